@@ -0,0 +1,57 @@
+#include "latency_histogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace tinydhcpd {
+LatencyHistogram::LatencyHistogram() : _buckets{}, _count(0), _max(0) {}
+
+// Values of SUB_BUCKET_BITS + g bits share a group of SUB_BUCKETS / 2
+// buckets, indexed by their SUB_BUCKET_BITS most significant bits.
+size_t LatencyHistogram::bucket_index(const uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return value;
+  }
+  const uint32_t group = std::bit_width(value) - SUB_BUCKET_BITS;
+  const uint64_t mantissa = value >> group;
+  return SUB_BUCKETS + (group - 1) * (SUB_BUCKETS / 2) +
+         (mantissa - SUB_BUCKETS / 2);
+}
+
+uint64_t LatencyHistogram::bucket_limit(const size_t index) {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  const uint32_t group = (index - SUB_BUCKETS) / (SUB_BUCKETS / 2) + 1;
+  const uint64_t mantissa =
+      (index - SUB_BUCKETS) % (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+  return ((mantissa + 1) << group) - 1;
+}
+
+void LatencyHistogram::record(const uint64_t value) {
+  _buckets[bucket_index(value)]++;
+  _count++;
+  _max = std::max(_max, value);
+}
+
+uint64_t LatencyHistogram::count() const { return _count; }
+
+uint64_t LatencyHistogram::max() const { return _max; }
+
+uint64_t LatencyHistogram::percentile(const double fraction) const {
+  if (_count == 0) {
+    return 0;
+  }
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(fraction * _count)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < _buckets.size(); i++) {
+    seen += _buckets[i];
+    if (seen >= rank) {
+      return std::min(bucket_limit(i), _max);
+    }
+  }
+  return _max;
+}
+} // namespace tinydhcpd
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace tinydhcpd {
+// Latencies (any unit) in log-linear buckets: values below 64 are exact,
+// larger ones are rounded up by at most 1/32, so a run of any length needs
+// the same few kilobytes.
+class LatencyHistogram {
+private:
+  static constexpr uint32_t SUB_BUCKET_BITS = 6;
+  static constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+  static constexpr size_t BUCKET_COUNT =
+      SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * (SUB_BUCKETS / 2);
+
+  std::array<uint64_t, BUCKET_COUNT> _buckets;
+  uint64_t _count;
+  uint64_t _max;
+
+  static size_t bucket_index(const uint64_t value);
+  // largest value that falls into the bucket
+  static uint64_t bucket_limit(const size_t index);
+
+public:
+  LatencyHistogram();
+
+  void record(const uint64_t value);
+  uint64_t count() const;
+  uint64_t max() const;
+  // the smallest value that is not exceeded by the given fraction of all
+  // recorded values (up to the rounding of its bucket), 0 if nothing has been
+  // recorded
+  uint64_t percentile(const double fraction) const;
+};
+} // namespace tinydhcpd
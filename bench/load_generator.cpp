@@ -0,0 +1,356 @@
+#include "load_generator.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "src/string-format.hpp"
+
+namespace tinydhcpd {
+namespace {
+constexpr uint8_t DHCP_TYPE_DISCOVER = 1;
+constexpr uint8_t DHCP_TYPE_OFFER = 2;
+constexpr uint8_t DHCP_TYPE_REQUEST = 3;
+constexpr uint8_t DHCP_TYPE_ACK = 5;
+constexpr uint8_t DHCP_TYPE_NAK = 6;
+constexpr uint8_t DHCP_TYPE_RELEASE = 7;
+
+constexpr uint16_t BROADCAST_FLAG = 0x8000;
+
+// subnet mask, routers, DNS servers, lease time
+constexpr std::array<uint8_t, 4> PARAMETER_REQUEST_LIST = {1, 3, 6, 51};
+
+uint64_t monotonic_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+LoadGenerator::LoadGenerator(const LoadConfiguration &config)
+    : _config(config), _socket_fd(-1), _clients(config.client_count),
+      _idle_clients(), _pending_replies(), _transactions_in_flight(0),
+      _transaction_counter(0), _bound_clients(0), _start_ns(0), _report() {
+  if (config.client_count == 0 || config.client_count > MAX_CLIENTS) {
+    throw std::invalid_argument(string_format(
+        "The number of clients must be between 1 and %u!", MAX_CLIENTS));
+  }
+  for (uint32_t i = 0; i < config.client_count; i++) {
+    // locally administered unicast addresses
+    _clients[i] = VirtualClient{
+        .hwaddr = {0x02, 0x00, static_cast<uint8_t>(i >> 24),
+                   static_cast<uint8_t>(i >> 16), static_cast<uint8_t>(i >> 8),
+                   static_cast<uint8_t>(i)},
+        .phase = Phase::IDLE,
+        .transaction_id = 0,
+        .exchange = 0,
+        .transaction_start_ns = 0,
+        .bound = false,
+        .address = INADDR_ANY,
+        .server_identifier = INADDR_ANY,
+        .renewals = 0};
+    _idle_clients.push_back(i);
+  }
+  _report.first_discover_timeout = -1;
+
+  _socket_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_socket_fd < 0) {
+    throw std::runtime_error(
+        string_format("Failed to create socket: %s", strerror(errno)));
+  }
+  int enable = 1;
+  setsockopt(_socket_fd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+  setsockopt(_socket_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  // replies arrive in bursts of up to the concurrency
+  int buffer_size = 4 << 20;
+  setsockopt(_socket_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size,
+             sizeof(buffer_size));
+  const bool relayed = config.relay_address != INADDR_ANY;
+  const struct sockaddr_in local_address {
+    .sin_family = AF_INET,
+    .sin_port = htons(relayed ? DHCP_SERVER_PORT : DHCP_CLIENT_PORT),
+    .sin_addr = {.s_addr = htonl(config.relay_address)}, .sin_zero = {}
+  };
+  if (bind(_socket_fd,
+           reinterpret_cast<const struct sockaddr *>(&local_address),
+           sizeof(local_address)) < 0) {
+    close(_socket_fd);
+    throw std::runtime_error(string_format(
+        "Failed to bind to %s:%u: %s", inet_ntoa(local_address.sin_addr),
+        ntohs(local_address.sin_port), strerror(errno)));
+  }
+}
+
+LoadGenerator::~LoadGenerator() noexcept { close(_socket_fd); }
+
+LoadReport LoadGenerator::run() {
+  _start_ns = monotonic_ns();
+  const uint64_t end_ns =
+      _start_ns + uint64_t{_config.duration_seconds} * 1000000000;
+  const uint64_t start_interval_ns =
+      _config.rate > 0 ? 1000000000 / _config.rate : 0;
+  uint64_t next_start_ns = _start_ns;
+  uint64_t now_ns = _start_ns;
+  while (now_ns < end_ns) {
+    if (_config.rate == 0) {
+      while (_transactions_in_flight < _config.concurrency &&
+             !_idle_clients.empty()) {
+        start_transaction(now_ns);
+      }
+    } else {
+      for (; next_start_ns <= now_ns; next_start_ns += start_interval_ns) {
+        if (_idle_clients.empty()) {
+          _report.skipped_starts++;
+        } else {
+          start_transaction(now_ns);
+        }
+      }
+    }
+    struct pollfd poll_fd {
+      .fd = _socket_fd, .events = POLLIN, .revents = 0
+    };
+    poll(&poll_fd, 1, 1);
+    receive_replies();
+    now_ns = monotonic_ns();
+    expire_replies(now_ns);
+  }
+
+  // let the transactions in flight finish or time out
+  while (_transactions_in_flight > 0) {
+    struct pollfd poll_fd {
+      .fd = _socket_fd, .events = POLLIN, .revents = 0
+    };
+    poll(&poll_fd, 1, 1);
+    receive_replies();
+    now_ns = monotonic_ns();
+    expire_replies(now_ns);
+  }
+  _report.elapsed_seconds = (now_ns - _start_ns) / 1e9;
+  if (_config.release) {
+    release_all();
+  }
+  return _report;
+}
+
+void LoadGenerator::start_transaction(const uint64_t now_ns) {
+  const uint32_t client_index = _idle_clients.front();
+  _idle_clients.pop_front();
+  VirtualClient &client = _clients[client_index];
+  client.transaction_id =
+      (++_transaction_counter << 20) | (client_index & (MAX_CLIENTS - 1));
+  client.transaction_start_ns = now_ns;
+  _transactions_in_flight++;
+
+  if (client.bound && client.renewals < _config.renewals) {
+    client.phase = Phase::RENEWING;
+    send_message(client, client_index, DHCP_TYPE_REQUEST, now_ns);
+    return;
+  }
+  if (client.bound) {
+    if (_config.release) {
+      send_message(client, client_index, DHCP_TYPE_RELEASE, now_ns);
+      _report.releases++;
+      client.address = INADDR_ANY;
+    }
+    // without a release, the server offers the same address again
+    client.bound = false;
+    _bound_clients--;
+  }
+  client.phase = Phase::SELECTING;
+  send_message(client, client_index, DHCP_TYPE_DISCOVER, now_ns);
+}
+
+void LoadGenerator::send_message(VirtualClient &client,
+                                 const uint32_t client_index,
+                                 const uint8_t message_type,
+                                 const uint64_t now_ns) {
+  DhcpDatagram message{._opcode = 0x1,
+                       ._hwaddr_type = 1, // Ethernet
+                       ._hwaddr_len = 6,
+                       ._transaction_id = client.transaction_id,
+                       ._secs_passed = 0,
+                       ._flags = static_cast<uint16_t>(
+                           _config.relay_address == INADDR_ANY ? BROADCAST_FLAG
+                                                               : 0),
+                       ._client_ip = INADDR_ANY,
+                       ._assigned_ip = INADDR_ANY,
+                       ._server_ip = INADDR_ANY,
+                       ._relay_agent_ip = _config.relay_address,
+                       ._recv_addr = INADDR_ANY,
+                       ._recv_ifindex = 0,
+                       ._max_message_size = DEFAULT_MAX_MESSAGE_SIZE,
+                       ._hw_addr = client.hwaddr,
+                       ._options = DhcpOptions(),
+                       ._option_block = {}};
+  message._options.set(OptionTag::DHCP_MESSAGE_TYPE, {message_type});
+  if (message_type == DHCP_TYPE_RELEASE) {
+    message._client_ip = client.address;
+    message._options.set(OptionTag::SERVER_IDENTIFIER,
+                         to_byte_array(client.server_identifier));
+  } else if (client.phase == Phase::RENEWING) {
+    message._client_ip = client.address;
+  } else {
+    message._options.set(OptionTag::PARAMETER_REQUEST_LIST,
+                         PARAMETER_REQUEST_LIST);
+    if (client.phase == Phase::REQUESTING) {
+      message._options.set(OptionTag::REQUESTED_IP_ADDRESS,
+                           to_byte_array(client.address));
+      message._options.set(OptionTag::SERVER_IDENTIFIER,
+                           to_byte_array(client.server_identifier));
+    }
+  }
+
+  std::array<uint8_t, DEFAULT_MAX_MESSAGE_SIZE> buffer;
+  const size_t length = message.encode(buffer.data(), buffer.size());
+  if (sendto(_socket_fd, buffer.data(), length, 0,
+             reinterpret_cast<const struct sockaddr *>(&_config.server),
+             sizeof(_config.server)) < 0 &&
+      errno != EWOULDBLOCK && errno != ENOBUFS) {
+    throw std::runtime_error(
+        string_format("Failed to send: %s", strerror(errno)));
+  }
+  // a message that could not be sent times out like a lost one
+  if (message_type != DHCP_TYPE_RELEASE) {
+    client.exchange++;
+    _pending_replies.push_back(PendingReply{
+        .deadline_ns = now_ns + uint64_t{_config.timeout_ms} * 1000000,
+        .client_index = client_index,
+        .exchange = client.exchange});
+  }
+}
+
+void LoadGenerator::receive_replies() {
+  std::array<uint8_t, 1500> buffer;
+  while (true) {
+    const ssize_t length = recv(_socket_fd, buffer.data(), buffer.size(), 0);
+    if (length < 0) {
+      if (errno == EWOULDBLOCK || errno == EINTR) {
+        return;
+      }
+      throw std::runtime_error(
+          string_format("Failed to receive: %s", strerror(errno)));
+    }
+    const uint64_t now_ns = monotonic_ns();
+    try {
+      DhcpDatagram reply = DhcpDatagram::from_buffer(buffer.data(), length);
+      handle_reply(reply, now_ns);
+    } catch (std::invalid_argument &ex) {
+      _report.unexpected_replies++;
+    }
+  }
+}
+
+void LoadGenerator::handle_reply(DhcpDatagram &reply, const uint64_t now_ns) {
+  const uint32_t client_index = reply._transaction_id & (MAX_CLIENTS - 1);
+  const std::span<const uint8_t> message_type =
+      reply._options.get(OptionTag::DHCP_MESSAGE_TYPE);
+  if (reply._opcode != 0x2 || message_type.empty() ||
+      client_index >= _clients.size() ||
+      _clients[client_index].transaction_id != reply._transaction_id ||
+      _clients[client_index].phase == Phase::IDLE ||
+      reply._hw_addr != _clients[client_index].hwaddr) {
+    _report.unexpected_replies++;
+    return;
+  }
+  VirtualClient &client = _clients[client_index];
+  const uint64_t latency_us = (now_ns - client.transaction_start_ns) / 1000;
+  switch (message_type[0]) {
+  case DHCP_TYPE_OFFER:
+    if (client.phase != Phase::SELECTING) {
+      break;
+    }
+    client.address = reply._assigned_ip;
+    client.server_identifier =
+        reply._options.contains(OptionTag::SERVER_IDENTIFIER)
+            ? to_number<in_addr_t>(
+                  reply._options.get(OptionTag::SERVER_IDENTIFIER))
+            : ntohl(_config.server.sin_addr.s_addr);
+    client.phase = Phase::REQUESTING;
+    send_message(client, client_index, DHCP_TYPE_REQUEST, now_ns);
+    return;
+  case DHCP_TYPE_ACK:
+    if (client.phase == Phase::REQUESTING) {
+      _report.dora_latency.record(latency_us);
+      client.bound = true;
+      client.renewals = 0;
+      _bound_clients++;
+      _report.peak_leases = std::max(_report.peak_leases, _bound_clients);
+    } else {
+      _report.renew_latency.record(latency_us);
+      client.renewals++;
+    }
+    finish_transaction(client, client_index);
+    return;
+  case DHCP_TYPE_NAK:
+    if (client.phase == Phase::REQUESTING) {
+      _report.request_naks++;
+    } else if (client.phase == Phase::RENEWING) {
+      _report.renew_naks++;
+      client.bound = false;
+      _bound_clients--;
+    } else {
+      break;
+    }
+    finish_transaction(client, client_index);
+    return;
+  }
+  _report.unexpected_replies++;
+}
+
+void LoadGenerator::expire_replies(const uint64_t now_ns) {
+  while (!_pending_replies.empty() &&
+         _pending_replies.front().deadline_ns <= now_ns) {
+    const PendingReply pending = _pending_replies.front();
+    _pending_replies.pop_front();
+    VirtualClient &client = _clients[pending.client_index];
+    if (client.phase == Phase::IDLE || client.exchange != pending.exchange) {
+      // answered in time
+      continue;
+    }
+    switch (client.phase) {
+    case Phase::SELECTING:
+      _report.discover_timeouts++;
+      if (_report.first_discover_timeout < 0) {
+        _report.first_discover_timeout =
+            (now_ns - _start_ns - uint64_t{_config.timeout_ms} * 1000000) /
+            1e9;
+      }
+      break;
+    case Phase::REQUESTING:
+      _report.request_timeouts++;
+      break;
+    case Phase::RENEWING:
+      // the lease is still valid, the next transaction renews it again
+      _report.renew_timeouts++;
+      break;
+    case Phase::IDLE:
+      break;
+    }
+    finish_transaction(client, pending.client_index);
+  }
+}
+
+void LoadGenerator::finish_transaction(VirtualClient &client,
+                                       const uint32_t client_index) {
+  client.phase = Phase::IDLE;
+  _transactions_in_flight--;
+  _idle_clients.push_back(client_index);
+}
+
+// Returns the leases of the run to the pool.
+void LoadGenerator::release_all() {
+  const uint64_t now_ns = monotonic_ns();
+  for (uint32_t i = 0; i < _clients.size(); i++) {
+    if (_clients[i].bound) {
+      send_message(_clients[i], i, DHCP_TYPE_RELEASE, now_ns);
+      _clients[i].bound = false;
+    }
+  }
+}
+} // namespace tinydhcpd
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <netinet/in.h>
+#include <vector>
+
+#include "latency_histogram.hpp"
+#include "src/datagram.hpp"
+
+namespace tinydhcpd {
+struct LoadConfiguration {
+  // where requests are sent to
+  struct sockaddr_in server;
+  // Requests are relayed through this address (host byte order), which the
+  // generator binds to on port 67, so that replies are unicast to it. With
+  // INADDR_ANY, the generator acts as directly attached clients that ask for
+  // broadcast replies on port 68.
+  in_addr_t relay_address;
+  uint32_t client_count;
+  // transactions in flight at any time, if rate is 0
+  uint32_t concurrency;
+  // transactions started per second, 0 = closed loop
+  uint32_t rate;
+  uint32_t duration_seconds;
+  uint32_t timeout_ms;
+  // renewals of every lease before it is released
+  uint32_t renewals;
+  // without releasing, clients start over with a DISCOVER for their lease
+  bool release;
+};
+
+struct LoadReport {
+  double elapsed_seconds;
+  // DISCOVER to ACK, in microseconds
+  LatencyHistogram dora_latency;
+  // REQUEST to ACK of a renewal, in microseconds
+  LatencyHistogram renew_latency;
+  uint64_t releases;
+  uint64_t request_naks;
+  uint64_t renew_naks;
+  // a server with an exhausted pool does not answer DISCOVERs at all
+  uint64_t discover_timeouts;
+  uint64_t request_timeouts;
+  uint64_t renew_timeouts;
+  // only with a rate: starts that found every client busy
+  uint64_t skipped_starts;
+  uint64_t unexpected_replies;
+  uint64_t peak_leases;
+  // seconds into the run, negative if every DISCOVER was answered
+  double first_discover_timeout;
+};
+
+// Runs virtual clients with distinct hardware addresses through
+// DISCOVER/OFFER/REQUEST/ACK, renewals and releases against a server, from a
+// single thread.
+class LoadGenerator {
+private:
+  enum struct Phase { IDLE, SELECTING, REQUESTING, RENEWING };
+
+  struct VirtualClient {
+    std::array<uint8_t, 16> hwaddr;
+    Phase phase;
+    uint32_t transaction_id;
+    // bumped for every message that expects a reply
+    uint32_t exchange;
+    uint64_t transaction_start_ns;
+    bool bound;
+    in_addr_t address;
+    in_addr_t server_identifier;
+    uint32_t renewals;
+  };
+
+  struct PendingReply {
+    uint64_t deadline_ns;
+    uint32_t client_index;
+    uint32_t exchange;
+  };
+
+  const LoadConfiguration _config;
+  int _socket_fd;
+  std::vector<VirtualClient> _clients;
+  // idle clients, in the order in which they became idle
+  std::deque<uint32_t> _idle_clients;
+  // all replies share the same timeout, so deadlines are ordered
+  std::deque<PendingReply> _pending_replies;
+  uint32_t _transactions_in_flight;
+  uint32_t _transaction_counter;
+  uint64_t _bound_clients;
+  uint64_t _start_ns;
+  LoadReport _report;
+
+  void start_transaction(const uint64_t now_ns);
+  void send_message(VirtualClient &client, const uint32_t client_index,
+                    const uint8_t message_type, const uint64_t now_ns);
+  void receive_replies();
+  void handle_reply(DhcpDatagram &reply, const uint64_t now_ns);
+  void expire_replies(const uint64_t now_ns);
+  void finish_transaction(VirtualClient &client, const uint32_t client_index);
+  void release_all();
+
+public:
+  static constexpr uint32_t MAX_CLIENTS = 1 << 20;
+
+  explicit LoadGenerator(const LoadConfiguration &config);
+  ~LoadGenerator() noexcept;
+  LoadGenerator(const LoadGenerator &other) = delete;
+
+  LoadReport run();
+};
+} // namespace tinydhcpd
@@ -0,0 +1,176 @@
+#include <arpa/inet.h>
+#include <getopt.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include "load_generator.hpp"
+#include "src/log/logger.hpp"
+#include "src/log/stdout_logsink.hpp"
+
+const char SERVER_TAG = 's';
+const char RELAY_TAG = 'r';
+const char CLIENTS_TAG = 'n';
+const char CONCURRENCY_TAG = 'c';
+const char RATE_TAG = 'R';
+const char DURATION_TAG = 'd';
+const char TIMEOUT_TAG = 't';
+const char RENEWALS_TAG = 'w';
+const char KEEP_LEASES_TAG = 'k';
+
+const struct option long_options[] = {
+    {"server", required_argument, nullptr, SERVER_TAG},
+    {"relay", required_argument, nullptr, RELAY_TAG},
+    {"clients", required_argument, nullptr, CLIENTS_TAG},
+    {"concurrency", required_argument, nullptr, CONCURRENCY_TAG},
+    {"rate", required_argument, nullptr, RATE_TAG},
+    {"duration", required_argument, nullptr, DURATION_TAG},
+    {"timeout", required_argument, nullptr, TIMEOUT_TAG},
+    {"renewals", required_argument, nullptr, RENEWALS_TAG},
+    {"keep-leases", no_argument, nullptr, KEEP_LEASES_TAG},
+    {nullptr, 0, nullptr, 0}};
+
+void print_usage(const char *program) {
+  std::fprintf(
+      stderr,
+      "Usage: %s [options]\n"
+      "-s, --server <address>    Send requests to <address> (127.0.0.1)\n"
+      "-r, --relay <address>     Relay requests from <address>:67, instead of\n"
+      "                          receiving broadcast replies on port 68\n"
+      "-n, --clients <n>         Simulate <n> clients (1000)\n"
+      "-c, --concurrency <n>     Keep <n> transactions in flight (64)\n"
+      "-R, --rate <n>            Start <n> transactions per second instead\n"
+      "-d, --duration <s>        Run for <s> seconds (10)\n"
+      "-t, --timeout <ms>        Give up on a reply after <ms> (1000)\n"
+      "-w, --renewals <n>        Renew every lease <n> times (1)\n"
+      "-k, --keep-leases         Start over without releasing the lease\n",
+      program);
+}
+
+uint32_t parse_number(const char *argument) {
+  char *end;
+  const unsigned long value = std::strtoul(argument, &end, 10);
+  if (*argument == '\0' || *end != '\0' || value > UINT32_MAX) {
+    throw std::invalid_argument(std::string("Not a number: ") + argument);
+  }
+  return static_cast<uint32_t>(value);
+}
+
+in_addr_t parse_address(const char *argument) {
+  struct in_addr address;
+  if (inet_aton(argument, &address) == 0) {
+    throw std::invalid_argument(std::string("Not an address: ") + argument);
+  }
+  return ntohl(address.s_addr);
+}
+
+void print_latency(const char *name, const tinydhcpd::LatencyHistogram &latency,
+                   const double elapsed_seconds) {
+  std::printf("%-6s %10lu %10.1f/s   latency us: p50 %lu  p99 %lu  "
+              "p999 %lu  max %lu\n",
+              name, latency.count(), latency.count() / elapsed_seconds,
+              latency.percentile(0.5), latency.percentile(0.99),
+              latency.percentile(0.999), latency.max());
+}
+
+void print_report(const tinydhcpd::LoadReport &report) {
+  const uint64_t transactions =
+      report.dora_latency.count() + report.renew_latency.count();
+  std::printf("Elapsed: %.2f s\n", report.elapsed_seconds);
+  std::printf("Transactions: %lu, %.1f/s\n", transactions,
+              transactions / report.elapsed_seconds);
+  print_latency("DORA", report.dora_latency, report.elapsed_seconds);
+  print_latency("Renew", report.renew_latency, report.elapsed_seconds);
+  std::printf("Releases: %lu\n", report.releases);
+  std::printf("NAKs: request %lu, renew %lu\n", report.request_naks,
+              report.renew_naks);
+  std::printf("Timeouts: discover %lu, request %lu, renew %lu\n",
+              report.discover_timeouts, report.request_timeouts,
+              report.renew_timeouts);
+  std::printf("Peak leases held: %lu\n", report.peak_leases);
+  if (report.first_discover_timeout >= 0) {
+    // an exhausted pool shows up as unanswered DISCOVERs
+    std::printf("First unanswered DISCOVER after %.2f s\n",
+                report.first_discover_timeout);
+  }
+  if (report.skipped_starts > 0) {
+    std::printf("Skipped starts (all clients busy): %lu\n",
+                report.skipped_starts);
+  }
+  if (report.unexpected_replies > 0) {
+    std::printf("Unexpected replies: %lu\n", report.unexpected_replies);
+  }
+}
+
+int main(int argc, char *const argv[]) {
+  tinydhcpd::LoadConfiguration config = {
+      .server = {.sin_family = AF_INET,
+                 .sin_port = htons(tinydhcpd::DHCP_SERVER_PORT),
+                 .sin_addr = {.s_addr = htonl(INADDR_LOOPBACK)},
+                 .sin_zero = {}},
+      .relay_address = INADDR_ANY,
+      .client_count = 1000,
+      .concurrency = 64,
+      .rate = 0,
+      .duration_seconds = 10,
+      .timeout_ms = 1000,
+      .renewals = 1,
+      .release = true};
+
+  tinydhcpd::global_logger.reset(
+      new tinydhcpd::Logger(*(new tinydhcpd::StdoutLogSink())));
+  tinydhcpd::current_global_log_level = tinydhcpd::Level::WARN;
+
+  try {
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:r:n:c:R:d:t:w:k", long_options,
+                              nullptr)) != -1) {
+      switch (opt) {
+      case SERVER_TAG:
+        config.server.sin_addr.s_addr = htonl(parse_address(optarg));
+        break;
+      case RELAY_TAG:
+        config.relay_address = parse_address(optarg);
+        break;
+      case CLIENTS_TAG:
+        config.client_count = parse_number(optarg);
+        break;
+      case CONCURRENCY_TAG:
+        config.concurrency = parse_number(optarg);
+        break;
+      case RATE_TAG:
+        config.rate = parse_number(optarg);
+        // the transactions are started at intervals of whole nanoseconds
+        if (config.rate > 1000000000) {
+          throw std::invalid_argument(
+              "The rate must not exceed 1000000000 per second");
+        }
+        break;
+      case DURATION_TAG:
+        config.duration_seconds = parse_number(optarg);
+        break;
+      case TIMEOUT_TAG:
+        config.timeout_ms = parse_number(optarg);
+        break;
+      case RENEWALS_TAG:
+        config.renewals = parse_number(optarg);
+        break;
+      case KEEP_LEASES_TAG:
+        config.release = false;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+
+    tinydhcpd::LoadGenerator generator(config);
+    print_report(generator.run());
+  } catch (std::exception &ex) {
+    std::fprintf(stderr, "%s\n", ex.what());
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
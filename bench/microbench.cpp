@@ -0,0 +1,411 @@
+// Microbenchmarks of the per-message and per-lease code paths. Every result is
+// printed as one JSON object per line, so runs can be diffed or collected by
+// `meson benchmark`.
+
+#include <getopt.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "src/address_pool.hpp"
+#include "src/datagram.hpp"
+#include "src/lease_expiry_queue.hpp"
+#include "src/lease_file.hpp"
+#include "src/lease_table.hpp"
+#include "src/log/logger.hpp"
+#include "src/log/stdout_logsink.hpp"
+#include "src/option_block_cache.hpp"
+#include "src/reservation_table.hpp"
+
+namespace {
+std::atomic<uint64_t> allocation_count(0);
+
+// Neither function is inlined, so the compiler does not see malloc() and
+// free() paired with operator new and delete.
+[[gnu::noinline]] void *allocate(const size_t size, const size_t alignment) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  void *pointer =
+      alignment <= alignof(std::max_align_t)
+          ? std::malloc(size == 0 ? 1 : size)
+          : std::aligned_alloc(alignment,
+                               (size + alignment - 1) / alignment * alignment);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+[[gnu::noinline]] void deallocate(void *pointer) noexcept {
+  std::free(pointer);
+}
+} // namespace
+
+// Counts every heap allocation of the process.
+void *operator new(size_t size) {
+  return allocate(size, alignof(std::max_align_t));
+}
+void *operator new[](size_t size) {
+  return allocate(size, alignof(std::max_align_t));
+}
+void *operator new(size_t size, std::align_val_t alignment) {
+  return allocate(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return allocate(size, static_cast<size_t>(alignment));
+}
+void operator delete(void *pointer) noexcept { deallocate(pointer); }
+void operator delete[](void *pointer) noexcept { deallocate(pointer); }
+void operator delete(void *pointer, size_t) noexcept { deallocate(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { deallocate(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept {
+  deallocate(pointer);
+}
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+  deallocate(pointer);
+}
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+  deallocate(pointer);
+}
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept {
+  deallocate(pointer);
+}
+
+namespace tinydhcpd {
+namespace {
+// keeps the compiler from optimizing away a result
+template <typename T> void keep(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchmarkSettings {
+  std::string filter;
+  std::chrono::nanoseconds min_time;
+};
+
+BenchmarkSettings settings{.filter = "",
+                           .min_time = std::chrono::milliseconds(200)};
+
+// Runs the operation in growing batches until min_time has passed, and prints
+// the time and allocations per operation.
+template <typename F> void run_benchmark(const std::string &name, F operation) {
+  if (name.find(settings.filter) == std::string::npos) {
+    return;
+  }
+  using clock = std::chrono::steady_clock;
+  operation(); // warm up
+  uint64_t iterations = 0;
+  uint64_t batch_size = 1;
+  const uint64_t allocations_before =
+      allocation_count.load(std::memory_order_relaxed);
+  const clock::time_point start = clock::now();
+  clock::duration elapsed{};
+  while (elapsed < settings.min_time) {
+    for (uint64_t i = 0; i < batch_size; i++) {
+      operation();
+    }
+    iterations += batch_size;
+    batch_size *= 2;
+    elapsed = clock::now() - start;
+  }
+  const uint64_t allocations =
+      allocation_count.load(std::memory_order_relaxed) - allocations_before;
+  std::printf("{\"benchmark\": \"%s\", \"iterations\": %lu, "
+              "\"ns_per_op\": %.2f, \"allocs_per_op\": %.3f}\n",
+              name.c_str(), iterations,
+              std::chrono::duration<double, std::nano>(elapsed).count() /
+                  iterations,
+              static_cast<double>(allocations) / iterations);
+  std::fflush(stdout);
+}
+
+HardwareAddress client_hwaddr(const uint32_t index) {
+  const uint8_t octets[6] = {0x02,
+                             0x00,
+                             static_cast<uint8_t>(index >> 24),
+                             static_cast<uint8_t>(index >> 16),
+                             static_cast<uint8_t>(index >> 8),
+                             static_cast<uint8_t>(index)};
+  return HardwareAddress(octets, 6);
+}
+
+// A DISCOVER as sent by a typical client.
+std::vector<uint8_t> encode_discover() {
+  DhcpDatagram discover{._opcode = 0x1,
+                        ._hwaddr_type = 1,
+                        ._hwaddr_len = 6,
+                        ._transaction_id = 0x12345678,
+                        ._secs_passed = 0,
+                        ._flags = 0x8000,
+                        ._client_ip = INADDR_ANY,
+                        ._assigned_ip = INADDR_ANY,
+                        ._server_ip = INADDR_ANY,
+                        ._relay_agent_ip = INADDR_ANY,
+                        ._recv_addr = INADDR_ANY,
+                        ._recv_ifindex = 0,
+                        ._max_message_size = DEFAULT_MAX_MESSAGE_SIZE,
+                        ._hw_addr = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+                        ._options = DhcpOptions(),
+                        ._option_block = {}};
+  discover._options.set(OptionTag::DHCP_MESSAGE_TYPE, {1});
+  discover._options.set(OptionTag::PARAMETER_REQUEST_LIST,
+                        {1, 2, 3, 6, 12, 15, 26, 28, 33, 42, 51, 58, 59, 119});
+  discover._options.set(OptionTag::MAX_MESSAGE_SIZE, {0x05, 0xc0});
+  discover._options.set(OptionTag::REQUESTED_IP_ADDRESS, {10, 0, 0, 42});
+  discover._options.set(OptionTag::HOSTNAME,
+                        {'b', 'e', 'n', 'c', 'h', '-', 'h', 'o', 's', 't'});
+  std::vector<uint8_t> buffer(discover.encoded_size());
+  discover.encode(buffer.data(), buffer.size());
+  return buffer;
+}
+
+const std::map<OptionTag, std::vector<uint8_t>> configured_options = {
+    {OptionTag::SUBNET_MASK, {255, 255, 0, 0}},
+    {OptionTag::ROUTERS, {10, 0, 0, 1}},
+    {OptionTag::DNS_SERVER, {8, 8, 8, 8, 1, 1, 1, 1}},
+    {OptionTag::DOMAIN_NAME, {'e', 'x', 'a', 'm', 'p', 'l', 'e'}},
+    {OptionTag::IFACE_MTU, {0x05, 0xdc}},
+    {OptionTag::BROADCAST_ADDR, {10, 0, 255, 255}},
+    {OptionTag::LEASE_TIME, {0, 0, 0x0e, 0x10}}};
+
+void benchmark_codec() {
+  std::vector<uint8_t> discover = encode_discover();
+  run_benchmark("datagram/from_buffer", [&discover]() {
+    keep(DhcpDatagram::from_buffer(discover.data(), discover.size()));
+  });
+  run_benchmark("options/parse", [&discover]() {
+    keep(DhcpOptions::parse(discover.data() + 240, discover.size() - 240));
+  });
+
+  OptionBlockCache option_blocks(configured_options);
+  const DhcpDatagram request =
+      DhcpDatagram::from_buffer(discover.data(), discover.size());
+  DhcpDatagram reply = request;
+  reply._opcode = 0x2;
+  reply._options = DhcpOptions();
+  reply._options.set(OptionTag::DHCP_MESSAGE_TYPE, {2});
+  reply._options.set(OptionTag::SERVER_IDENTIFIER, {10, 0, 0, 1});
+  reply._options.set(OptionTag::LEASE_TIME, {0, 0, 0x0e, 0x10});
+  // what Daemon::set_requested_options() does for every reply
+  run_benchmark("options/requested_block_hit", [&]() {
+    reply._option_block = option_blocks.get(
+        request._options.get(OptionTag::PARAMETER_REQUEST_LIST));
+    keep(reply._option_block);
+  });
+  // more distinct request lists than cache entries
+  std::vector<std::vector<uint8_t>> request_lists;
+  for (uint8_t i = 0; i < 128; i++) {
+    request_lists.push_back({1, 3, 6, 15, 26, 28, 51, i});
+  }
+  size_t next_list = 0;
+  run_benchmark("options/requested_block_miss", [&]() {
+    keep(option_blocks.get(request_lists[next_list]));
+    next_list = (next_list + 1) % request_lists.size();
+  });
+  reply._option_block = option_blocks.get(
+      request._options.get(OptionTag::PARAMETER_REQUEST_LIST));
+  std::array<uint8_t, 1500> buffer;
+  run_benchmark("datagram/encode", [&]() {
+    keep(reply.encode(buffer.data(), buffer.size()));
+  });
+}
+
+void benchmark_bytemanip() {
+  uint32_t number = 0x0a000001;
+  std::array<uint8_t, 4> bytes = {10, 0, 0, 1};
+  run_benchmark("bytemanip/to_byte_vector", [&number]() {
+    keep(to_byte_vector(number));
+    number++;
+  });
+  run_benchmark("bytemanip/to_byte_array", [&number]() {
+    keep(to_byte_array(number));
+    number++;
+  });
+  run_benchmark("bytemanip/to_number", [&bytes]() {
+    keep(to_number<uint32_t>(std::span<const uint8_t>(bytes)));
+    bytes[3]++;
+  });
+  run_benchmark("bytemanip/to_network_byte_array", [&number]() {
+    keep(to_network_byte_array(number));
+    number++;
+  });
+  run_benchmark("bytemanip/load_network_order", [&bytes]() {
+    keep(load_network_order<uint32_t>(bytes.data()));
+    bytes[3]++;
+  });
+  run_benchmark("bytemanip/store_network_order", [&bytes, &number]() {
+    store_network_order(bytes.data(), number);
+    keep(bytes);
+    number++;
+  });
+}
+
+// The lease bookkeeping of the daemon, which keeps the lease table, the
+// address pool and the expiry queue in sync.
+struct LeaseState {
+  AddressPool pool;
+  LeaseTable leases;
+  LeaseExpiryQueue expiry_queue;
+
+  // a pool of 2^16 addresses with lease_count of them leased
+  explicit LeaseState(const uint32_t lease_count)
+      : pool(0x0a000000, 0x0a00ffff), leases(), expiry_queue() {
+    for (uint32_t i = 0; i < lease_count; i++) {
+      const in_addr_t address = pool.find_free().value();
+      pool.reserve(address);
+      leases.insert_or_assign(client_hwaddr(i), address, 2000000000 + i);
+    }
+    expiry_queue.rebuild(leases);
+  }
+};
+
+void benchmark_lease_operations() {
+  for (const uint32_t lease_count : {1000u, 32768u}) {
+    LeaseState state(lease_count);
+    uint32_t next_client = lease_count;
+    // handle_discovery for a new client: find an address and record the
+    // offer, then forget the lease again to stay at the same fill level
+    run_benchmark(
+        "leases/allocate/" + std::to_string(lease_count), [&state,
+                                                           &next_client]() {
+          const HardwareAddress hwaddr = client_hwaddr(next_client++);
+          const in_addr_t address = state.pool.find_free().value();
+          state.pool.reserve(address);
+          state.leases.insert_or_assign(hwaddr, address, 1000);
+          keep(state.leases.find(hwaddr));
+          state.pool.release(address);
+          state.leases.erase(hwaddr);
+        });
+
+    // update_leases with one due lease per call
+    uint64_t now = 1000;
+    run_benchmark(
+        "leases/expire/" + std::to_string(lease_count), [&state, &next_client,
+                                                         &now]() {
+          const HardwareAddress hwaddr = client_hwaddr(next_client++);
+          const in_addr_t address = state.pool.find_free().value();
+          state.pool.reserve(address);
+          state.leases.insert_or_assign(hwaddr, address, now);
+          state.expiry_queue.schedule(hwaddr, now);
+          state.expiry_queue.pop_due(
+              now, [&state](const HardwareAddress &due_hwaddr,
+                            const uint64_t timeout_timestamp) {
+                const Lease *lease = state.leases.find(due_hwaddr);
+                if (lease == nullptr ||
+                    lease->timeout_timestamp != timeout_timestamp) {
+                  return;
+                }
+                state.pool.release(lease->address);
+                state.leases.erase(due_hwaddr);
+              });
+          now++;
+        });
+  }
+}
+
+// the fixed host lookups of handle_discovery() and release_address()
+void benchmark_reservations() {
+  constexpr uint32_t RESERVATION_COUNT = 20000;
+  std::vector<Reservation> reservations;
+  for (uint32_t i = 0; i < RESERVATION_COUNT; i++) {
+    Reservation reservation{.hwaddr = {}, .address = 0x0a000000 + i};
+    std::copy_n(client_hwaddr(i).octets.begin(), ETHER_ADDR_LEN,
+                reservation.hwaddr.begin());
+    reservations.push_back(reservation);
+  }
+  const ReservationTable table(std::move(reservations));
+  uint32_t next_client = 0;
+  run_benchmark("reservations/find_hit/20000", [&table, &next_client]() {
+    keep(table.find(client_hwaddr(next_client++ % RESERVATION_COUNT)));
+  });
+  run_benchmark("reservations/find_miss/20000", [&table, &next_client]() {
+    keep(table.find(client_hwaddr(RESERVATION_COUNT + next_client++)));
+  });
+  run_benchmark("reservations/find_by_address/20000",
+                [&table, &next_client]() {
+                  keep(table.find_by_address(0x0a000000 +
+                                             next_client++ % 65536));
+                });
+}
+
+// load_leases() and write_leases() read and write the whole file
+void benchmark_lease_file() {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "tinydhcpd-microbench-leases")
+          .string();
+  for (const uint32_t lease_count : {1000u, 100000u, 1000000u}) {
+    std::vector<Lease> leases;
+    leases.reserve(lease_count);
+    for (uint32_t i = 0; i < lease_count; i++) {
+      leases.push_back(Lease{.hwaddr = client_hwaddr(i),
+                             .address = 0x0a000000 + i,
+                             .timeout_timestamp = 2000000000 + i});
+    }
+    for (const auto &[format, format_name] :
+         {std::make_pair(LeaseFileFormat::BINARY, "binary"),
+          std::make_pair(LeaseFileFormat::TEXT, "text")}) {
+      const std::string suffix =
+          std::string(format_name) + "/" + std::to_string(lease_count);
+      run_benchmark("lease_file/write/" + suffix, [&]() {
+        write_lease_file(path, leases, format);
+      });
+      write_lease_file(path, leases, format);
+      LeaseTable table;
+      table.reserve(lease_count);
+      run_benchmark("lease_file/read/" + suffix, [&]() {
+        read_lease_file(path, [&table](const Lease &lease) {
+          table.insert_or_assign(lease.hwaddr, lease.address,
+                                 lease.timeout_timestamp);
+        });
+      });
+    }
+  }
+  std::filesystem::remove(path);
+}
+} // namespace
+} // namespace tinydhcpd
+
+int main(int argc, char *const argv[]) {
+  const struct option long_options[] = {
+      {"filter", required_argument, nullptr, 'f'},
+      {"min-time", required_argument, nullptr, 'm'},
+      {nullptr, 0, nullptr, 0}};
+  int opt;
+  while ((opt = getopt_long(argc, argv, "f:m:", long_options, nullptr)) !=
+         -1) {
+    switch (opt) {
+    case 'f':
+      tinydhcpd::settings.filter = optarg;
+      break;
+    case 'm':
+      tinydhcpd::settings.min_time =
+          std::chrono::milliseconds(std::atoi(optarg));
+      break;
+    default:
+      std::fprintf(stderr,
+                   "Usage: %s [--filter <substring>] [--min-time <ms>]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  // only warnings, the lease file reader logs at INFO
+  tinydhcpd::global_logger.reset(
+      new tinydhcpd::Logger(*(new tinydhcpd::StdoutLogSink())));
+  tinydhcpd::current_global_log_level = tinydhcpd::Level::WARN;
+
+  tinydhcpd::benchmark_codec();
+  tinydhcpd::benchmark_bytemanip();
+  tinydhcpd::benchmark_lease_operations();
+  tinydhcpd::benchmark_reservations();
+  tinydhcpd::benchmark_lease_file();
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include "address_pool.hpp"
+
+#include <bit>
+#include <stdexcept>
+
+namespace tinydhcpd {
+constexpr size_t BITS_PER_WORD = 64;
+
+AddressPool::AddressPool(const in_addr_t first_hostorder,
+                         const in_addr_t last_hostorder)
+    : _first(first_hostorder), _last(last_hostorder), _free_count(0),
+      _levels() {
+  if (last_hostorder < first_hostorder) {
+    throw std::invalid_argument("Address range end lies before its start!");
+  }
+  const size_t address_count =
+      static_cast<size_t>(last_hostorder - first_hostorder) + 1;
+
+  size_t word_count = address_count;
+  do {
+    word_count = (word_count + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    _levels.emplace_back(word_count, 0);
+  } while (word_count > 1);
+
+  for (size_t index = 0; index < address_count; index++) {
+    set_free_bit(index);
+  }
+  _free_count = address_count;
+}
+
+void AddressPool::set_free_bit(size_t index) {
+  for (auto &level : _levels) {
+    uint64_t &word = level[index / BITS_PER_WORD];
+    const bool was_empty = word == 0;
+    word |= uint64_t{1} << (index % BITS_PER_WORD);
+    if (!was_empty) {
+      // the summary bits above are already set
+      return;
+    }
+    index /= BITS_PER_WORD;
+  }
+}
+
+void AddressPool::clear_free_bit(size_t index) {
+  for (auto &level : _levels) {
+    uint64_t &word = level[index / BITS_PER_WORD];
+    word &= ~(uint64_t{1} << (index % BITS_PER_WORD));
+    if (word != 0) {
+      // there are other free addresses below the summary bit
+      return;
+    }
+    index /= BITS_PER_WORD;
+  }
+}
+
+bool AddressPool::contains(const in_addr_t address_hostorder) const {
+  return address_hostorder >= _first && address_hostorder <= _last;
+}
+
+bool AddressPool::is_free(const in_addr_t address_hostorder) const {
+  if (!contains(address_hostorder)) {
+    return false;
+  }
+  const size_t index = address_hostorder - _first;
+  return (_levels.front()[index / BITS_PER_WORD] &
+          (uint64_t{1} << (index % BITS_PER_WORD))) != 0;
+}
+
+std::optional<in_addr_t> AddressPool::find_free() const {
+  if (_levels.back().front() == 0) {
+    return std::nullopt;
+  }
+  size_t index = 0;
+  for (auto level = _levels.crbegin(); level != _levels.crend(); level++) {
+    index = index * BITS_PER_WORD + std::countr_zero((*level)[index]);
+  }
+  return _first + static_cast<in_addr_t>(index);
+}
+
+bool AddressPool::reserve(const in_addr_t address_hostorder) {
+  if (!is_free(address_hostorder)) {
+    return false;
+  }
+  clear_free_bit(address_hostorder - _first);
+  _free_count--;
+  return true;
+}
+
+void AddressPool::release(const in_addr_t address_hostorder) {
+  if (!contains(address_hostorder) || is_free(address_hostorder)) {
+    return;
+  }
+  set_free_bit(address_hostorder - _first);
+  _free_count++;
+}
+
+in_addr_t AddressPool::first() const { return _first; }
+
+in_addr_t AddressPool::last() const { return _last; }
+
+size_t AddressPool::size() const {
+  return static_cast<size_t>(_last - _first) + 1;
+}
+
+size_t AddressPool::free_count() const { return _free_count; }
+} // namespace tinydhcpd
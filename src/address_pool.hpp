@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <optional>
+#include <vector>
+
+namespace tinydhcpd {
+// Keeps track of the free addresses of a contiguous range (host byte order).
+//
+// Level 0 holds one bit per address (set = free). Every bit of a higher level
+// summarizes one word of the level below (set = that word still has a free
+// bit), so finding the lowest free address only touches one word per level,
+// regardless of how many addresses are in use.
+class AddressPool {
+private:
+  in_addr_t _first;
+  in_addr_t _last;
+  size_t _free_count;
+  std::vector<std::vector<uint64_t>> _levels;
+
+  void set_free_bit(size_t index);
+  void clear_free_bit(size_t index);
+
+public:
+  AddressPool(const in_addr_t first_hostorder, const in_addr_t last_hostorder);
+
+  bool contains(const in_addr_t address_hostorder) const;
+  bool is_free(const in_addr_t address_hostorder) const;
+  // returns the lowest free address without marking it as used
+  std::optional<in_addr_t> find_free() const;
+  // marks the given address as used, returns false if it was not free
+  bool reserve(const in_addr_t address_hostorder);
+  void release(const in_addr_t address_hostorder);
+
+  in_addr_t first() const;
+  in_addr_t last() const;
+  size_t size() const;
+  size_t free_count() const;
+};
+} // namespace tinydhcpd
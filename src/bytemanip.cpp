@@ -29,4 +29,27 @@ uint16_t convert_network_byte_array_to_uint16(uint8_t *array) {
 uint32_t convert_network_byte_array_to_uint32(uint8_t *array) {
   return ntohl(to_number<uint32_t>(array));
 }
+
+// the data is summed as big endian 16 bit words
+uint32_t add_to_checksum(uint32_t sum, const uint8_t *data,
+                         const size_t length) {
+  for (size_t i = 0; i + 1 < length; i += 2) {
+    sum += (data[i] << 8) | data[i + 1];
+  }
+  if (length % 2 != 0) {
+    sum += data[length - 1] << 8;
+  }
+  return sum;
+}
+
+uint32_t add_to_checksum(const uint32_t sum, const uint32_t value) {
+  return sum + (value >> 16) + (value & 0xffff);
+}
+
+uint16_t finish_checksum(uint32_t sum) {
+  while ((sum >> 16) != 0) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return static_cast<uint16_t>(~sum);
+}
 } // namespace tinydhcpd
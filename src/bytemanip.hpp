@@ -1,7 +1,10 @@
 #pragma once
 
+#include <arpa/inet.h>
 #include <array>
 #include <cstdint>
+#include <cstring>
+#include <span>
 #include <stdexcept>
 #include <vector>
 
@@ -12,6 +15,13 @@ std::array<uint8_t, 2> to_network_byte_array(uint16_t number);
 uint16_t convert_network_byte_array_to_uint16(uint8_t *array);
 uint32_t convert_network_byte_array_to_uint32(uint8_t *array);
 
+// Internet checksum (RFC 1071): values are accumulated into a 32 bit sum,
+// which finish_checksum() folds and complements.
+uint32_t add_to_checksum(uint32_t sum, const uint8_t *data,
+                         const size_t length);
+uint32_t add_to_checksum(const uint32_t sum, const uint32_t value);
+uint16_t finish_checksum(uint32_t sum);
+
 template <typename N>
 std::array<uint8_t, sizeof(N) / sizeof(uint8_t)> to_byte_array(N number) {
   const size_t size = sizeof(N) / sizeof(uint8_t);
@@ -37,10 +47,10 @@ template <typename N> std::vector<uint8_t> to_byte_vector(N number) {
   return vec;
 }
 
-template <typename N> N to_number(std::vector<uint8_t> bytes) {
+template <typename N> N to_number(std::span<const uint8_t> bytes) {
   constexpr size_t max_size = sizeof(N) / sizeof(uint8_t);
   if (bytes.size() != max_size) {
-    throw std::invalid_argument("The given vector is not the right size!");
+    throw std::invalid_argument("The given bytes are not the right size!");
   }
   N value = 0;
   for (size_t i = 0; i < max_size; i++) {
@@ -60,20 +70,29 @@ template <typename N> N to_number(uint8_t *bytes) {
   return value;
 }
 
-template <typename N>
-void convert_number_to_network_byte_array_and_push(std::vector<uint8_t> &vec,
-                                                   N number) {
-  auto network_order_array = to_network_byte_array(number);
-  for (uint8_t &byte : network_order_array) {
-    vec.push_back(byte);
+// Reads a number stored in network byte order from a possibly unaligned
+// buffer.
+template <typename N> N load_network_order(const uint8_t *bytes) {
+  static_assert(sizeof(N) == 1 || sizeof(N) == 2 || sizeof(N) == 4);
+  N number;
+  std::memcpy(&number, bytes, sizeof(N));
+  if constexpr (sizeof(N) == 4) {
+    return ntohl(number);
+  } else if constexpr (sizeof(N) == 2) {
+    return ntohs(number);
+  } else {
+    return number;
   }
 }
-template <typename N>
-void convert_number_to_byte_array_and_push(std::vector<uint8_t> &vec,
-                                           N number) {
-  auto byte_array = to_byte_array(number);
-  for (uint8_t &byte : byte_array) {
-    vec.push_back(byte);
+
+// Writes a number in network byte order to a possibly unaligned buffer.
+template <typename N> void store_network_order(uint8_t *dest, N number) {
+  static_assert(sizeof(N) == 1 || sizeof(N) == 2 || sizeof(N) == 4);
+  if constexpr (sizeof(N) == 4) {
+    number = htonl(number);
+  } else if constexpr (sizeof(N) == 2) {
+    number = htons(number);
   }
+  std::memcpy(dest, &number, sizeof(N));
 }
 } // namespace tinydhcpd
@@ -1,5 +1,6 @@
 #include "configuration.hpp"
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <libconfig.h++>
 #include <netinet/ether.h>
@@ -10,7 +11,7 @@
 
 namespace tinydhcpd {
 void parse_configuration(ProgramConfiguration &optval) {
-  using ::libconfig::Setting, ::libconfig::Config;
+  using ::libconfig::Config;
   Config configuration;
 
   LOG_INFO("Reading config file");
@@ -18,29 +19,137 @@ void parse_configuration(ProgramConfiguration &optval) {
   LOG_TRACE("Parsing configuration...");
 
   std::string config_listen_address;
-  if (!configuration.lookupValue(LISTEN_ADDRESS_KEY, config_listen_address) &&
-      !configuration.lookupValue(INTERFACE_KEY, optval.interface)) {
-    throw std::invalid_argument(
-        "One of (listen-address|interface) must be given!");
-  }
+  configuration.lookupValue(LISTEN_ADDRESS_KEY, config_listen_address);
 
   configuration.lookupValue(LEASE_FILE_KEY, optval.lease_file_path);
+  std::string config_lease_file_format;
+  if (configuration.lookupValue(LEASE_FILE_FORMAT_KEY,
+                                config_lease_file_format)) {
+    if (!lease_file_format_mapping.contains(config_lease_file_format)) {
+      throw std::invalid_argument(
+          string_format("Invalid lease file format: %s",
+                        config_lease_file_format.c_str()));
+    }
+    optval.lease_file_format =
+        lease_file_format_mapping.at(config_lease_file_format);
+  }
+  std::string config_receive_backend;
+  if (configuration.lookupValue(RECEIVE_BACKEND_KEY, config_receive_backend)) {
+    if (!receive_backend_mapping.contains(config_receive_backend)) {
+      throw std::invalid_argument(string_format(
+          "Invalid receive backend: %s", config_receive_backend.c_str()));
+    }
+    optval.receive_backend =
+        receive_backend_mapping.at(config_receive_backend);
+  }
+  parse_journal_configuration(configuration, optval.journal_config);
+  configuration.lookupValue(IO_BATCH_SIZE_KEY, optval.io_batch_size);
+  configuration.lookupValue(RAW_UNICAST_KEY, optval.raw_unicast);
+  configuration.lookupValue(METRICS_SOCKET_KEY, optval.metrics_socket_path);
+  parse_rate_limits(configuration, optval.rate_limits);
+  if (optval.io_batch_size == 0 || optval.io_batch_size > MAX_IO_BATCH_SIZE) {
+    throw std::invalid_argument(string_format(
+        "The I/O batch size must be between 1 and %u!", MAX_IO_BATCH_SIZE));
+  }
 
   if (!config_listen_address.empty()) {
     inet_aton(config_listen_address.c_str(), &(optval.address));
   }
 
-  if (optval.interface.empty()) {
-    optval.interface =
-        static_cast<std::string>(configuration.lookup(INTERFACE_KEY));
+  // interfaces given on the command line take precedence
+  if (optval.interfaces.empty()) {
+    parse_interfaces(configuration, optval);
+  }
+  parse_subnets(configuration, optval);
+  if (optval.address.s_addr == INADDR_ANY && optval.interfaces.empty()) {
+    throw std::invalid_argument(
+        "One of (listen-address|interface) must be given!");
   }
 
-  if (!configuration.exists("subnet")) {
+  parse_worker_configuration(configuration, optval);
+}
+
+void parse_interfaces(libconfig::Config &configuration,
+                      ProgramConfiguration &optval) {
+  if (!configuration.exists(INTERFACE_KEY)) {
+    return;
+  }
+  libconfig::Setting &interface_config = configuration.lookup(INTERFACE_KEY);
+  if (!interface_config.isArray() && !interface_config.isList()) {
+    optval.interfaces.push_back(static_cast<std::string>(interface_config));
+    return;
+  }
+  for (int i = 0; i < interface_config.getLength(); i++) {
+    optval.interfaces.push_back(static_cast<std::string>(interface_config[i]));
+  }
+}
+
+// Reads the subnet block and/or the subnets list. Every subnet is served on
+// its own interface, at most one of them may leave it out to serve the
+// remaining ones. Relay-only subnets have no interface at all.
+void parse_subnets(libconfig::Config &configuration,
+                   ProgramConfiguration &optval) {
+  if (configuration.exists(SUBNETS_KEY)) {
+    libconfig::Setting &subnets_config = configuration.lookup(SUBNETS_KEY);
+    for (int i = 0; i < subnets_config.getLength(); i++) {
+      optval.subnets.push_back(parse_subnet(subnets_config[i]));
+    }
+  }
+  if (configuration.exists(SUBNET_KEY)) {
+    optval.subnets.push_back(parse_subnet(configuration.lookup(SUBNET_KEY)));
+  }
+  if (optval.subnets.empty()) {
     throw std::invalid_argument("No subnet declaration found!");
   }
 
-  Setting &subnet_parsed_cfg = configuration.lookup("subnet");
+  bool has_default_subnet = false;
+  for (size_t i = 0; i < optval.subnets.size(); i++) {
+    const SubnetConfiguration &subnet_cfg = optval.subnets[i];
+    for (size_t j = 0; j < i; j++) {
+      if (optval.subnets[j].netmask.s_addr == subnet_cfg.netmask.s_addr &&
+          (optval.subnets[j].subnet_address.s_addr &
+           subnet_cfg.netmask.s_addr) ==
+              (subnet_cfg.subnet_address.s_addr & subnet_cfg.netmask.s_addr)) {
+        throw std::invalid_argument(
+            string_format("Subnet %s is declared more than once!",
+                          inet_ntoa(subnet_cfg.subnet_address)));
+      }
+    }
+    const std::string &interface = subnet_cfg.interface;
+    if (subnet_cfg.relay_only) {
+      if (!interface.empty()) {
+        throw std::invalid_argument(string_format(
+            "Relay-only subnet %s must not have an interface!",
+            inet_ntoa(subnet_cfg.subnet_address)));
+      }
+      continue;
+    }
+    if (interface.empty()) {
+      if (has_default_subnet) {
+        throw std::invalid_argument(
+            "Only one subnet may be declared without an interface!");
+      }
+      has_default_subnet = true;
+      continue;
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (optval.subnets[j].interface == interface) {
+        throw std::invalid_argument(string_format(
+            "More than one subnet on interface %s!", interface.c_str()));
+      }
+    }
+    if (std::find(optval.interfaces.begin(), optval.interfaces.end(),
+                  interface) == optval.interfaces.end()) {
+      optval.interfaces.push_back(interface);
+    }
+  }
+}
+
+SubnetConfiguration parse_subnet(libconfig::Setting &subnet_parsed_cfg) {
   SubnetConfiguration subnet_cfg;
+  subnet_parsed_cfg.lookupValue(INTERFACE_KEY, subnet_cfg.interface);
+  subnet_cfg.relay_only = false;
+  subnet_parsed_cfg.lookupValue(RELAY_ONLY_KEY, subnet_cfg.relay_only);
   std::string config_net_addr, config_netmask, config_range_start,
       config_range_end;
   if (!subnet_parsed_cfg.lookupValue(NET_ADDRESS_KEY, config_net_addr) ||
@@ -74,10 +183,93 @@ void parse_configuration(ProgramConfiguration &optval) {
   subnet_cfg.defined_options[OptionTag::LEASE_TIME] =
       to_byte_vector(lease_time_seconds);
   subnet_cfg.lease_time_seconds = lease_time_seconds;
-  optval.subnet_config = subnet_cfg;
+  return subnet_cfg;
+}
+
+void parse_journal_configuration(libconfig::Config &configuration,
+                                 LeaseJournalConfiguration &journal_cfg) {
+  configuration.lookupValue(JOURNAL_FLUSH_INTERVAL_KEY,
+                            journal_cfg.flush_interval_ms);
+  configuration.lookupValue(JOURNAL_BATCH_SIZE_KEY, journal_cfg.batch_size);
+  configuration.lookupValue(JOURNAL_COMPACTION_THRESHOLD_KEY,
+                            journal_cfg.compaction_threshold);
+  if (journal_cfg.batch_size == 0) {
+    throw std::invalid_argument("The journal batch size must be positive!");
+  }
+
+  std::string config_sync_policy;
+  if (configuration.lookupValue(JOURNAL_SYNC_KEY, config_sync_policy)) {
+    if (!journal_sync_mapping.contains(config_sync_policy)) {
+      throw std::invalid_argument(
+          string_format("Invalid journal sync policy: %s",
+                        config_sync_policy.c_str()));
+    }
+    journal_cfg.sync_policy = journal_sync_mapping.at(config_sync_policy);
+  }
+}
+
+void parse_worker_configuration(libconfig::Config &configuration,
+                                ProgramConfiguration &optval) {
+  configuration.lookupValue(WORKERS_KEY, optval.worker_count);
+  // every worker needs at least one address of its own in every subnet
+  uint32_t range_size = UINT32_MAX;
+  for (const SubnetConfiguration &subnet_cfg : optval.subnets) {
+    range_size = std::min(range_size, ntohl(subnet_cfg.range_end.s_addr) -
+                                          ntohl(subnet_cfg.range_start.s_addr) +
+                                          1);
+  }
+  if (optval.worker_count == 0 || optval.worker_count > range_size) {
+    throw std::invalid_argument(string_format(
+        "The number of workers must be between 1 and %u!", range_size));
+  }
+
+  if (configuration.exists(WORKER_CPUS_KEY)) {
+    libconfig::Setting &cpus_config = configuration.lookup(WORKER_CPUS_KEY);
+    if (!cpus_config.isArray()) {
+      throw std::invalid_argument(
+          "worker-cpus must be an array of CPU numbers!");
+    }
+    optval.worker_cpus.clear();
+    for (int i = 0; i < cpus_config.getLength(); i++) {
+      optval.worker_cpus.push_back(static_cast<int>(cpus_config[i]));
+    }
+  }
+}
+
+void parse_rate_limits(libconfig::Config &configuration,
+                       RateLimitConfiguration &rate_limits) {
+  if (!configuration.exists(RATE_LIMIT_KEY)) {
+    return;
+  }
+  libconfig::Setting &rate_limit_block = configuration.lookup(RATE_LIMIT_KEY);
+  parse_rate_limit(rate_limit_block, RATE_LIMIT_CLIENT_KEY, rate_limits.client);
+  parse_rate_limit(rate_limit_block, INTERFACE_KEY, rate_limits.interface);
+  parse_rate_limit(rate_limit_block, RATE_LIMIT_GLOBAL_KEY, rate_limits.global);
+}
+
+void parse_rate_limit(libconfig::Setting &rate_limit_block,
+                      const std::string &key, RateLimit &rate_limit) {
+  if (!rate_limit_block.exists(key)) {
+    return;
+  }
+  libconfig::Setting &limit_block = rate_limit_block.lookup(key);
+  limit_block.lookupValue(RATE_LIMIT_RATE_KEY, rate_limit.rate);
+  // by default, one second's worth of messages may arrive at once
+  rate_limit.burst = rate_limit.rate;
+  limit_block.lookupValue(RATE_LIMIT_BURST_KEY, rate_limit.burst);
+  if (rate_limit.rate > 0 && rate_limit.burst == 0) {
+    throw std::invalid_argument(string_format(
+        "The %s rate limit needs a positive burst!", key.c_str()));
+  }
 }
 
 void check_net_range(SubnetConfiguration &cfg) {
+  // subnets are matched by prefix length
+  const uint32_t host_bits = ~ntohl(cfg.netmask.s_addr);
+  if ((host_bits & (host_bits + 1)) != 0) {
+    throw std::invalid_argument(string_format(
+        "Netmask %s is not contiguous!", inet_ntoa(cfg.netmask)));
+  }
   in_addr_t netmasked_network_address =
       cfg.subnet_address.s_addr & cfg.netmask.s_addr;
   if ((cfg.range_start.s_addr & cfg.netmask.s_addr) !=
@@ -94,6 +286,9 @@ void check_net_range(SubnetConfiguration &cfg) {
                       "Netaddr: %s | Range end %s",
                       inet_ntoa(cfg.subnet_address), inet_ntoa(cfg.range_end)));
   }
+  if (ntohl(cfg.range_end.s_addr) < ntohl(cfg.range_start.s_addr)) {
+    throw std::invalid_argument("The range end lies before the range start!");
+  }
 }
 
 void parse_hosts(libconfig::Setting &subnet_cfg_block,
@@ -101,6 +296,7 @@ void parse_hosts(libconfig::Setting &subnet_cfg_block,
   using ::libconfig::Setting, ::libconfig::SettingIterator;
 
   Setting &hosts_config = subnet_cfg_block.lookup(HOSTS_KEY);
+  std::vector<Reservation> reservations;
   for (SettingIterator iter = hosts_config.begin(); iter != hosts_config.end();
        iter++) {
     Setting &currentGroup = *iter;
@@ -131,9 +327,14 @@ void parse_hosts(libconfig::Setting &subnet_cfg_block,
         continue;
       }
 
-      subnet_cfg.fixed_hosts[*parsed_ether_addr] = parsed_ip4_addr;
+      Reservation reservation{.hwaddr = {},
+                              .address = ntohl(parsed_ip4_addr.s_addr)};
+      std::copy_n(parsed_ether_addr->ether_addr_octet, ETHER_ADDR_LEN,
+                  reservation.hwaddr.begin());
+      reservations.push_back(reservation);
     }
   }
+  subnet_cfg.fixed_hosts = ReservationTable(std::move(reservations));
 }
 
 void parse_options(libconfig::Setting &subnet_cfg_block,
@@ -143,73 +344,165 @@ void parse_options(libconfig::Setting &subnet_cfg_block,
   for (SettingIterator options_iter = options_config.begin();
        options_iter != options_config.end(); options_iter++) {
     Setting &current_setting = *options_iter;
-    std::string option_key(current_setting.getName());
-    libconfig::Setting::Type valueType = current_setting.getType();
-
-    try {
-      OptionTag tag = key_tag_mapping.at(option_key);
-      switch (valueType) {
-
-      case libconfig::Setting::Type::TypeInt: {
-        int config_value = current_setting;
-        auto netarray = to_network_byte_array((uint16_t)config_value);
-        std::vector<uint8_t> value(netarray.begin(), netarray.end());
-        subnet_cfg.defined_options[tag] = value;
-        std::ostringstream os;
-        os << "Read option " << string_format("%x", static_cast<uint8_t>(tag))
-           << " | Value: ";
-        for (auto &elem : value) {
-          os << string_format("%x ", elem);
-        }
-        LOG_TRACE(os.str());
-        break;
-      }
+    const std::string option_key(current_setting.getName());
+    const OptionDefinition *definition = find_option_definition(option_key);
+    if (definition == nullptr) {
+      LOG_WARN(std::string("Unknown option: ").append(option_key));
+      continue;
+    }
+    if (!definition->configurable) {
+      throw std::invalid_argument(string_format(
+          "Option %s is set by the server and cannot be configured!",
+          option_key.c_str()));
+    }
+
+    std::vector<uint8_t> value =
+        encode_option_value(*definition, current_setting);
+    if (value.size() > UINT8_MAX ||
+        !is_legal_option_length(definition->code, value.size())) {
+      throw std::invalid_argument(string_format(
+          "Invalid value of option %s! Legal lengths: %u - %u bytes in steps "
+          "of %u | Actual length: %lu",
+          option_key.c_str(), definition->min_length, definition->max_length,
+          definition->length_multiple, value.size()));
+    }
+    std::ostringstream os;
+    os << "Read option " << string_format("%x", definition->code)
+       << " | Value: ";
+    for (auto &elem : value) {
+      os << string_format("%x ", elem);
+    }
+    LOG_TRACE(os.str());
+    subnet_cfg.defined_options[static_cast<OptionTag>(definition->code)] =
+        std::move(value);
+  }
+}
 
-      case libconfig::Setting::Type::TypeArray: {
-        std::vector<uint8_t> addresses;
-        for (SettingIterator array_iter = current_setting.begin();
-             array_iter != current_setting.end(); array_iter++) {
-          const std::array<uint8_t, 4> &address_bytes =
-              parse_ip_address(*array_iter);
-          addresses.insert(addresses.end(), address_bytes.begin(),
-                           address_bytes.end());
-        }
-        subnet_cfg.defined_options[tag] = addresses;
-        std::ostringstream os;
-        os << "Read option " << string_format("%x", static_cast<uint8_t>(tag))
-           << " | Value: ";
-        for (auto &elem : addresses) {
-          os << string_format("%d ", elem);
-        }
-        LOG_TRACE(os.str());
-        break;
+// Encodes the value of an option as it is sent, according to its type in the
+// option catalog. Lengths are checked by the caller.
+std::vector<uint8_t>
+encode_option_value(const OptionDefinition &definition,
+                    libconfig::Setting &setting) {
+  using ::libconfig::Setting;
+  const bool is_list = setting.isArray() || setting.isList();
+  const auto type_error = [&definition](const char *expected) {
+    return std::invalid_argument(string_format("Option %s must be %s!",
+                                               definition.name.data(),
+                                               expected));
+  };
+  std::vector<uint8_t> value;
+  switch (definition.type) {
+  case OptionType::ADDRESS:
+  case OptionType::ADDRESSES:
+  case OptionType::ADDRESS_PAIRS:
+    if (!is_list) {
+      if (definition.type == OptionType::ADDRESS_PAIRS) {
+        throw type_error("a list of IP address pairs");
+      }
+      if (setting.getType() != Setting::TypeString) {
+        throw type_error("an IP address");
+      }
+      const std::array<uint8_t, 4> &address_bytes =
+          parse_ip_address(definition, setting);
+      value.assign(address_bytes.begin(), address_bytes.end());
+      break;
+    }
+    for (int i = 0; i < setting.getLength(); i++) {
+      if (setting[i].getType() != Setting::TypeString) {
+        throw type_error("a list of IP addresses");
       }
+      const std::array<uint8_t, 4> &address_bytes =
+          parse_ip_address(definition, setting[i]);
+      value.insert(value.end(), address_bytes.begin(), address_bytes.end());
+    }
+    break;
 
-      default:
-        const std::array<uint8_t, 4> &address_bytes =
-            parse_ip_address(current_setting);
-        std::vector<uint8_t> address(address_bytes.begin(),
-                                     address_bytes.end());
-        subnet_cfg.defined_options[tag] = address;
-        std::ostringstream os;
-        os << "Read option " << string_format("%x", static_cast<uint8_t>(tag))
-           << " | Value: ";
-        for (auto &elem : address) {
-          os << string_format("%d ", elem);
-        }
-        LOG_TRACE(os.str());
-        break;
+  case OptionType::INT32:
+    value = to_byte_vector(static_cast<uint32_t>(static_cast<int32_t>(
+        parse_option_integer(definition, setting, INT32_MIN, INT32_MAX))));
+    break;
+  case OptionType::UINT8:
+    value = to_byte_vector(static_cast<uint8_t>(
+        parse_option_integer(definition, setting, 0, UINT8_MAX)));
+    break;
+  case OptionType::UINT16:
+    value = to_byte_vector(static_cast<uint16_t>(
+        parse_option_integer(definition, setting, 0, UINT16_MAX)));
+    break;
+  case OptionType::UINT32:
+    value = to_byte_vector(static_cast<uint32_t>(
+        parse_option_integer(definition, setting, 0, UINT32_MAX)));
+    break;
+  case OptionType::UINT16S:
+  case OptionType::BYTES: {
+    if (!is_list) {
+      throw type_error("a list of numbers");
+    }
+    const long long max_element =
+        definition.type == OptionType::BYTES ? UINT8_MAX : UINT16_MAX;
+    for (int i = 0; i < setting.getLength(); i++) {
+      const long long element =
+          parse_option_integer(definition, setting[i], 0, max_element);
+      if (definition.type == OptionType::BYTES) {
+        value.push_back(static_cast<uint8_t>(element));
+      } else {
+        const auto element_bytes =
+            to_byte_array(static_cast<uint16_t>(element));
+        value.insert(value.end(), element_bytes.begin(), element_bytes.end());
       }
-    } catch (std::out_of_range &oor) {
-      LOG_WARN(std::string("Unknown option: ").append(option_key));
-      continue;
     }
+    break;
   }
+
+  case OptionType::FLAG:
+    if (setting.getType() != Setting::TypeBoolean) {
+      throw type_error("true or false");
+    }
+    value.push_back(static_cast<bool>(setting) ? 1 : 0);
+    break;
+  case OptionType::TEXT: {
+    if (setting.getType() != Setting::TypeString) {
+      throw type_error("a string");
+    }
+    const std::string text = static_cast<std::string>(setting);
+    value.assign(text.begin(), text.end());
+    break;
+  }
+  }
+  return value;
 }
 
-std::array<uint8_t, 4> parse_ip_address(const char *address_string) {
-  in_addr_t address = inet_network(address_string);
-  std::array<uint8_t, 4> address_bytes = to_byte_array<>(address);
+long long parse_option_integer(const OptionDefinition &definition,
+                               libconfig::Setting &setting,
+                               const long long min_value,
+                               const long long max_value) {
+  long long number;
+  if (setting.getType() == libconfig::Setting::TypeInt) {
+    number = static_cast<int>(setting);
+  } else if (setting.getType() == libconfig::Setting::TypeInt64) {
+    number = static_cast<long long>(setting);
+  } else {
+    throw std::invalid_argument(string_format(
+        "Option %s must be a number!", definition.name.data()));
+  }
+  if (number < min_value || number > max_value) {
+    throw std::invalid_argument(
+        string_format("Value %lld of option %s is not between %lld and %lld!",
+                      number, definition.name.data(), min_value, max_value));
+  }
+  return number;
+}
+
+std::array<uint8_t, 4> parse_ip_address(const OptionDefinition &definition,
+                                        const char *address_string) {
+  // unlike inet_aton, this rejects shorthands like "10.1"
+  in_addr address;
+  if (inet_pton(AF_INET, address_string, &address) != 1) {
+    throw std::invalid_argument(
+        string_format("Option %s contains the invalid IP address %s!",
+                      definition.name.data(), address_string));
+  }
+  std::array<uint8_t, 4> address_bytes = to_byte_array<>(ntohl(address.s_addr));
   return address_bytes;
 }
 } // namespace tinydhcpd
@@ -7,11 +7,18 @@
 #include <map>
 
 #include "datagram.hpp"
+#include "lease_journal.hpp"
+#include "option_catalog.hpp"
+#include "rate_limiter.hpp"
+#include "socket.hpp"
 #include "subnet_config.hpp"
 
 namespace tinydhcpd {
 const std::string LISTEN_ADDRESS_KEY = "listen-address";
 const std::string INTERFACE_KEY = "interface";
+const std::string SUBNET_KEY = "subnet";
+const std::string SUBNETS_KEY = "subnets";
+const std::string RELAY_ONLY_KEY = "relay-only";
 const std::string NET_ADDRESS_KEY = "net-address";
 const std::string NETMASK_KEY = "netmask";
 const std::string RANGE_START_KEY = "range-start";
@@ -19,19 +26,42 @@ const std::string RANGE_END_KEY = "range-end";
 const std::string OPTIONS_KEY = "options";
 const std::string HOSTS_KEY = "hosts";
 const std::string LEASE_FILE_KEY = "lease-file";
+const std::string LEASE_FILE_FORMAT_KEY = "lease-file-format";
 const std::string LEASE_TIME_KEY = "lease-time";
+const std::string IO_BATCH_SIZE_KEY = "io-batch-size";
+const std::string WORKERS_KEY = "workers";
+const std::string WORKER_CPUS_KEY = "worker-cpus";
+const std::string RAW_UNICAST_KEY = "raw-unicast";
+const std::string RECEIVE_BACKEND_KEY = "receive-backend";
+const std::string METRICS_SOCKET_KEY = "metrics-socket";
+const std::string RATE_LIMIT_KEY = "rate-limit";
+const std::string RATE_LIMIT_CLIENT_KEY = "client";
+const std::string RATE_LIMIT_GLOBAL_KEY = "global";
+const std::string RATE_LIMIT_RATE_KEY = "rate";
+const std::string RATE_LIMIT_BURST_KEY = "burst";
+const std::string JOURNAL_FLUSH_INTERVAL_KEY = "journal-flush-interval";
+const std::string JOURNAL_BATCH_SIZE_KEY = "journal-batch-size";
+const std::string JOURNAL_SYNC_KEY = "journal-sync";
+const std::string JOURNAL_COMPACTION_THRESHOLD_KEY =
+    "journal-compaction-threshold";
 
 const std::string HOSTS_TYPE_ETHER_KEY = "ether";
 const std::string HOSTS_FIXED_ADDRESS_KEY = "fixed-address";
 
-const std::string OPTIONS_ROUTER_KEY = "routers";
-const std::string OPTIONS_DNS_SERVERS_KEY = "domain-name-servers";
-
 constexpr uint32_t DEFAULT_LEASE_TIME = 3600; // 1h
+constexpr uint32_t DEFAULT_IO_BATCH_SIZE = 32;
+constexpr uint32_t MAX_IO_BATCH_SIZE = 1024; // UIO_MAXIOV
+constexpr uint32_t DEFAULT_JOURNAL_FLUSH_INTERVAL_MS = 50;
+constexpr uint32_t DEFAULT_JOURNAL_BATCH_SIZE = 64;
+constexpr uint32_t DEFAULT_JOURNAL_COMPACTION_THRESHOLD = 100000;
 
-const std::map<std::string, OptionTag> key_tag_mapping = {
-    {OPTIONS_ROUTER_KEY, OptionTag::ROUTERS},
-    {OPTIONS_DNS_SERVERS_KEY, OptionTag::DNS_SERVER}};
+const std::map<std::string, LeaseFileFormat> lease_file_format_mapping = {
+    {"binary", LeaseFileFormat::BINARY}, {"text", LeaseFileFormat::TEXT}};
+const std::map<std::string, ReceiveBackend> receive_backend_mapping = {
+    {"socket", ReceiveBackend::SOCKET},
+    {"packet-ring", ReceiveBackend::PACKET_RING}};
+const std::map<std::string, JournalSyncPolicy> journal_sync_mapping = {
+    {"none", JournalSyncPolicy::NONE}, {"batch", JournalSyncPolicy::BATCH}};
 
 enum DAEMON_TYPE {
 #ifdef HAVE_SYSTEMD
@@ -42,19 +72,53 @@ enum DAEMON_TYPE {
 
 struct ProgramConfiguration {
   struct in_addr address;
-  std::string interface;
+  std::vector<std::string> interfaces;
   std::string confpath;
   std::string lease_file_path;
+  LeaseFileFormat lease_file_format;
+  uint32_t io_batch_size;
+  uint32_t worker_count;
+  // worker i is pinned to worker_cpus[i % size], empty = no pinning
+  std::vector<int> worker_cpus;
+  // send unicast replies through a packet socket instead of adding ARP
+  // entries, requires CAP_NET_RAW
+  bool raw_unicast;
+  ReceiveBackend receive_backend;
+  // unix socket serving the metrics, empty = none
+  std::string metrics_socket_path;
+  RateLimitConfiguration rate_limits;
   bool foreground;
   DAEMON_TYPE daemon_type;
-  tinydhcpd::SubnetConfiguration subnet_config;
+  std::vector<tinydhcpd::SubnetConfiguration> subnets;
+  tinydhcpd::LeaseJournalConfiguration journal_config;
 };
 
 void parse_configuration(ProgramConfiguration &optval);
+void parse_interfaces(libconfig::Config &configuration,
+                      ProgramConfiguration &optval);
+void parse_subnets(libconfig::Config &configuration,
+                   ProgramConfiguration &optval);
+SubnetConfiguration parse_subnet(libconfig::Setting &subnet_block);
+void parse_journal_configuration(libconfig::Config &configuration,
+                                 LeaseJournalConfiguration &journal_cfg);
+void parse_worker_configuration(libconfig::Config &configuration,
+                                ProgramConfiguration &optval);
+void parse_rate_limits(libconfig::Config &configuration,
+                       RateLimitConfiguration &rate_limits);
+void parse_rate_limit(libconfig::Setting &rate_limit_block,
+                      const std::string &key, RateLimit &rate_limit);
 void check_net_range(SubnetConfiguration &cfg);
 void parse_hosts(libconfig::Setting &subnet_block,
                  SubnetConfiguration &subnet_cfg);
 void parse_options(libconfig::Setting &subnet_block,
                    SubnetConfiguration &subnet_cfg);
-std::array<uint8_t, 4> parse_ip_address(const char *address_string);
+std::vector<uint8_t>
+encode_option_value(const OptionDefinition &definition,
+                    libconfig::Setting &setting);
+long long parse_option_integer(const OptionDefinition &definition,
+                               libconfig::Setting &setting,
+                               const long long min_value,
+                               const long long max_value);
+std::array<uint8_t, 4> parse_ip_address(const OptionDefinition &definition,
+                                        const char *address_string);
 } // namespace tinydhcpd
@@ -0,0 +1,136 @@
+#include "configuration_store.hpp"
+
+#include <arpa/inet.h>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+#include "log/logger.hpp"
+#include "option_block_cache.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+namespace {
+std::string subnet_label(const SubnetConfiguration &cfg) {
+  return string_format(
+      "%s/%d",
+      inet_ntoa({.s_addr = cfg.subnet_address.s_addr & cfg.netmask.s_addr}),
+      std::popcount(cfg.netmask.s_addr));
+}
+
+std::string format_range(const SubnetConfiguration &cfg) {
+  // inet_ntoa() reuses its buffer
+  const std::string range_start = inet_ntoa(cfg.range_start);
+  return range_start + " - " + inet_ntoa(cfg.range_end);
+}
+
+size_t count_changed_options(const SubnetConfiguration &previous,
+                             const SubnetConfiguration &current) {
+  size_t changed = 0;
+  for (const auto &[tag, value] : current.defined_options) {
+    const auto previous_value = previous.defined_options.find(tag);
+    if (previous_value == previous.defined_options.end() ||
+        previous_value->second != value) {
+      changed++;
+    }
+  }
+  for (const auto &[tag, value] : previous.defined_options) {
+    if (!current.defined_options.contains(tag)) {
+      changed++;
+    }
+  }
+  return changed;
+}
+
+size_t count_changed_hosts(const SubnetConfiguration &previous,
+                           const SubnetConfiguration &current) {
+  size_t changed = 0;
+  for (const Reservation &reservation : current.fixed_hosts) {
+    const Reservation *previous_reservation = previous.fixed_hosts.find(
+        HardwareAddress(reservation.hwaddr.data(), ETHER_ADDR_LEN));
+    if (previous_reservation == nullptr ||
+        previous_reservation->address != reservation.address) {
+      changed++;
+    }
+  }
+  for (const Reservation &reservation : previous.fixed_hosts) {
+    if (current.fixed_hosts.find(HardwareAddress(
+            reservation.hwaddr.data(), ETHER_ADDR_LEN)) == nullptr) {
+      changed++;
+    }
+  }
+  return changed;
+}
+
+void log_changes(const SubnetConfiguration &previous,
+                 const SubnetConfiguration &current) {
+  const std::string label = subnet_label(current);
+  if (previous.range_start.s_addr != current.range_start.s_addr ||
+      previous.range_end.s_addr != current.range_end.s_addr) {
+    LOG_INFO("Subnet %s: range %s changed to %s", label.c_str(),
+             format_range(previous).c_str(), format_range(current).c_str());
+  }
+  if (previous.lease_time_seconds != current.lease_time_seconds) {
+    LOG_INFO("Subnet %s: lease time %u s changed to %u s", label.c_str(),
+             previous.lease_time_seconds, current.lease_time_seconds);
+  }
+  const size_t changed_options = count_changed_options(previous, current);
+  if (changed_options > 0) {
+    LOG_INFO("Subnet %s: %lu options changed", label.c_str(), changed_options);
+  }
+  const size_t changed_hosts = count_changed_hosts(previous, current);
+  if (changed_hosts > 0) {
+    LOG_INFO("Subnet %s: %lu host reservations changed", label.c_str(),
+             changed_hosts);
+  }
+}
+} // namespace
+
+ConfigurationStore::ConfigurationStore(
+    const std::vector<SubnetConfiguration> &subnets)
+    : _snapshot(std::make_shared<const ConfigurationSnapshot>(
+          ConfigurationSnapshot{.generation = 0, .subnets = subnets})),
+      _generation(0) {}
+
+std::shared_ptr<const ConfigurationSnapshot> ConfigurationStore::load() const {
+  return _snapshot.load();
+}
+
+uint64_t ConfigurationStore::generation() const {
+  return _generation.load(std::memory_order_acquire);
+}
+
+void ConfigurationStore::publish(std::vector<SubnetConfiguration> subnets) {
+  const std::shared_ptr<const ConfigurationSnapshot> previous = load();
+  // the workers' metrics are laid out per subnet
+  if (subnets.size() != previous->subnets.size()) {
+    throw std::invalid_argument(
+        "Adding or removing subnets requires a restart!");
+  }
+  for (size_t i = 0; i < subnets.size(); i++) {
+    if (subnet_label(subnets[i]) != subnet_label(previous->subnets[i])) {
+      throw std::invalid_argument(string_format(
+          "Subnet %s has been replaced by %s, which requires a restart!",
+          subnet_label(previous->subnets[i]).c_str(),
+          subnet_label(subnets[i]).c_str()));
+    }
+    // the sockets only listen on the interfaces known at startup
+    if (subnets[i].interface != previous->subnets[i].interface ||
+        subnets[i].relay_only != previous->subnets[i].relay_only) {
+      throw std::invalid_argument(string_format(
+          "Moving subnet %s to another interface requires a restart!",
+          subnet_label(subnets[i]).c_str()));
+    }
+    // fail here rather than in the workers
+    OptionBlockCache(subnets[i].defined_options);
+    log_changes(previous->subnets[i], subnets[i]);
+  }
+
+  const uint64_t generation = previous->generation + 1;
+  _snapshot.store(std::make_shared<const ConfigurationSnapshot>(
+      ConfigurationSnapshot{.generation = generation,
+                            .subnets = std::move(subnets)}));
+  _generation.store(generation, std::memory_order_release);
+  LOG_INFO("Published configuration generation %lu", generation);
+}
+} // namespace tinydhcpd
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "subnet_config.hpp"
+
+namespace tinydhcpd {
+// The reloadable part of the configuration. A snapshot is never modified
+// once it has been published.
+struct ConfigurationSnapshot {
+  uint64_t generation;
+  std::vector<SubnetConfiguration> subnets;
+};
+
+// Hands the current configuration snapshot to the workers. A reload parses
+// and checks the new configuration on its own thread and then only swaps the
+// pointer. Each worker picks up the new snapshot between two batches of
+// messages, and the old one is freed once the last worker has let go of it.
+class ConfigurationStore {
+private:
+  std::atomic<std::shared_ptr<const ConfigurationSnapshot>> _snapshot;
+  std::atomic<uint64_t> _generation;
+
+public:
+  explicit ConfigurationStore(const std::vector<SubnetConfiguration> &subnets);
+  ConfigurationStore(const ConfigurationStore &other) = delete;
+
+  std::shared_ptr<const ConfigurationSnapshot> load() const;
+  // cheaper than load() to find out whether there is a new snapshot
+  uint64_t generation() const;
+  // Logs what has changed and publishes the subnets as the new snapshot.
+  // Throws std::invalid_argument if subnets have been added or removed, which
+  // needs a restart, and std::runtime_error if an option cannot be encoded.
+  void publish(std::vector<SubnetConfiguration> subnets);
+};
+} // namespace tinydhcpd
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <arpa/inet.h>
+#include <bit>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
@@ -22,6 +23,7 @@
 
 #include "bytemanip.hpp"
 #include "datagram.hpp"
+#include "lease_file.hpp"
 #include "log/logger.hpp"
 #include "log/syslog_logsink.hpp"
 #ifdef HAVE_SYSTEMD
@@ -43,23 +45,90 @@ constexpr uint8_t DHCP_TYPE_NAK = 6;
 constexpr uint8_t DHCP_TYPE_RELEASE = 7;
 constexpr uint8_t DHCP_TYPE_INFORM = 8;
 
-constexpr uint16_t DHCP_CLIENT_PORT = 68;
+// entries of Daemon::_subnet_by_ifindex
+constexpr int32_t NO_SUBNET = -1;
+constexpr int32_t UNRESOLVED_SUBNET = -2;
 
-const std::string LEASE_FILE_DELIMITER = ",";
+// the pool and lease gauges need a scan over all leases
+constexpr uint64_t METRICS_REFRESH_INTERVAL_SECONDS = 5;
 
-std::unique_ptr<tinydhcpd::Logger> global_logger;
+// shorter than the time an offered address is held for the client
+constexpr uint64_t REPLY_CACHE_TTL_SECONDS = 5;
 
 void sighandler(int signum) {
   tinydhcpd::LOG_TRACE("Caught signal " + std::to_string(signum));
   tinydhcpd::last_signal = signum;
 }
 
-Daemon::Daemon(const struct in_addr &address, const std::string &iface_name,
-               SubnetConfiguration &netconfig,
-               const std::string &lease_file_path) try
-    : _socket(address, iface_name, *this),
-      _epoll_socket(_socket, (EPOLLIN | EPOLLOUT)), _netconfig(netconfig),
-      _lease_file_path(lease_file_path), _active_leases() {
+// Splits the address range into worker_count contiguous shards of (almost)
+// equal size and returns the first and last address of the given one.
+std::pair<in_addr_t, in_addr_t> get_pool_shard(const SubnetConfiguration &cfg,
+                                               const uint32_t worker_index,
+                                               const uint32_t worker_count) {
+  const in_addr_t range_start = ntohl(cfg.range_start.s_addr);
+  const uint64_t range_size = ntohl(cfg.range_end.s_addr) - range_start + 1;
+  const uint64_t shard_size = range_size / worker_count;
+  const uint64_t remainder = range_size % worker_count;
+  const in_addr_t first = range_start + worker_index * shard_size +
+                          std::min<uint64_t>(worker_index, remainder);
+  const in_addr_t last =
+      first + shard_size + (worker_index < remainder ? 1 : 0) - 1;
+  return std::make_pair(first, last);
+}
+
+bool subnet_contains(const SubnetConfiguration &cfg,
+                     const in_addr_t address_hostorder) {
+  return (htonl(address_hostorder) & cfg.netmask.s_addr) ==
+         (cfg.subnet_address.s_addr & cfg.netmask.s_addr);
+}
+
+std::string get_worker_lease_file_path(const std::string &lease_file_path,
+                                       const uint32_t worker_index,
+                                       const uint32_t worker_count) {
+  if (worker_count == 1) {
+    return lease_file_path;
+  }
+  return lease_file_path + "." + std::to_string(worker_index);
+}
+
+Daemon::Daemon(const ProgramConfiguration &config,
+               const uint32_t worker_index,
+               const ConfigurationStore &config_store,
+               MetricsRegistry &metrics_registry) try
+    : _worker_index(worker_index), _worker_count(config.worker_count),
+      _config_store(config_store), _configuration(),
+      _metrics(metrics_registry.worker(worker_index)),
+      _metrics_registry(metrics_registry), _interface_cache(),
+      _socket(config.address, config.interfaces, config.io_batch_size,
+              worker_index, config.worker_count, config.receive_backend,
+              config.rate_limits, *this, _metrics),
+      _epoll_socket(_socket, (EPOLLIN | EPOLLOUT),
+                    std::max<int>(config.journal_config.flush_interval_ms, 1)),
+      _raw_sender(), _interface_names(config.interfaces), _subnets(),
+      _subnet_by_ifindex(), _subnet_by_ifindex_generation(0),
+      _subnet_by_prefix(),
+      _lease_file_path(get_worker_lease_file_path(
+          config.lease_file_path, worker_index, config.worker_count)),
+      _lease_file_format(config.lease_file_format),
+      _lease_journal(_lease_file_path, config.journal_config, _metrics),
+      _reply_cache(),
+      _metrics_exporter(), _next_metrics_refresh(0),
+      _rate_limited_reported(0) {
+  _epoll_socket.watch(_interface_cache,
+                      [this]() { _interface_cache.handle_events(); });
+  if (config.receive_backend == ReceiveBackend::PACKET_RING) {
+    _epoll_socket.watch(_socket.packet_ring_fd(),
+                        [this]() { _socket.handle_packet_ring(); });
+  }
+  if (config.raw_unicast) {
+    _raw_sender.emplace();
+  }
+  if (worker_index == 0 && !config.metrics_socket_path.empty()) {
+    _metrics_exporter.emplace(config.metrics_socket_path, metrics_registry);
+    _epoll_socket.watch(*_metrics_exporter,
+                        [this]() { _metrics_exporter->handle_connections(); });
+  }
+  install_configuration(_config_store.load());
   load_leases();
 } catch (std::runtime_error &ex) {
   printf("%s\n", ex.what());
@@ -183,276 +252,441 @@ void Daemon::daemonize(const DAEMON_TYPE type) {
 
 void Daemon::main_loop() {
 #ifdef HAVE_SYSTEMD
-  sd_notify(0, "STATUS=Ready\nREADY=1");
+  if (_worker_index == 0) {
+    sd_notify(0, "STATUS=Ready\nREADY=1");
+  }
 #endif
   _epoll_socket.poll_loop();
 }
 
+bool Daemon::accepts_destination(const int ifindex,
+                                 const in_addr_t destination) {
+  if (destination == INADDR_BROADCAST) {
+    return true;
+  }
+  const InterfaceInfo *interface = _interface_cache.find(ifindex);
+  return interface != nullptr && interface->address != INADDR_ANY &&
+         (destination == interface->address ||
+          destination == interface->broadcast_address);
+}
+
 void Daemon::handle_recv(DhcpDatagram &datagram) {
-  std::ostringstream os;
-  os << "Received packet from ";
-  for (int i = 0; i < datagram._hwaddr_len; i++) {
-    os << string_format("%x", datagram._hw_addr[i]) << ":";
+  const InterfaceInfo *interface =
+      _interface_cache.find(datagram._recv_ifindex);
+  if (interface == nullptr || interface->address == INADDR_ANY) {
+    LOG_WARN("Dropping message from interface %d without IPv4 address",
+             datagram._recv_ifindex);
+    return;
+  }
+  datagram._recv_addr = interface->address;
+  ServedSubnet *subnet;
+  if (datagram._relay_agent_ip != INADDR_ANY) {
+    // the relay agent sits on the client's segment
+    subnet = find_subnet_by_address(datagram._relay_agent_ip);
+    if (subnet == nullptr) {
+      if (log_enabled(Level::DEBUG)) {
+        LOG_DEBUG("Ignoring message relayed by %s",
+                  inet_ntoa({.s_addr = htonl(datagram._relay_agent_ip)}));
+      }
+      return;
+    }
+  } else {
+    subnet = find_subnet(datagram._recv_ifindex, *interface);
+    if (subnet == nullptr) {
+      LOG_DEBUG("Ignoring message from interface %s", interface->name.c_str());
+      return;
+    }
+  }
+
+  if (log_enabled(Level::DEBUG)) {
+    std::ostringstream os;
+    os << "Received packet from ";
+    for (int i = 0; i < datagram._hwaddr_len; i++) {
+      os << string_format("%x", datagram._hw_addr[i]) << ":";
+    }
+    LOG_DEBUG(os.str());
   }
-  LOG_DEBUG(os.str());
-  LOG_TRACE(string_format("XID: %#010x", datagram._transaction_id));
+  LOG_TRACE("XID: %#010x", datagram._transaction_id);
   if (datagram._opcode != 0x1) {
     return;
   }
-  std::for_each(datagram._options.begin(), datagram._options.end(),
-                [](const auto &option) {
-                  std::ostringstream os;
-                  os << string_format("Tag %u | Length %u | Value(s) ",
-                                      static_cast<uint8_t>(option.first),
-                                      option.second.size());
-                  for (uint8_t val_byte : option.second) {
-                    os << string_format("%#04x ", val_byte);
-                  }
-                  LOG_TRACE(os.str());
-                });
-
-  switch (datagram._options[OptionTag::DHCP_MESSAGE_TYPE].at(0)) {
+  if (log_enabled(Level::TRACE)) {
+    datagram._options.for_each(
+        [](const OptionTag tag, const std::span<const uint8_t> value) {
+          std::ostringstream os;
+          os << string_format("Tag %u | Length %lu | Value(s) ",
+                              static_cast<uint8_t>(tag), value.size());
+          for (uint8_t val_byte : value) {
+            os << string_format("%#04x ", val_byte);
+          }
+          LOG_TRACE(os.str());
+        });
+  }
+
+  const std::span<const uint8_t> message_type =
+      datagram._options.get(OptionTag::DHCP_MESSAGE_TYPE);
+  if (message_type.empty()) {
+    LOG_WARN("Received a message without DHCP message type");
+    return;
+  }
+  switch (message_type[0]) {
   case DHCP_TYPE_DISCOVER:
     LOG_DEBUG("DISCOVER");
-    handle_discovery(datagram);
+    _metrics.count(Counter::DISCOVER);
+    if (!resend_cached_reply(datagram, DHCP_TYPE_DISCOVER)) {
+      handle_discovery(*subnet, datagram);
+    }
     break;
   case DHCP_TYPE_REQUEST:
     LOG_DEBUG("REQUEST");
-    handle_request(datagram);
+    _metrics.count(Counter::REQUEST);
+    if (!resend_cached_reply(datagram, DHCP_TYPE_REQUEST)) {
+      handle_request(*subnet, datagram);
+    }
     break;
   case DHCP_TYPE_RELEASE:
     LOG_DEBUG("RELEASE");
-    handle_release(datagram);
+    _metrics.count(Counter::RELEASE);
+    _reply_cache.erase(
+        HardwareAddress(datagram._hw_addr, datagram._hwaddr_len));
+    handle_release(*subnet, datagram);
     break;
   case DHCP_TYPE_INFORM:
     LOG_DEBUG("INFORM");
-    handle_inform(datagram);
+    _metrics.count(Counter::INFORM);
+    handle_inform(*subnet, datagram);
     break;
   case DHCP_TYPE_DECLINE:
     LOG_DEBUG("DECLINE");
-    handle_decline(datagram);
+    _metrics.count(Counter::DECLINE);
+    _reply_cache.erase(
+        HardwareAddress(datagram._hw_addr, datagram._hwaddr_len));
+    handle_decline(*subnet, datagram);
     break;
   default:
-    LOG_WARN(
-        string_format("Invalid message type: %x",
-                      datagram._options[OptionTag::DHCP_MESSAGE_TYPE].at(0)));
+    LOG_WARN("Invalid message type: %x", message_type[0]);
   }
 }
 
-void Daemon::handle_discovery(const DhcpDatagram &datagram) {
+void Daemon::handle_discovery(ServedSubnet &subnet,
+                              const DhcpDatagram &datagram) {
   DhcpDatagram reply = create_skeleton_reply_datagram(datagram);
-  struct ether_addr request_hwaddr {};
-  std::copy(datagram._hw_addr.cbegin(),
-            datagram._hw_addr.cbegin() + datagram._hwaddr_len,
-            request_hwaddr.ether_addr_octet);
-  in_addr_t offer_address_host_order = datagram._client_ip;
-  in_addr_t range_start_host_order = ntohl(_netconfig.range_start.s_addr);
-  in_addr_t range_end_host_order = ntohl(_netconfig.range_end.s_addr);
+  const HardwareAddress client_hwaddr(datagram._hw_addr, datagram._hwaddr_len);
+  in_addr_t offer_address_host_order = INADDR_ANY;
+  in_addr_t requested_ip = INADDR_ANY;
+  if (datagram._options.contains(OptionTag::REQUESTED_IP_ADDRESS)) {
+    requested_ip = to_number<in_addr_t>(
+        datagram._options.get(OptionTag::REQUESTED_IP_ADDRESS));
+  }
 
   // figure out what address we can give the client
-  update_leases();
-  if (datagram._options.contains(OptionTag::REQUESTED_IP_ADDRESS)) {
-    in_addr_t requested_ip = to_number<in_addr_t>(
-        datagram._options.at(OptionTag::REQUESTED_IP_ADDRESS));
-    if (requested_ip >= range_start_host_order &&
-        requested_ip <= range_end_host_order) {
-      if (_active_leases.contains(datagram._hw_addr) &&
-          _active_leases.at(datagram._hw_addr).first == requested_ip) {
-        offer_address_host_order = requested_ip;
-      }
+  update_leases(subnet);
+  const Lease *existing_lease = subnet.leases.find(client_hwaddr);
+  const bool has_lease = existing_lease != nullptr;
+  const Reservation *reservation =
+      subnet.config.fixed_hosts.find(client_hwaddr);
+  if (reservation != nullptr) {
+    offer_address_host_order = reservation->address;
+  } else if (has_lease) {
+    offer_address_host_order = existing_lease->address;
+    if (datagram._client_ip != INADDR_ANY && requested_ip == INADDR_ANY) {
+      // the client has not requested a specific lease, so we just return the
+      // remaining lease time
+      uint64_t now = get_current_time();
+      uint32_t remaining =
+          static_cast<uint32_t>(existing_lease->timeout_timestamp - now);
+      reply._options.set(OptionTag::LEASE_TIME, to_byte_array(remaining));
     }
-  } else if (offer_address_host_order != INADDR_ANY) {
-    // the client has not requested a specific lease, so we just return the
-    // remaining lease time
-    uint64_t now = get_current_time();
-    uint32_t remaining = static_cast<uint32_t>(
-        _active_leases.at(datagram._hw_addr).second - now);
-    reply._options[OptionTag::LEASE_TIME] = to_byte_vector(remaining);
-  }
-  if (offer_address_host_order == INADDR_ANY) {
-    if (!_netconfig.fixed_hosts.contains(request_hwaddr)) {
-      offer_address_host_order = range_start_host_order;
-      for (auto &entry : _active_leases) {
-        if (offer_address_host_order == entry.second.first) {
-          offer_address_host_order++;
-        }
-        if (offer_address_host_order >= range_end_host_order) {
-          LOG_ERROR("Failed to find free address!");
-          return;
-        } else {
-          break;
-        }
-      }
-    } else {
-      offer_address_host_order =
-          ntohl(_netconfig.fixed_hosts[request_hwaddr].s_addr);
+  } else if (subnet.address_pool.is_free(requested_ip)) {
+    offer_address_host_order = requested_ip;
+  } else {
+    std::optional<in_addr_t> free_address = subnet.address_pool.find_free();
+    if (!free_address.has_value()) {
+      LOG_ERROR("Failed to find free address!");
+      return;
     }
+    offer_address_host_order = free_address.value();
+  }
+  if (log_enabled(Level::DEBUG)) {
+    LOG_DEBUG("Offering address %s",
+              inet_ntoa({.s_addr = htonl(offer_address_host_order)}));
   }
-  in_addr_t offer_address_netorder = htonl(offer_address_host_order);
-  LOG_DEBUG(string_format("Offering address %s",
-                          inet_ntoa({.s_addr = offer_address_netorder})));
 
   reply._assigned_ip = offer_address_host_order;
-  reply._options[OptionTag::DHCP_MESSAGE_TYPE] = {DHCP_TYPE_OFFER};
-  reply._options[OptionTag::SERVER_IDENTIFIER] =
-      to_byte_vector(datagram._recv_addr);
+  reply._options.set(OptionTag::DHCP_MESSAGE_TYPE, {DHCP_TYPE_OFFER});
+  reply._options.set(OptionTag::SERVER_IDENTIFIER,
+                     to_byte_array(datagram._recv_addr));
 
-  set_requested_options(datagram, reply);
+  set_requested_options(subnet, datagram, reply);
   if (!reply._options.contains(OptionTag::LEASE_TIME)) {
-    reply._options[OptionTag::LEASE_TIME] =
-        to_byte_vector(_netconfig.lease_time_seconds);
+    reply._options.set(OptionTag::LEASE_TIME,
+                       to_byte_array(subnet.config.lease_time_seconds));
   }
 
   const uint64_t current_time_seconds = get_current_time();
-  _active_leases[datagram._hw_addr] =
-      std::make_pair(offer_address_host_order, current_time_seconds + 10);
+  if (!has_lease) {
+    store_lease(subnet, client_hwaddr, offer_address_host_order,
+                current_time_seconds + 10, LeaseEvent::OFFER);
+  }
 
-  struct sockaddr_in destination =
-      get_reply_destination(datagram, offer_address_netorder);
-  _socket.enqueue_datagram(destination, reply);
+  send_reply(datagram, reply, offer_address_host_order);
 }
 
-void Daemon::handle_request(const DhcpDatagram &datagram) {
+void Daemon::handle_request(ServedSubnet &subnet,
+                            const DhcpDatagram &datagram) {
   in_addr_t requested_address_hostorder;
   if (datagram._options.contains(OptionTag::REQUESTED_IP_ADDRESS)) {
     requested_address_hostorder = to_number<in_addr_t>(
-        datagram._options.at(OptionTag::REQUESTED_IP_ADDRESS));
+        datagram._options.get(OptionTag::REQUESTED_IP_ADDRESS));
   } else {
     requested_address_hostorder = datagram._client_ip;
   }
-  in_addr_t requested_address_netorder = htonl(requested_address_hostorder);
-  const std::string requested_address_string =
-      inet_ntoa(in_addr{.s_addr = requested_address_netorder});
+  const in_addr requested_address{.s_addr =
+                                      htonl(requested_address_hostorder)};
 
   DhcpDatagram reply = create_skeleton_reply_datagram(datagram);
-  if ((requested_address_netorder & _netconfig.netmask.s_addr) !=
-      (_netconfig.subnet_address.s_addr & _netconfig.netmask.s_addr)) {
-    std::ostringstream os;
-    os << "Requested address " << requested_address_string
-       << " is not in the configured subnet!";
-    LOG_WARN(os.str());
-    reply._options[OptionTag::DHCP_MESSAGE_TYPE] = {DHCP_TYPE_NAK};
-    struct sockaddr_in dest = get_reply_destination(datagram, INADDR_ANY);
-    _socket.enqueue_datagram(dest, reply);
+  if (!subnet_contains(subnet.config, requested_address_hostorder)) {
+    if (log_enabled(Level::WARN)) {
+      LOG_WARN("Requested address %s is not in the configured subnet!",
+               inet_ntoa(requested_address));
+    }
+    reply._options.set(OptionTag::DHCP_MESSAGE_TYPE, {DHCP_TYPE_NAK});
+    send_reply(datagram, reply, INADDR_ANY);
     return;
   }
 
-  update_leases();
+  update_leases(subnet);
 
-  if (_active_leases.contains(datagram._hw_addr)) {
-    if (_active_leases[datagram._hw_addr].first ==
-        requested_address_hostorder) {
-      reply._options[OptionTag::DHCP_MESSAGE_TYPE] = {DHCP_TYPE_ACK};
+  const HardwareAddress client_hwaddr(datagram._hw_addr, datagram._hwaddr_len);
+  const Lease *address_holder =
+      subnet.leases.find_by_address(requested_address_hostorder);
+  const Lease *client_lease = subnet.leases.find(client_hwaddr);
+  if (address_holder != nullptr && address_holder->hwaddr != client_hwaddr) {
+    // if somebody else holds this lease, we tell the client to reset
+    LOG_DEBUG("Requested address already in use");
+    reply._options.set(OptionTag::DHCP_MESSAGE_TYPE, {DHCP_TYPE_NAK});
+  } else if (client_lease != nullptr) {
+    if (client_lease->address == requested_address_hostorder) {
+      reply._options.set(OptionTag::DHCP_MESSAGE_TYPE, {DHCP_TYPE_ACK});
       reply._assigned_ip = requested_address_hostorder;
 
-      set_requested_options(datagram, reply);
-      reply._options[OptionTag::SERVER_IDENTIFIER] =
-          to_byte_vector(datagram._recv_addr);
+      set_requested_options(subnet, datagram, reply);
+      reply._options.set(OptionTag::SERVER_IDENTIFIER,
+                         to_byte_array(datagram._recv_addr));
       if (!reply._options.contains(OptionTag::LEASE_TIME)) {
-        reply._options[OptionTag::LEASE_TIME] =
-            to_byte_vector(_netconfig.lease_time_seconds);
+        reply._options.set(OptionTag::LEASE_TIME,
+                           to_byte_array(subnet.config.lease_time_seconds));
       }
 
       const uint64_t current_time_seconds = get_current_time();
-      _active_leases[datagram._hw_addr] =
-          std::make_pair(requested_address_hostorder,
-                         current_time_seconds + _netconfig.lease_time_seconds);
+      store_lease(subnet, client_hwaddr, requested_address_hostorder,
+                  current_time_seconds + subnet.config.lease_time_seconds,
+                  LeaseEvent::ACK);
 
-      LOG_INFO(string_format(
-          "Assigned IP %s", inet_ntoa({.s_addr = requested_address_netorder})));
+      if (log_enabled(Level::INFO)) {
+        LOG_INFO("Assigned IP %s", inet_ntoa(requested_address));
+      }
     } else {
-      // if somebody else holds this lease, we tell the client to reset
-      LOG_DEBUG("Requested address already in use");
-      reply._options[OptionTag::DHCP_MESSAGE_TYPE] = {DHCP_TYPE_NAK};
+      LOG_DEBUG("Requested address differs from the offered one");
+      reply._options.set(OptionTag::DHCP_MESSAGE_TYPE, {DHCP_TYPE_NAK});
     }
   } else {
-    LOG_WARN("Client requests address " + requested_address_string +
-             " without prior DHCPDISCOVER! Responding with NAK");
-    reply._options[OptionTag::DHCP_MESSAGE_TYPE] = {DHCP_TYPE_NAK};
+    if (log_enabled(Level::WARN)) {
+      LOG_WARN("Client requests address %s without prior DHCPDISCOVER! "
+               "Responding with NAK",
+               inet_ntoa(requested_address));
+    }
+    reply._options.set(OptionTag::DHCP_MESSAGE_TYPE, {DHCP_TYPE_NAK});
   }
-  struct sockaddr_in dest = get_reply_destination(datagram, INADDR_ANY);
-  _socket.enqueue_datagram(dest, reply);
+  send_reply(datagram, reply, INADDR_ANY);
 }
 
-void Daemon::handle_release(const DhcpDatagram &datagram) {
-  _active_leases.erase(datagram._hw_addr);
+void Daemon::handle_release(ServedSubnet &subnet,
+                            const DhcpDatagram &datagram) {
+  remove_lease(subnet, HardwareAddress(datagram._hw_addr, datagram._hwaddr_len),
+               LeaseEvent::RELEASE);
 }
 
-void Daemon::handle_inform(const DhcpDatagram &datagram) {
+void Daemon::handle_inform(ServedSubnet &subnet,
+                           const DhcpDatagram &datagram) {
   DhcpDatagram reply = create_skeleton_reply_datagram(datagram);
-  set_requested_options(datagram, reply);
-  reply._options.erase(OptionTag::LEASE_TIME);
-  struct sockaddr_in destination =
-      get_reply_destination(datagram, datagram._client_ip);
-  _socket.enqueue_datagram(destination, reply);
+  set_requested_options(subnet, datagram, reply);
+  send_reply(datagram, reply, datagram._client_ip);
 }
 
-void Daemon::handle_decline(const DhcpDatagram &datagram) {
+void Daemon::handle_decline(ServedSubnet &subnet,
+                            const DhcpDatagram &datagram) {
   in_addr_t declined_ip_hostorder = to_number<in_addr_t>(
-      datagram._options.at(OptionTag::REQUESTED_IP_ADDRESS));
-  std::array<uint8_t, 16> dummy_hwaddr;
-  std::fill(dummy_hwaddr.begin(), dummy_hwaddr.end(), 0x0);
-  _active_leases[dummy_hwaddr] =
-      std::make_pair(declined_ip_hostorder, UINT64_MAX);
-}
-
-// Determines the reply destination based on the request datagram.
-// If the reply can be sent as unicast, this also injects the
-// unicast_address <-> hwaddr mapping into the ARP cache.
-struct sockaddr_in
-Daemon::get_reply_destination(const DhcpDatagram &request_datagram,
-                              const in_addr_t unicast_address) {
+      datagram._options.get(OptionTag::REQUESTED_IP_ADDRESS));
+  if (!subnet_contains(subnet.config, declined_ip_hostorder)) {
+    LOG_WARN("Declined address is not in the subnet of the interface");
+    return;
+  }
+  // the declining client must not release the address again once its own
+  // lease runs out
+  const HardwareAddress client_hwaddr(datagram._hw_addr, datagram._hwaddr_len);
+  const Lease *holder = subnet.leases.find_by_address(declined_ip_hostorder);
+  if (holder != nullptr && holder->hwaddr != client_hwaddr) {
+    // declined before, or leased to another client that may still use it
+    if (holder->timeout_timestamp != UINT64_MAX && log_enabled(Level::WARN)) {
+      LOG_WARN("Ignoring DECLINE of %s, which is leased to another client",
+               inet_ntoa({.s_addr = htonl(declined_ip_hostorder)}));
+    }
+    return;
+  }
+  const Lease *lease = subnet.leases.find(client_hwaddr);
+  if (lease != nullptr && lease->address == declined_ip_hostorder) {
+    remove_lease(subnet, client_hwaddr, LeaseEvent::RELEASE);
+  }
+  store_lease(subnet, HardwareAddress::for_declined(declined_ip_hostorder),
+              declined_ip_hostorder, UINT64_MAX, LeaseEvent::DECLINE);
+}
+
+// A reply can only be unicast if the client has not asked for a broadcast
+// and its hw addr is usable (e.g. not all zeroes).
+bool Daemon::can_unicast(const DhcpDatagram &request_datagram,
+                         const in_addr_t unicast_address) {
+  return (request_datagram._flags & 0x8000) == 0 &&
+         request_datagram._hwaddr_len != 0 &&
+         std::find_if(request_datagram._hw_addr.cbegin(),
+                      request_datagram._hw_addr.cend(),
+                      [](uint8_t byte) { return byte > 0; }) !=
+             request_datagram._hw_addr.cend() &&
+         unicast_address != INADDR_ANY;
+}
+
+// Injects the destination <-> hwaddr mapping into the ARP cache, because the
+// client cannot answer ARP requests before it has configured its address.
+void Daemon::inject_arp_entry(const DhcpDatagram &request_datagram,
+                              const InterfaceInfo &interface,
+                              const struct sockaddr_in &destination) {
+  struct sockaddr arp_hwaddr {
+    .sa_family = request_datagram._hwaddr_type, .sa_data = {}
+  };
+  std::copy(request_datagram._hw_addr.cbegin(),
+            request_datagram._hw_addr.cbegin() + request_datagram._hwaddr_len,
+            arp_hwaddr.sa_data);
+
+  struct arpreq areq {
+    .arp_pa = {}, .arp_ha = arp_hwaddr, .arp_flags = ATF_COM,
+    .arp_netmask = {}, .arp_dev = {}
+  };
+  std::memcpy(&areq.arp_pa, &destination, sizeof(struct sockaddr_in));
+  std::strncpy(areq.arp_dev, interface.name.c_str(), sizeof(areq.arp_dev) - 1);
+  if (ioctl(_socket, SIOCSARP, &areq) != 0)
+    LOG_ERROR("Failed to inject into arp cache! Error: %d", errno);
+}
+
+// Sends the reply to the relay agent the request came through, otherwise to
+// unicast_address if possible and to the broadcast address of the receiving
+// interface if not.
+void Daemon::send_reply(const DhcpDatagram &request_datagram,
+                        DhcpDatagram &reply,
+                        const in_addr_t unicast_address_hostorder) {
+  // the interface has been checked when the request was received
+  const InterfaceInfo &interface =
+      *_interface_cache.find(request_datagram._recv_ifindex);
+  const std::span<const uint8_t> message_type =
+      reply._options.get(OptionTag::DHCP_MESSAGE_TYPE);
+  if (!message_type.empty()) {
+    switch (message_type[0]) {
+    case DHCP_TYPE_OFFER:
+      _metrics.count(Counter::OFFER);
+      break;
+    case DHCP_TYPE_ACK:
+      _metrics.count(Counter::ACK);
+      break;
+    case DHCP_TYPE_NAK:
+      _metrics.count(Counter::NAK);
+      break;
+    }
+  }
+  if (request_datagram._relay_agent_ip != INADDR_ANY) {
+    // the relay has to broadcast a NAK, the client may have lost its address
+    if (!message_type.empty() && message_type[0] == DHCP_TYPE_NAK) {
+      reply._flags |= 0x8000;
+    }
+    const struct sockaddr_in relay_destination {
+      .sin_family = AF_INET, .sin_port = htons(DHCP_SERVER_PORT),
+      .sin_addr = {.s_addr = htonl(request_datagram._relay_agent_ip)},
+      .sin_zero = {}
+    };
+    // the relay need not be on the receiving interface, let the routing
+    // table decide
+    cache_reply(request_datagram, relay_destination, 0, interface.address,
+                reply,
+                _socket.enqueue_datagram(relay_destination, 0,
+                                         interface.address, reply));
+    return;
+  }
   struct sockaddr_in destination {
     .sin_family = AF_INET, .sin_port = htons(DHCP_CLIENT_PORT),
-    .sin_addr = {.s_addr = unicast_address}, .sin_zero = {}
+    .sin_addr = {.s_addr = htonl(interface.broadcast_address)}, .sin_zero = {}
   };
-  bool is_unicast = true;
-
-  // is the broadcast flag set or the hw addr somehow not correct (e.g. all
-  // zeroes)?
-  if ((request_datagram._flags & 0x8000) != 0 ||
-      request_datagram._hwaddr_len == 0 ||
-      std::find_if(request_datagram._hw_addr.cbegin(),
-                   request_datagram._hw_addr.cend(),
-                   [](uint8_t byte) { return byte > 0; }) ==
-          request_datagram._hw_addr.cend() ||
-      unicast_address == INADDR_ANY) {
-    is_unicast = false;
-    struct ifreq ireq;
-    std::memcpy(&ireq.ifr_name, request_datagram._recv_iface.c_str(),
-                request_datagram._recv_iface.length() + 1);
-    if (ioctl(_socket, SIOCGIFBRDADDR, &ireq) != 0) {
-      LOG_ERROR(string_format("Failed to get broadcast address! Falling back "
-                              "to manual calculation. Error: %d",
-                              errno));
-      destination.sin_addr.s_addr =
-          (request_datagram._recv_addr | ~_netconfig.netmask.s_addr);
-    } else {
-      destination.sin_addr.s_addr =
-          reinterpret_cast<struct sockaddr_in *>(&ireq.ifr_broadaddr)
-              ->sin_addr.s_addr;
+  if (can_unicast(request_datagram, unicast_address_hostorder)) {
+    if (_raw_sender.has_value() &&
+        _raw_sender->send(request_datagram._recv_ifindex, interface,
+                          request_datagram, reply,
+                          unicast_address_hostorder)) {
+      return;
     }
+    destination.sin_addr.s_addr = htonl(unicast_address_hostorder);
+    inject_arp_entry(request_datagram, interface, destination);
   }
-  if (is_unicast) {
-    struct sockaddr arp_hwaddr {
-      .sa_family = request_datagram._hwaddr_type, .sa_data = {}
-    };
-    std::copy(request_datagram._hw_addr.cbegin(),
-              request_datagram._hw_addr.cbegin() + request_datagram._hwaddr_len,
-              arp_hwaddr.sa_data);
+  cache_reply(request_datagram, destination, request_datagram._recv_ifindex,
+              interface.address, reply,
+              _socket.enqueue_datagram(destination,
+                                       request_datagram._recv_ifindex,
+                                       interface.address, reply));
+}
 
-    struct arpreq areq {
-      .arp_pa = {}, .arp_ha = arp_hwaddr, .arp_flags = ATF_COM,
-      .arp_netmask = {}, .arp_dev = {}
-    };
-    std::memcpy(&areq.arp_pa, &destination, sizeof(struct sockaddr_in));
-    std::memcpy(&areq.arp_dev, request_datagram._recv_iface.c_str(),
-                request_datagram._recv_iface.length() + 1);
-    if (ioctl(_socket, SIOCSARP, &areq) != 0)
-      LOG_ERROR(
-          string_format("Failed to inject into arp cache! Error: %d", errno));
+// Keeps the reply to a DISCOVER or REQUEST for retransmissions of the
+// request. Replies sent through the packet socket are not cached.
+void Daemon::cache_reply(const DhcpDatagram &request_datagram,
+                         const struct sockaddr_in &destination,
+                         const int ifindex, const in_addr_t source_address,
+                         const DhcpDatagram &reply,
+                         const std::span<const uint8_t> encoded_reply) {
+  const std::span<const uint8_t> request_type =
+      request_datagram._options.get(OptionTag::DHCP_MESSAGE_TYPE);
+  const std::span<const uint8_t> reply_type =
+      reply._options.get(OptionTag::DHCP_MESSAGE_TYPE);
+  if (encoded_reply.empty() || request_type.empty() || reply_type.empty() ||
+      (request_type[0] != DHCP_TYPE_DISCOVER &&
+       request_type[0] != DHCP_TYPE_REQUEST)) {
+    return;
+  }
+  _reply_cache.insert(request_datagram, request_type[0],
+                      get_current_time() + REPLY_CACHE_TTL_SECONDS,
+                      destination, ifindex, source_address, reply_type[0],
+                      encoded_reply);
+}
+
+// Sends the cached reply if the request is a retransmission. Returns false if
+// the request has to be handled.
+bool Daemon::resend_cached_reply(const DhcpDatagram &request_datagram,
+                                 const uint8_t request_type) {
+  const CachedReply *cached = _reply_cache.find(
+      request_datagram, request_type, get_current_time());
+  if (cached == nullptr) {
+    return false;
+  }
+  LOG_DEBUG("Resending the reply to a retransmitted request");
+  _metrics.count(Counter::REPLY_CACHE_HIT);
+  switch (cached->message_type) {
+  case DHCP_TYPE_OFFER:
+    _metrics.count(Counter::OFFER);
+    break;
+  case DHCP_TYPE_ACK:
+    _metrics.count(Counter::ACK);
+    break;
+  case DHCP_TYPE_NAK:
+    _metrics.count(Counter::NAK);
+    break;
   }
-  return destination;
+  _socket.enqueue_encoded(cached->destination, cached->ifindex,
+                          cached->source_address, cached->data);
+  return true;
 }
 
 DhcpDatagram
@@ -466,126 +700,389 @@ Daemon::create_skeleton_reply_datagram(const DhcpDatagram &request_datagram) {
                     ._client_ip = INADDR_ANY,
                     ._assigned_ip = INADDR_ANY,
                     ._server_ip = INADDR_ANY,
-                    ._relay_agent_ip = INADDR_ANY,
+                    ._relay_agent_ip = request_datagram._relay_agent_ip,
                     ._recv_addr = 0x0,
-                    ._recv_iface = "",
+                    ._recv_ifindex = request_datagram._recv_ifindex,
+                    ._max_message_size = request_datagram._max_message_size,
                     ._hw_addr = {},
-                    ._options =
-                        std::unordered_map<OptionTag, std::vector<uint8_t>>()};
+                    ._options = DhcpOptions(),
+                    ._option_block = {}};
   std::copy(request_datagram._hw_addr.begin(), request_datagram._hw_addr.end(),
             skel._hw_addr.begin());
+  // relay agents expect their information back (RFC 3046)
+  if (request_datagram._options.contains(OptionTag::RELAY_AGENT_INFORMATION)) {
+    skel._options.set(
+        OptionTag::RELAY_AGENT_INFORMATION,
+        request_datagram._options.get(OptionTag::RELAY_AGENT_INFORMATION));
+  }
   return skel;
 }
 
-void Daemon::set_requested_options(const DhcpDatagram &request,
+// Attaches the configured options the client has asked for, except for the
+// lease time, which every reply sets on its own.
+void Daemon::set_requested_options(ServedSubnet &subnet,
+                                   const DhcpDatagram &request,
                                    DhcpDatagram &reply) {
-  if (!request._options.contains(OptionTag::PARAMETER_REQUEST_LIST)) {
+  reply._option_block = subnet.option_blocks.get(
+      request._options.get(OptionTag::PARAMETER_REQUEST_LIST));
+  LOG_TRACE("Attaching %lu bytes of configured options",
+            reply._option_block.size());
+}
+
+// Expires the leases whose timeout has passed. Only the entries that are
+// actually due are touched, the rest of the lease table is left alone.
+void Daemon::update_leases(ServedSubnet &subnet) {
+  const uint64_t current_time_seconds = get_current_time();
+  subnet.expiry_queue.pop_due(
+      current_time_seconds, [this, &subnet](const HardwareAddress &hwaddr,
+                                            const uint64_t timeout_timestamp) {
+        const Lease *lease = subnet.leases.find(hwaddr);
+        if (lease == nullptr || lease->timeout_timestamp != timeout_timestamp) {
+          // the lease has been renewed or released in the meantime
+          return;
+        }
+        remove_lease(subnet, hwaddr, LeaseEvent::EXPIRE);
+      });
+}
+
+// Records a lease and keeps the address pool and the lease journal in sync
+// with it. If the client previously held a different address, that address
+// is returned to the pool.
+void Daemon::store_lease(ServedSubnet &subnet, const HardwareAddress &hwaddr,
+                         const in_addr_t address_hostorder,
+                         const uint64_t timeout_timestamp,
+                         const LeaseEvent event) {
+  const Lease *lease =
+      insert_lease(subnet, hwaddr, address_hostorder, timeout_timestamp);
+  if (lease == nullptr) {
+    LOG_ERROR("Address %s is already leased to another client",
+              inet_ntoa({.s_addr = htonl(address_hostorder)}));
     return;
   }
-  for (uint8_t option :
-       request._options.at(OptionTag::PARAMETER_REQUEST_LIST)) {
-    if (!_netconfig.defined_options.contains(static_cast<OptionTag>(option)) ||
-        reply._options.contains(static_cast<OptionTag>(option))) {
-      LOG_TRACE(string_format("No configured value for option %x", option));
-      continue;
-    }
-    reply._options[static_cast<OptionTag>(option)] =
-        _netconfig.defined_options.at(static_cast<OptionTag>(option));
-    std::ostringstream os;
-    os << string_format("Set value for option %x to ", option);
-    for (auto &elem : reply._options[static_cast<OptionTag>(option)]) {
-      os << string_format("%x", elem);
-    }
-    LOG_DEBUG(os.str());
+  _lease_journal.append(event, *lease);
+  if (timeout_timestamp == UINT64_MAX) {
+    return;
+  }
+
+  subnet.expiry_queue.schedule(hwaddr, timeout_timestamp);
+  // renewals leave stale entries behind, so rebuild the queue once they
+  // outnumber the live ones
+  if (subnet.expiry_queue.size() > 2 * subnet.leases.size() + 1024) {
+    subnet.expiry_queue.rebuild(subnet.leases);
   }
 }
 
-void Daemon::update_leases() {
-  LOG_TRACE("Updating leases");
-  const uint64_t current_time_seconds = get_current_time();
-  for (auto map_iter = _active_leases.cbegin();
-       map_iter != _active_leases.cend();) {
-    if (map_iter->second.second <= current_time_seconds) {
-      map_iter = _active_leases.erase(map_iter);
-    } else {
-      ++map_iter;
+// Updates the lease table and the address pool, without journaling or
+// scheduling the expiry. Returns nullptr if another client holds the address.
+const Lease *Daemon::insert_lease(ServedSubnet &subnet,
+                                  const HardwareAddress &hwaddr,
+                                  const in_addr_t address_hostorder,
+                                  const uint64_t timeout_timestamp) {
+  if (!subnet.address_pool.reserve(address_hostorder)) {
+    // in use already, which is fine for the client's own address, its
+    // reservation or an address outside of the pool
+    const Lease *holder = subnet.leases.find_by_address(address_hostorder);
+    if (holder != nullptr && holder->hwaddr != hwaddr) {
+      return nullptr;
     }
   }
+  const Lease *existing_lease = subnet.leases.find(hwaddr);
+  if (existing_lease != nullptr &&
+      existing_lease->address != address_hostorder) {
+    release_address(subnet, existing_lease->address);
+  }
+  return &subnet.leases.insert_or_assign(hwaddr, address_hostorder,
+                                         timeout_timestamp);
 }
 
-void Daemon::load_leases() {
-  std::ifstream lease_file(_lease_file_path);
-  if (!lease_file.is_open()) {
-    LOG_WARN("The lease file does not exist! Creating a new one...");
-    lease_file = std::ifstream(_lease_file_path, std::fstream::trunc);
+void Daemon::remove_lease(ServedSubnet &subnet, const HardwareAddress &hwaddr,
+                          const LeaseEvent event) {
+  Lease *lease = subnet.leases.find(hwaddr);
+  if (lease == nullptr) {
+    return;
   }
+  // a lease that lost its address to another one must not free it
+  if (subnet.leases.find_by_address(lease->address) == lease) {
+    release_address(subnet, lease->address);
+  }
+  _lease_journal.append(event, *lease);
+  subnet.leases.erase(hwaddr);
+}
 
-  std::string current_line;
-  const uint64_t current_time_seconds = get_current_time();
-  LOG_DEBUG("Reading leases from file...");
+// Returns the address to the pool, unless it is reserved.
+void Daemon::release_address(ServedSubnet &subnet,
+                             const in_addr_t address_hostorder) {
+  if (subnet.config.fixed_hosts.find_by_address(address_hostorder) == nullptr) {
+    subnet.address_pool.release(address_hostorder);
+  }
+}
 
-  while (std::getline(lease_file, current_line)) {
-    LOG_TRACE(current_line);
-    size_t first_delim_pos = current_line.find_first_of(LEASE_FILE_DELIMITER);
-    size_t last_delim_pos = current_line.find_last_of(LEASE_FILE_DELIMITER);
+// Maps the interface to the subnet served on it. The result is cached per
+// interface index until interfaces are added, removed or renamed.
+ServedSubnet *Daemon::find_subnet(const int ifindex,
+                                  const InterfaceInfo &interface) {
+  if (_subnet_by_ifindex_generation != _interface_cache.generation()) {
+    _subnet_by_ifindex.clear();
+    _subnet_by_ifindex_generation = _interface_cache.generation();
+  }
+  if (static_cast<size_t>(ifindex) >= _subnet_by_ifindex.size()) {
+    _subnet_by_ifindex.resize(ifindex + 1, UNRESOLVED_SUBNET);
+  }
+  int32_t &subnet_index = _subnet_by_ifindex[ifindex];
+  if (subnet_index == UNRESOLVED_SUBNET) {
+    subnet_index = resolve_subnet(interface.name);
+  }
+  return subnet_index == NO_SUBNET ? nullptr : &_subnets[subnet_index];
+}
 
-    if (first_delim_pos == std::string::npos ||
-        last_delim_pos == std::string::npos) {
-      LOG_WARN(string_format("Invalid entry in lease file: %s", current_line));
-      continue;
+// A subnet without an interface serves every served interface that no other
+// subnet claims, or every interface at all if none have been configured.
+// Relay-only subnets are never served directly.
+int32_t Daemon::resolve_subnet(const std::string &interface_name) const {
+  int32_t default_subnet = NO_SUBNET;
+  for (size_t i = 0; i < _subnets.size(); i++) {
+    if (_subnets[i].config.interface == interface_name) {
+      return static_cast<int32_t>(i);
     }
+    if (_subnets[i].config.interface.empty() &&
+        !_subnets[i].config.relay_only) {
+      default_subnet = static_cast<int32_t>(i);
+    }
+  }
+  if (!_interface_names.empty() &&
+      std::find(_interface_names.begin(), _interface_names.end(),
+                interface_name) == _interface_names.end()) {
+    return NO_SUBNET;
+  }
+  return default_subnet;
+}
 
-    std::string hwaddr_string = current_line.substr(0, first_delim_pos);
-    std::string ipaddr_string = current_line.substr(
-        first_delim_pos + 1, last_delim_pos - first_delim_pos - 1);
-    uint64_t timeout_timestamp = std::strtoul(
-        current_line
-            .substr(last_delim_pos + 1, current_line.size() - last_delim_pos)
-            .c_str(),
-        nullptr, 10);
+ServedSubnet *
+Daemon::find_subnet_by_address(const in_addr_t address_hostorder) {
+  const std::optional<uint32_t> subnet_index =
+      _subnet_by_prefix.find(address_hostorder);
+  return subnet_index.has_value() ? &_subnets[subnet_index.value()] : nullptr;
+}
 
-    std::ostringstream os;
-    os << "IP: " << ipaddr_string << " | Ether: " << hwaddr_string
-       << " | Timestamp: " << timeout_timestamp;
-    LOG_DEBUG(os.str());
-    if (timeout_timestamp < current_time_seconds) {
-      continue;
+// Builds empty subnets for the snapshot, which is kept alive as long as they
+// refer to it.
+void Daemon::install_configuration(
+    std::shared_ptr<const ConfigurationSnapshot> configuration) {
+  std::vector<ServedSubnet> subnets;
+  subnets.reserve(configuration->subnets.size());
+  std::vector<PrefixTable::Prefix> subnet_prefixes;
+  for (const SubnetConfiguration &subnet_config : configuration->subnets) {
+    subnet_prefixes.push_back(PrefixTable::Prefix{
+        .network = ntohl(subnet_config.subnet_address.s_addr),
+        .length = static_cast<uint8_t>(
+            std::popcount(ntohl(subnet_config.netmask.s_addr))),
+        .value = static_cast<uint32_t>(subnets.size())});
+    const auto [first, last] =
+        get_pool_shard(subnet_config, _worker_index, _worker_count);
+    subnets.push_back(ServedSubnet{.config = subnet_config,
+                                   .address_pool = AddressPool(first, last),
+                                   .leases = LeaseTable(),
+                                   .expiry_queue = LeaseExpiryQueue(),
+                                   .option_blocks = OptionBlockCache(
+                                       subnet_config.defined_options)});
+    // reserved addresses are never handed out dynamically
+    for (const Reservation &reservation : subnet_config.fixed_hosts) {
+      subnets.back().address_pool.reserve(reservation.address);
+    }
+    if (_worker_count > 1) {
+      // inet_ntoa() reuses its buffer
+      const std::string first_address = inet_ntoa({.s_addr = htonl(first)});
+      LOG_INFO("Worker %u serves addresses %s - %s", _worker_index,
+               first_address.c_str(), inet_ntoa({.s_addr = htonl(last)}));
+    }
+  }
+  _subnets = std::move(subnets);
+  _subnet_by_prefix = PrefixTable(std::move(subnet_prefixes));
+  _subnet_by_ifindex.clear();
+  _configuration = std::move(configuration);
+}
+
+// Switches to the latest snapshot. The leases are carried over if they are
+// still valid. Dropped leases are journaled as expired, so the clients get a
+// NAK when they renew and start over.
+void Daemon::reload_configuration() {
+  const std::shared_ptr<const ConfigurationSnapshot> previous = _configuration;
+  const std::vector<Lease> leases = snapshot_leases();
+  install_configuration(_config_store.load());
+  _reply_cache.clear();
+
+  size_t dropped = 0;
+  // still in the range, but now in the part of another worker
+  size_t moved_shard = 0;
+  for (const Lease &lease : leases) {
+    ServedSubnet *subnet = find_subnet_by_address(lease.address);
+    const bool valid = subnet != nullptr && lease_is_valid(*subnet, lease);
+    if (valid) {
+      insert_lease(*subnet, lease.hwaddr, lease.address,
+                   lease.timeout_timestamp);
+    } else {
+      _lease_journal.append(LeaseEvent::EXPIRE, lease);
+      dropped++;
+      if (subnet != nullptr &&
+          lease.address >= ntohl(subnet->config.range_start.s_addr) &&
+          lease.address <= ntohl(subnet->config.range_end.s_addr) &&
+          !subnet->address_pool.contains(lease.address)) {
+        moved_shard++;
+      }
     }
+  }
+  for (ServedSubnet &subnet : _subnets) {
+    subnet.expiry_queue.rebuild(subnet.leases);
+  }
+  LOG_INFO("Worker %u switched to configuration generation %lu, kept %lu "
+           "leases, dropped %lu",
+           _worker_index, _configuration->generation, leases.size() - dropped,
+           dropped);
+  if (moved_shard > 0) {
+    LOG_WARN("Worker %u dropped %lu leases that are still in the range but "
+             "now belong to another worker, those clients get a NAK when "
+             "they renew",
+             _worker_index, moved_shard);
+  }
+}
 
-    std::array<uint8_t, 16> hwaddr;
-    size_t index = 0;
-    size_t pos = 0;
-    while ((pos = hwaddr_string.find_first_of(':')) != std::string::npos) {
-      hwaddr.at(index) =
-          std::strtol(hwaddr_string.substr(0, pos).c_str(), nullptr, 16);
-      hwaddr_string.erase(0, pos + 1); // account for delimiter length
-      index++;
+// A lease is valid if its address is in this worker's part of the range and
+// not reserved for another client, or if it is the client's reservation.
+bool Daemon::lease_is_valid(const ServedSubnet &subnet, const Lease &lease) {
+  const Reservation *reservation = subnet.config.fixed_hosts.find(lease.hwaddr);
+  if (reservation != nullptr) {
+    return reservation->address == lease.address;
+  }
+  return subnet.address_pool.contains(lease.address) &&
+         subnet.config.fixed_hosts.find_by_address(lease.address) == nullptr;
+}
+
+void Daemon::load_leases() {
+  const uint64_t current_time_seconds = get_current_time();
+  LOG_DEBUG("Reading leases from file...");
+  // leases of subnets that are no longer configured are dropped
+  const auto insert_if_valid = [this,
+                                current_time_seconds](const Lease &lease) {
+    ServedSubnet *subnet = find_subnet_by_address(lease.address);
+    if (subnet != nullptr && lease.timeout_timestamp >= current_time_seconds &&
+        lease_is_valid(*subnet, lease)) {
+      insert_lease(*subnet, lease.hwaddr, lease.address,
+                   lease.timeout_timestamp);
     }
+  };
+  if (!read_lease_file(_lease_file_path, insert_if_valid)) {
+    LOG_WARN("The lease file does not exist! Creating a new one...");
+    write_lease_file(_lease_file_path, {}, _lease_file_format);
+  }
 
-    struct in_addr ip_addr {};
-    inet_aton(ipaddr_string.c_str(), &ip_addr);
-    _active_leases[hwaddr] =
-        std::make_pair(ntohl(ip_addr.s_addr), timeout_timestamp);
+  _lease_journal.replay(
+      [this, &insert_if_valid](const LeaseEvent event, const Lease &lease) {
+        if (event == LeaseEvent::RELEASE || event == LeaseEvent::EXPIRE) {
+          ServedSubnet *subnet = find_subnet_by_address(lease.address);
+          if (subnet != nullptr) {
+            remove_lease(*subnet, lease.hwaddr, event);
+          }
+        } else {
+          insert_if_valid(lease);
+        }
+      });
+  _lease_journal.open();
+  size_t lease_count = 0;
+  for (ServedSubnet &subnet : _subnets) {
+    subnet.expiry_queue.rebuild(subnet.leases);
+    lease_count += subnet.leases.size();
   }
-  lease_file.close();
+  LOG_INFO("Loaded %lu leases", lease_count);
 }
 
+// Writes a complete lease file and discards the journal entries it replaces.
 void Daemon::write_leases() {
-  std::ofstream lease_file(_lease_file_path);
-
-  update_leases();
-  struct in_addr ip_addr;
+  for (ServedSubnet &subnet : _subnets) {
+    update_leases(subnet);
+  }
   LOG_DEBUG("Writing leases to file");
-  for (auto const &[hwaddr, value_pair] : _active_leases) {
-    for (const uint8_t &octet : hwaddr) {
-      lease_file << string_format("%x", octet) << ":";
-    }
-    lease_file << LEASE_FILE_DELIMITER;
-    ip_addr.s_addr = htonl(value_pair.first);
-    lease_file << inet_ntoa(ip_addr) << LEASE_FILE_DELIMITER
-               << value_pair.second << "\n";
+  _lease_journal.flush();
+  write_lease_file(_lease_file_path, snapshot_leases(), _lease_file_format);
+  _lease_journal.reset();
+}
+
+std::vector<Lease> Daemon::snapshot_leases() {
+  std::vector<Lease> snapshot;
+  size_t lease_count = 0;
+  for (const ServedSubnet &subnet : _subnets) {
+    lease_count += subnet.leases.size();
+  }
+  snapshot.reserve(lease_count);
+  for (const ServedSubnet &subnet : _subnets) {
+    subnet.leases.for_each(
+        [&snapshot](const Lease &lease) { snapshot.push_back(lease); });
+  }
+  return snapshot;
+}
+
+void Daemon::handle_tick() {
+  _interface_cache.handle_tick();
+  if (_config_store.generation() != _configuration->generation) {
+    reload_configuration();
+  }
+  for (ServedSubnet &subnet : _subnets) {
+    update_leases(subnet);
+  }
+  _lease_journal.flush_if_due();
+  if (_lease_journal.compaction_due()) {
+    _lease_journal.start_compaction(snapshot_leases(), _lease_file_path,
+                                    _lease_file_format);
+  }
+  _metrics.set_send_queue_depth(_socket.send_queue_length());
+  const uint64_t current_time_seconds = get_current_time();
+  if (current_time_seconds >= _next_metrics_refresh) {
+    refresh_metrics();
+    _next_metrics_refresh =
+        current_time_seconds + METRICS_REFRESH_INTERVAL_SECONDS;
   }
-  lease_file.flush();
+}
+
+// Updates the gauges of the subnet shards, and the service status if this is
+// the first worker.
+void Daemon::refresh_metrics() {
+  const uint64_t current_time_seconds = get_current_time();
+  for (size_t i = 0; i < _subnets.size(); i++) {
+    const ServedSubnet &subnet = _subnets[i];
+    uint64_t active = 0;
+    uint64_t expiring = 0;
+    subnet.leases.for_each([&](const Lease &lease) {
+      // declined addresses are not leased to anybody
+      if (lease.timeout_timestamp == UINT64_MAX) {
+        return;
+      }
+      active++;
+      if (lease.timeout_timestamp - current_time_seconds <
+          subnet.config.lease_time_seconds / 2) {
+        expiring++;
+      }
+    });
+    SubnetGauges &gauges = _metrics.subnet(i);
+    gauges.pool_size.store(subnet.address_pool.size(),
+                           std::memory_order_relaxed);
+    gauges.pool_used.store(subnet.address_pool.size() -
+                               subnet.address_pool.free_count(),
+                           std::memory_order_relaxed);
+    gauges.leases_active.store(active, std::memory_order_relaxed);
+    gauges.leases_expiring.store(expiring, std::memory_order_relaxed);
+  }
+  const uint64_t rate_limited = _metrics.get(Counter::RATE_LIMITED_CLIENT) +
+                                _metrics.get(Counter::RATE_LIMITED_INTERFACE) +
+                                _metrics.get(Counter::RATE_LIMITED_GLOBAL);
+  if (rate_limited > _rate_limited_reported) {
+    LOG_WARN("Dropped %lu messages over the rate limits",
+             rate_limited - _rate_limited_reported);
+    _rate_limited_reported = rate_limited;
+  }
+#ifdef HAVE_SYSTEMD
+  if (_worker_index == 0) {
+    sd_notify(0, ("STATUS=" + _metrics_registry.status()).c_str());
+  }
+#endif
 }
 
 uint64_t Daemon::get_current_time() {
@@ -2,10 +2,24 @@
 
 #include <cstdint>
 #include <fstream>
+#include <memory>
 #include <netinet/in.h>
+#include <optional>
 
+#include "address_pool.hpp"
 #include "configuration.hpp"
+#include "configuration_store.hpp"
 #include "epoll.hpp"
+#include "interface_cache.hpp"
+#include "lease_expiry_queue.hpp"
+#include "lease_file.hpp"
+#include "lease_journal.hpp"
+#include "lease_table.hpp"
+#include "metrics.hpp"
+#include "option_block_cache.hpp"
+#include "prefix_table.hpp"
+#include "raw_sender.hpp"
+#include "reply_cache.hpp"
 #include "socket.hpp"
 #include "socket_observer.hpp"
 #include "subnet_config.hpp"
@@ -14,33 +28,103 @@ namespace tinydhcpd {
 
 void sighandler(int signum);
 
+// A subnet and the part of the lease state that belongs to it. Leases are
+// kept per subnet, so a client may hold an address in several of them.
+struct ServedSubnet {
+  // part of the configuration snapshot the daemon currently holds
+  const SubnetConfiguration &config;
+  AddressPool address_pool;
+  LeaseTable leases;
+  LeaseExpiryQueue expiry_queue;
+  OptionBlockCache option_blocks;
+};
+
 class Daemon : SocketObserver {
 private:
+  const uint32_t _worker_index;
+  const uint32_t _worker_count;
+  const ConfigurationStore &_config_store;
+  std::shared_ptr<const ConfigurationSnapshot> _configuration;
+  WorkerMetrics &_metrics;
+  const MetricsRegistry &_metrics_registry;
+  InterfaceCache _interface_cache;
   Socket _socket;
   Epoll<Socket> _epoll_socket;
-  SubnetConfiguration _netconfig;
+  std::optional<RawSender> _raw_sender;
+  const std::vector<std::string> _interface_names;
+  std::vector<ServedSubnet> _subnets;
+  // index into _subnets per interface index, resolved on first use
+  std::vector<int32_t> _subnet_by_ifindex;
+  uint64_t _subnet_by_ifindex_generation;
+  // index into _subnets by the longest subnet prefix containing an address
+  PrefixTable _subnet_by_prefix;
   std::string _lease_file_path;
-  std::map<std::array<uint8_t, 16>, std::pair<in_addr_t, uint64_t>>
-      _active_leases;
+  LeaseFileFormat _lease_file_format;
+  LeaseJournal _lease_journal;
+  ReplyCache _reply_cache;
+  // only served by the first worker
+  std::optional<MetricsExporter> _metrics_exporter;
+  uint64_t _next_metrics_refresh;
+  // rate limited messages at the last refresh
+  uint64_t _rate_limited_reported;
   DhcpDatagram
   create_skeleton_reply_datagram(const DhcpDatagram &request_datagram);
+  ServedSubnet *find_subnet(const int ifindex, const InterfaceInfo &interface);
+  int32_t resolve_subnet(const std::string &interface_name) const;
+  ServedSubnet *find_subnet_by_address(const in_addr_t address_hostorder);
+  void install_configuration(
+      std::shared_ptr<const ConfigurationSnapshot> configuration);
+  void reload_configuration();
+  bool lease_is_valid(const ServedSubnet &subnet, const Lease &lease);
   void load_leases();
-  void update_leases();
+  void update_leases(ServedSubnet &subnet);
+  std::vector<Lease> snapshot_leases();
+  void refresh_metrics();
+  void store_lease(ServedSubnet &subnet, const HardwareAddress &hwaddr,
+                   const in_addr_t address_hostorder,
+                   const uint64_t timeout_timestamp, const LeaseEvent event);
+  const Lease *insert_lease(ServedSubnet &subnet, const HardwareAddress &hwaddr,
+                            const in_addr_t address_hostorder,
+                            const uint64_t timeout_timestamp);
+  void remove_lease(ServedSubnet &subnet, const HardwareAddress &hwaddr,
+                    const LeaseEvent event);
+  void release_address(ServedSubnet &subnet, const in_addr_t address_hostorder);
   uint64_t get_current_time();
-  struct sockaddr_in get_reply_destination(const DhcpDatagram &request_datagram,
-                                           const in_addr_t unicast_address);
-  void set_requested_options(const DhcpDatagram &request, DhcpDatagram &reply);
-  void handle_discovery(const DhcpDatagram &datagram);
-  void handle_request(const DhcpDatagram &datagram);
-  void handle_decline(const DhcpDatagram &datagram);
-  void handle_release(const DhcpDatagram &datagram);
-  void handle_inform(const DhcpDatagram &datagram);
+  bool can_unicast(const DhcpDatagram &request_datagram,
+                   const in_addr_t unicast_address);
+  void inject_arp_entry(const DhcpDatagram &request_datagram,
+                        const InterfaceInfo &interface,
+                        const struct sockaddr_in &destination);
+  void send_reply(const DhcpDatagram &request_datagram, DhcpDatagram &reply,
+                  const in_addr_t unicast_address_hostorder);
+  void cache_reply(const DhcpDatagram &request_datagram,
+                   const struct sockaddr_in &destination, const int ifindex,
+                   const in_addr_t source_address, const DhcpDatagram &reply,
+                   const std::span<const uint8_t> encoded_reply);
+  bool resend_cached_reply(const DhcpDatagram &request_datagram,
+                           const uint8_t request_type);
+  void set_requested_options(ServedSubnet &subnet, const DhcpDatagram &request,
+                             DhcpDatagram &reply);
+  void handle_discovery(ServedSubnet &subnet, const DhcpDatagram &datagram);
+  void handle_request(ServedSubnet &subnet, const DhcpDatagram &datagram);
+  void handle_decline(ServedSubnet &subnet, const DhcpDatagram &datagram);
+  void handle_release(ServedSubnet &subnet, const DhcpDatagram &datagram);
+  void handle_inform(ServedSubnet &subnet, const DhcpDatagram &datagram);
 
 public:
-  Daemon(const struct in_addr &address, const std::string &iface_name,
-         SubnetConfiguration &netconfig, const std::string &lease_file_path);
+  // With more than one worker, every worker serves its own shard of the
+  // address range of every subnet and keeps its own lease file, suffixed with
+  // the worker index.
+  // The subnets are taken from the store, and replaced whenever a new
+  // snapshot is published.
+  Daemon(const ProgramConfiguration &config, const uint32_t worker_index,
+         const ConfigurationStore &config_store,
+         MetricsRegistry &metrics_registry);
   virtual ~Daemon() {}
   virtual void handle_recv(DhcpDatagram &datagram) override;
+  virtual bool accepts_destination(const int ifindex,
+                                   const in_addr_t destination) override;
+  virtual void handle_tick() override;
   void main_loop();
   void write_leases();
   void daemonize(const DAEMON_TYPE type);
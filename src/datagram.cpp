@@ -1,5 +1,7 @@
 #include "datagram.hpp"
 
+#include <cstring>
+
 #include "log/logger.hpp"
 #include "string-format.hpp"
 
@@ -23,101 +25,113 @@ const size_t OPTIONS_OFFSET = 240;
 
 const uint32_t DHCP_MAGIC_COOKIE = 0x63825363;
 
-const std::unordered_map<OptionTag, uint8_t> predefined_option_lengths = {
-    {OptionTag::PAD, 0},
-    {OptionTag::DHCP_MESSAGE_TYPE, 1},
-    {OptionTag::SUBNET_MASK, 4},
-    {OptionTag::TIME_OFFSET, 4},
-    {OptionTag::REQUESTED_IP_ADDRESS, 4},
-    {OptionTag::OPTIONS_END, 0},
-};
-
 DhcpDatagram DhcpDatagram::from_buffer(uint8_t *buffer, size_t buflen) {
+  if (buflen < OPTIONS_OFFSET) {
+    throw std::invalid_argument(
+        string_format("Message too short for DHCP: %lu bytes", buflen));
+  }
   DhcpDatagram datagram;
+  datagram._recv_addr = INADDR_ANY;
+  datagram._recv_ifindex = 0;
   datagram._opcode = buffer[OPCODE_OFFSET];
   datagram._hwaddr_type = buffer[HWADDR_TYPE_OFFSET];
   datagram._hwaddr_len = buffer[HWADDR_LENGTH_OFFSET];
 
   datagram._transaction_id =
-      convert_network_byte_array_to_uint32(buffer + TRANSACTION_ID_OFFSET);
+      load_network_order<uint32_t>(buffer + TRANSACTION_ID_OFFSET);
   datagram._secs_passed =
-      convert_network_byte_array_to_uint16(buffer + SECS_PASSED_OFFSET);
-  datagram._flags = to_number<uint16_t>(buffer + FLAGS_OFFSET);
+      load_network_order<uint16_t>(buffer + SECS_PASSED_OFFSET);
+  datagram._flags = load_network_order<uint16_t>(buffer + FLAGS_OFFSET);
 
-  datagram._client_ip = to_number<uint32_t>(buffer + CLIENT_IP_OFFSET);
-  datagram._assigned_ip = to_number<uint32_t>(buffer + ASSIGNED_IP_OFFSET);
-  datagram._server_ip = to_number<uint32_t>(buffer + SERVER_IP_OFFSET);
+  datagram._client_ip = load_network_order<uint32_t>(buffer + CLIENT_IP_OFFSET);
+  datagram._assigned_ip =
+      load_network_order<uint32_t>(buffer + ASSIGNED_IP_OFFSET);
+  datagram._server_ip = load_network_order<uint32_t>(buffer + SERVER_IP_OFFSET);
+  datagram._relay_agent_ip =
+      load_network_order<uint32_t>(buffer + RELAY_AGENT_IP_OFFSET);
 
-  std::copy(buffer + CLIENT_HWADDR_OFFSET, buffer + SERVER_HOSTNAME_OFFSET - 1,
-            datagram._hw_addr.begin());
-  uint32_t cookie = ntohl(*(uint32_t *)(buffer + MAGIC_COOKIE_OFFSET));
+  std::memcpy(datagram._hw_addr.data(), buffer + CLIENT_HWADDR_OFFSET,
+              datagram._hw_addr.size());
+  uint32_t cookie = load_network_order<uint32_t>(buffer + MAGIC_COOKIE_OFFSET);
   if (cookie != DHCP_MAGIC_COOKIE) {
-    LOG_DEBUG(string_format("DHCP cookie: got %x | expected %x", cookie,
-                            DHCP_MAGIC_COOKIE));
+    LOG_DEBUG("DHCP cookie: got %x | expected %x", cookie, DHCP_MAGIC_COOKIE);
     LOG_WARN("Not a DHCP message!");
   }
 
   datagram._options =
-      parse_options(buffer + OPTIONS_OFFSET, buflen - OPTIONS_OFFSET);
+      DhcpOptions::parse(buffer + OPTIONS_OFFSET, buflen - OPTIONS_OFFSET);
+  const std::span<const uint8_t> max_message_size =
+      datagram._options.get(OptionTag::MAX_MESSAGE_SIZE);
+  datagram._max_message_size =
+      max_message_size.empty()
+          ? DEFAULT_MAX_MESSAGE_SIZE
+          : std::max(DEFAULT_MAX_MESSAGE_SIZE,
+                     load_network_order<uint16_t>(max_message_size.data()));
   return datagram;
 }
 
-std::unordered_map<OptionTag, std::vector<uint8_t>>
-DhcpDatagram::parse_options(const uint8_t *options_buffer, size_t buffer_size) {
-  std::unordered_map<OptionTag, std::vector<uint8_t>> parsed_options;
-  while (options_buffer < (options_buffer + buffer_size)) {
-    OptionTag tag = static_cast<OptionTag>(*options_buffer++);
-    if (predefined_option_lengths.contains(tag) &&
-        predefined_option_lengths.at(tag) == 0) {
-      if (tag == OptionTag::OPTIONS_END) {
-        break;
-      }
-      continue;
-    }
-
-    uint8_t option_length = *(options_buffer++);
-    if (predefined_option_lengths.contains(tag) &&
-        predefined_option_lengths.at(tag) != option_length) {
-      throw std::invalid_argument(
-          string_format("Invalid option length! Tag: %u | Legal length: %u | "
-                        "Actual length: %u",
-                        static_cast<uint8_t>(tag),
-                        predefined_option_lengths.at(tag), option_length));
-    }
-    std::vector<uint8_t> value(options_buffer, options_buffer + option_length);
-    parsed_options[tag] = value;
-    options_buffer += option_length;
-  }
-  return parsed_options;
+size_t DhcpDatagram::encoded_size() const {
+  size_t size = OPTIONS_OFFSET + _option_block.size() + 1; // options end
+  _options.for_each(
+      [&size](const OptionTag, const std::span<const uint8_t> value) {
+        size += 2 + value.size();
+      });
+  return size;
 }
 
-std::vector<uint8_t> DhcpDatagram::to_byte_vector() {
-  std::vector<uint8_t> bytes;
-  bytes.push_back(_opcode);
-  bytes.push_back(_hwaddr_type);
-  bytes.push_back(_hwaddr_len);
-  bytes.push_back(0x0); // hops
-  convert_number_to_network_byte_array_and_push(bytes, _transaction_id);
-  convert_number_to_network_byte_array_and_push(bytes, _secs_passed);
-  convert_number_to_byte_array_and_push(bytes, _flags);
-  convert_number_to_byte_array_and_push(bytes, _client_ip);
-  convert_number_to_byte_array_and_push(bytes, _assigned_ip);
-  convert_number_to_byte_array_and_push(bytes, _server_ip);
-  convert_number_to_byte_array_and_push(bytes, _relay_agent_ip);
-  std::copy(_hw_addr.begin(), _hw_addr.end(), std::back_inserter(bytes));
-  std::fill_n(std::back_inserter(bytes), 192, 0x0); // server name & boot file
-  bytes.push_back((DHCP_MAGIC_COOKIE & (0xff << 24)) >> 24);
-  bytes.push_back((DHCP_MAGIC_COOKIE & (0xff << 16)) >> 16);
-  bytes.push_back((DHCP_MAGIC_COOKIE & (0xff << 8)) >> 8);
-  bytes.push_back(DHCP_MAGIC_COOKIE & 0xff);
-  for (auto &entry : _options) {
-    bytes.push_back(static_cast<uint8_t>(entry.first));
-    bytes.push_back(static_cast<uint8_t>(entry.second.size()));
-    std::copy(entry.second.begin(), entry.second.end(),
-              std::back_inserter(bytes));
+size_t DhcpDatagram::encode(uint8_t *buffer, const size_t capacity) const {
+  const size_t size = encoded_size();
+  if (size > capacity) {
+    throw std::invalid_argument(
+        string_format("Datagram does not fit into %lu bytes: %lu bytes",
+                      capacity, size));
   }
-  bytes.push_back(static_cast<uint8_t>(OptionTag::OPTIONS_END));
+  buffer[OPCODE_OFFSET] = _opcode;
+  buffer[HWADDR_TYPE_OFFSET] = _hwaddr_type;
+  buffer[HWADDR_LENGTH_OFFSET] = _hwaddr_len;
+  buffer[NR_HOPS_OFFSET] = 0x0;
+  store_network_order(buffer + TRANSACTION_ID_OFFSET, _transaction_id);
+  store_network_order(buffer + SECS_PASSED_OFFSET, _secs_passed);
+  store_network_order(buffer + FLAGS_OFFSET, _flags);
+  store_network_order(buffer + CLIENT_IP_OFFSET, _client_ip);
+  store_network_order(buffer + ASSIGNED_IP_OFFSET, _assigned_ip);
+  store_network_order(buffer + SERVER_IP_OFFSET, _server_ip);
+  store_network_order(buffer + RELAY_AGENT_IP_OFFSET, _relay_agent_ip);
+  std::memcpy(buffer + CLIENT_HWADDR_OFFSET, _hw_addr.data(), _hw_addr.size());
+  // server name & boot file
+  std::memset(buffer + SERVER_HOSTNAME_OFFSET, 0,
+              MAGIC_COOKIE_OFFSET - SERVER_HOSTNAME_OFFSET);
+  store_network_order(buffer + MAGIC_COOKIE_OFFSET, DHCP_MAGIC_COOKIE);
 
-  return bytes;
+  uint8_t *option = buffer + OPTIONS_OFFSET;
+  const auto encode_option = [&option](const OptionTag tag,
+                                       const std::span<const uint8_t> value) {
+    option[0] = static_cast<uint8_t>(tag);
+    option[1] = static_cast<uint8_t>(value.size());
+    std::memcpy(option + 2, value.data(), value.size());
+    option += 2 + value.size();
+  };
+  // some clients expect the message type to be the first option
+  if (_options.contains(OptionTag::DHCP_MESSAGE_TYPE)) {
+    encode_option(OptionTag::DHCP_MESSAGE_TYPE,
+                  _options.get(OptionTag::DHCP_MESSAGE_TYPE));
+  }
+  _options.for_each(
+      [&encode_option](const OptionTag tag,
+                       const std::span<const uint8_t> value) {
+        if (tag != OptionTag::DHCP_MESSAGE_TYPE &&
+            tag != OptionTag::RELAY_AGENT_INFORMATION) {
+          encode_option(tag, value);
+        }
+      });
+  std::memcpy(option, _option_block.data(), _option_block.size());
+  option += _option_block.size();
+  // relay agents expect their information to be the last option (RFC 3046)
+  if (_options.contains(OptionTag::RELAY_AGENT_INFORMATION)) {
+    encode_option(OptionTag::RELAY_AGENT_INFORMATION,
+                  _options.get(OptionTag::RELAY_AGENT_INFORMATION));
+  }
+  *option = static_cast<uint8_t>(OptionTag::OPTIONS_END);
+  return size;
 }
 } // namespace tinydhcpd
@@ -1,34 +1,16 @@
 #pragma once
 
 #include <netinet/in.h>
-#include <unordered_map>
+#include <string>
 
 #include "bytemanip.hpp"
+#include "dhcp_options.hpp"
 
 namespace tinydhcpd {
-enum struct OptionTag : uint8_t {
-  PAD = 0,
-  SUBNET_MASK = 1,
-  TIME_OFFSET = 2,
-  ROUTERS = 3,
-  TIME_SERVER = 4,
-  NAME_SERVER = 5,
-  DNS_SERVER = 6,
-  LOG_SERVER = 7,
-  HOSTNAME = 12,
-  DOMAIN_NAME = 15,
-  IFACE_MTU = 26,
-  BROADCAST_ADDR = 28,
-  STATIC_ROUTES = 33,
-  REQUESTED_IP_ADDRESS = 50,
-  LEASE_TIME = 51,
-  DHCP_MESSAGE_TYPE = 53,
-  SERVER_IDENTIFIER = 54,
-  PARAMETER_REQUEST_LIST = 55,
-  DHCP_RENEW_TIME = 58,
-  DHCP_REBINDING_TIME = 59,
-  OPTIONS_END = 255
-};
+constexpr uint16_t DHCP_SERVER_PORT = 67;
+constexpr uint16_t DHCP_CLIENT_PORT = 68;
+// every client has to accept IP datagrams of this size
+constexpr uint16_t DEFAULT_MAX_MESSAGE_SIZE = 576;
 
 struct DhcpDatagram {
   uint8_t _opcode;
@@ -44,18 +26,28 @@ struct DhcpDatagram {
   uint32_t _server_ip;
   uint32_t _relay_agent_ip;
 
+  // address of the receiving interface (host byte order)
   in_addr_t _recv_addr;
-  std::string _recv_iface;
+  int _recv_ifindex;
+  // largest IP datagram the receiver accepts
+  uint16_t _max_message_size;
 
   std::array<uint8_t, 16> _hw_addr;
 
-  std::unordered_map<OptionTag, std::vector<uint8_t>> _options;
+  // refers to the buffer the datagram was parsed from
+  DhcpOptions _options;
+  // pre-encoded options that are sent after _options
+  std::span<const uint8_t> _option_block;
 
   static DhcpDatagram from_buffer(uint8_t *buffer, size_t buflen);
 
-  std::vector<uint8_t> to_byte_vector();
-  static std::unordered_map<OptionTag, std::vector<uint8_t>>
-  parse_options(const uint8_t *options_buffer, size_t buffer_size);
+  size_t encoded_size() const;
+  // Writes the wire format of the datagram to the buffer, with the message
+  // type as the first option, the others in ascending tag order, then the
+  // option block and the relay agent information last. Returns the number of
+  // bytes written, or throws std::invalid_argument if the datagram does not
+  // fit.
+  size_t encode(uint8_t *buffer, const size_t capacity) const;
 };
 
 } // namespace tinydhcpd
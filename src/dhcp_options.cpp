@@ -0,0 +1,128 @@
+#include "dhcp_options.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "option_catalog.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+// The options the server reads. A message with an illegal length in one of
+// them is rejected, while other options with an illegal length are left out,
+// as clients send e.g. empty host names.
+constexpr OptionLengthSet required_legal_options = [] {
+  OptionLengthSet tags{};
+  for (const OptionTag tag :
+       {OptionTag::REQUESTED_IP_ADDRESS, OptionTag::DHCP_MESSAGE_TYPE,
+        OptionTag::SERVER_IDENTIFIER, OptionTag::PARAMETER_REQUEST_LIST,
+        OptionTag::MAX_MESSAGE_SIZE, OptionTag::CLIENT_IDENTIFIER}) {
+    const uint8_t index = static_cast<uint8_t>(tag);
+    tags[index / 64] |= uint64_t{1} << (index % 64);
+  }
+  return tags;
+}();
+
+DhcpOptions::DhcpOptions() : _buffer(nullptr), _present{}, _storage_used(0) {}
+
+DhcpOptions DhcpOptions::parse(const uint8_t *buffer, const size_t length) {
+  DhcpOptions options;
+  options._buffer = buffer;
+  size_t offset = 0;
+  while (offset < length) {
+    const uint8_t tag = buffer[offset++];
+    if (tag == static_cast<uint8_t>(OptionTag::PAD)) {
+      continue;
+    }
+    if (tag == static_cast<uint8_t>(OptionTag::OPTIONS_END)) {
+      break;
+    }
+    if (offset >= length) {
+      throw std::invalid_argument(
+          string_format("Option %u is missing its length", tag));
+    }
+    const uint8_t option_length = buffer[offset++];
+    if (option_length > length - offset) {
+      throw std::invalid_argument(string_format(
+          "Option %u exceeds the message! Length: %u | Remaining: %lu", tag,
+          option_length, length - offset));
+    }
+    if (!is_legal_option_length(tag, option_length)) {
+      if ((required_legal_options[tag / 64] >> (tag % 64)) & 1) {
+        const OptionDefinition &definition = option_definitions[tag];
+        throw std::invalid_argument(string_format(
+            "Invalid option length! Tag: %u | Legal lengths: %u - %u | "
+            "Actual length: %u",
+            tag, definition.min_length, definition.max_length, option_length));
+      }
+      offset += option_length;
+      continue;
+    }
+    // a repeated option replaces the earlier occurrence
+    options._slots[tag] = Slot{.offset = static_cast<uint16_t>(offset),
+                               .length = option_length,
+                               .internal = false};
+    options.mark_present(tag);
+    offset += option_length;
+  }
+  return options;
+}
+
+void DhcpOptions::mark_present(const uint8_t tag) {
+  _present[tag / 64] |= uint64_t{1} << (tag % 64);
+}
+
+const uint8_t *DhcpOptions::data(const Slot &slot) const {
+  return (slot.internal ? _storage.data() : _buffer) + slot.offset;
+}
+
+bool DhcpOptions::contains(const OptionTag tag) const {
+  const uint8_t index = static_cast<uint8_t>(tag);
+  return (_present[index / 64] >> (index % 64)) & 1;
+}
+
+std::span<const uint8_t> DhcpOptions::get(const OptionTag tag) const {
+  if (!contains(tag)) {
+    return {};
+  }
+  const Slot &slot = _slots[static_cast<uint8_t>(tag)];
+  return std::span<const uint8_t>(data(slot), slot.length);
+}
+
+void DhcpOptions::set(const OptionTag tag,
+                      const std::span<const uint8_t> value) {
+  if (value.size() > UINT8_MAX) {
+    throw std::invalid_argument(
+        string_format("Value of option %u is too long: %lu",
+                      static_cast<uint8_t>(tag), value.size()));
+  }
+  Slot &slot = _slots[static_cast<uint8_t>(tag)];
+  // overwrite in place if the old value was at least as long
+  if (!contains(tag) || !slot.internal || slot.length < value.size()) {
+    if (value.size() > STORAGE_SIZE - _storage_used) {
+      throw std::runtime_error(string_format(
+          "No space left for option %u", static_cast<uint8_t>(tag)));
+    }
+    slot.offset = static_cast<uint16_t>(_storage_used);
+    slot.internal = true;
+    _storage_used += value.size();
+  }
+  slot.length = static_cast<uint8_t>(value.size());
+  std::copy(value.begin(), value.end(), _storage.begin() + slot.offset);
+  mark_present(static_cast<uint8_t>(tag));
+}
+
+void DhcpOptions::set(const OptionTag tag,
+                      const std::initializer_list<uint8_t> value) {
+  set(tag, std::span<const uint8_t>(value.begin(), value.size()));
+}
+
+void DhcpOptions::erase(const OptionTag tag) {
+  const uint8_t index = static_cast<uint8_t>(tag);
+  _present[index / 64] &= ~(uint64_t{1} << (index % 64));
+}
+
+bool DhcpOptions::empty() const {
+  return std::all_of(_present.begin(), _present.end(),
+                     [](const uint64_t word) { return word == 0; });
+}
+} // namespace tinydhcpd
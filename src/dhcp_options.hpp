@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+
+namespace tinydhcpd {
+enum struct OptionTag : uint8_t {
+  PAD = 0,
+  SUBNET_MASK = 1,
+  TIME_OFFSET = 2,
+  ROUTERS = 3,
+  TIME_SERVER = 4,
+  NAME_SERVER = 5,
+  DNS_SERVER = 6,
+  LOG_SERVER = 7,
+  HOSTNAME = 12,
+  DOMAIN_NAME = 15,
+  IFACE_MTU = 26,
+  BROADCAST_ADDR = 28,
+  STATIC_ROUTES = 33,
+  REQUESTED_IP_ADDRESS = 50,
+  LEASE_TIME = 51,
+  DHCP_MESSAGE_TYPE = 53,
+  SERVER_IDENTIFIER = 54,
+  PARAMETER_REQUEST_LIST = 55,
+  MAX_MESSAGE_SIZE = 57,
+  DHCP_RENEW_TIME = 58,
+  DHCP_REBINDING_TIME = 59,
+  CLIENT_IDENTIFIER = 61,
+  RELAY_AGENT_INFORMATION = 82,
+  OPTIONS_END = 255
+};
+
+// Index of the options of a DHCP message, with one slot per possible tag.
+//
+// Parsed options are not copied: their slots point into the buffer that was
+// parsed, which therefore has to outlive the index. Options that are set
+// afterwards (i.e. on replies) are copied into a fixed internal storage, so
+// neither parsing nor building a message allocates.
+class DhcpOptions {
+public:
+  static constexpr size_t STORAGE_SIZE = 1024;
+
+private:
+  struct Slot {
+    uint16_t offset;
+    uint8_t length;
+    bool internal; // offset refers to _storage instead of _buffer
+  };
+
+  const uint8_t *_buffer;
+  // one bit per tag, only slots with their bit set are initialized
+  std::array<uint64_t, 4> _present;
+  std::array<Slot, 256> _slots;
+  size_t _storage_used;
+  std::array<uint8_t, STORAGE_SIZE> _storage;
+
+  void mark_present(const uint8_t tag);
+  const uint8_t *data(const Slot &slot) const;
+
+public:
+  DhcpOptions();
+
+  // Indexes the options in the given buffer. Throws std::invalid_argument if
+  // an option runs past the end of the buffer, or if an option the server
+  // reads has an illegal length. Other options with an illegal length are
+  // skipped.
+  static DhcpOptions parse(const uint8_t *buffer, const size_t length);
+
+  bool contains(const OptionTag tag) const;
+  // returns an empty span if the option is not present
+  std::span<const uint8_t> get(const OptionTag tag) const;
+  void set(const OptionTag tag, const std::span<const uint8_t> value);
+  void set(const OptionTag tag, const std::initializer_list<uint8_t> value);
+  void erase(const OptionTag tag);
+  bool empty() const;
+
+  // Calls callback(tag, value) for every option, in ascending tag order.
+  template <typename F> void for_each(F callback) const {
+    for (size_t word = 0; word < _present.size(); word++) {
+      uint64_t bits = _present[word];
+      while (bits != 0) {
+        const uint8_t tag = word * 64 + std::countr_zero(bits);
+        bits &= bits - 1;
+        const Slot &slot = _slots[tag];
+        callback(static_cast<OptionTag>(tag),
+                 std::span<const uint8_t>(data(slot), slot.length));
+      }
+    }
+  }
+};
+} // namespace tinydhcpd
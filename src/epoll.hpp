@@ -1,27 +1,57 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <csignal>
+#include <functional>
 #include <stdexcept>
 #include <sys/epoll.h>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace tinydhcpd {
 extern volatile std::sig_atomic_t last_signal; // defined in daemon.cpp
 
 template <class T> class Epoll {
-  static constexpr size_t MAX_EVENTS = 1;
+  static constexpr size_t MAX_EVENTS = 8;
 
   T &subject;
+  int tick_interval_ms;
   bool ready_to_send = false;
   int epoll_fd;
   struct epoll_event epoll_ctl_cfg;
   std::array<struct epoll_event, MAX_EVENTS> events;
+  // other file descriptors and what to do once they become readable
+  std::vector<std::pair<int, std::function<void()>>> auxiliary_fds;
+
+  void handle_subject_event(const uint32_t event_flags) {
+    if ((event_flags & EPOLLIN) > 0) {
+      bool finished = subject.handle_epollin();
+      while (!finished) {
+        finished = subject.handle_epollin();
+      }
+    }
+    if ((event_flags & EPOLLOUT) > 0) {
+      ready_to_send = true;
+    }
+  }
+
+  void handle_auxiliary_event(const int fd) {
+    auto auxiliary = std::find_if(
+        auxiliary_fds.begin(), auxiliary_fds.end(),
+        [fd](const auto &entry) { return entry.first == fd; });
+    if (auxiliary != auxiliary_fds.end()) {
+      auxiliary->second();
+    }
+  }
 
 public:
-  Epoll(T &subject, uint32_t events)
-      : subject(subject), epoll_ctl_cfg{.events = events | EPOLLET, .data = {}},
-        events() {
+  // subject.handle_tick() is called after every wakeup, and at least every
+  // tick_interval_ms if nothing happens (-1 to only wake up on events)
+  Epoll(T &subject, uint32_t events, int tick_interval_ms = -1)
+      : subject(subject), tick_interval_ms(tick_interval_ms),
+        epoll_ctl_cfg{.events = events | EPOLLET, .data = {}}, events() {
     epoll_fd = epoll_create1(0);
     if (epoll_fd == -1) {
       throw std::runtime_error("Failed to create epoll structure!");
@@ -50,9 +80,24 @@ public:
   friend void swap(Epoll<T> &first, Epoll<T> &second) noexcept {
     using std::swap;
     swap(first.subject, second.subject);
+    swap(first.tick_interval_ms, second.tick_interval_ms);
     swap(first.epoll_fd, second.epoll_fd);
     swap(first.epoll_ctl_cfg, second.epoll_ctl_cfg);
     swap(first.events, second.events);
+    swap(first.auxiliary_fds, second.auxiliary_fds);
+  }
+
+  // Watches another file descriptor (edge-triggered), on_readable has to
+  // consume everything that is available.
+  void watch(const int fd, std::function<void()> on_readable) {
+    struct epoll_event watch_cfg {
+      .events = EPOLLIN | EPOLLET, .data = {}
+    };
+    watch_cfg.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &watch_cfg) == -1) {
+      throw std::runtime_error("Failed at epoll_ctl!");
+    }
+    auxiliary_fds.emplace_back(fd, std::move(on_readable));
   }
 
   void poll_loop() {
@@ -72,21 +117,22 @@ public:
         }
       }
 
-      if (epoll_wait(epoll_fd, events.data(), MAX_EVENTS, -1) == -1) {
+      const int event_count =
+          epoll_wait(epoll_fd, events.data(), MAX_EVENTS, tick_interval_ms);
+      if (event_count == -1) {
         if (errno == EINTR) {
           continue;
         }
         throw std::runtime_error("epoll_wait failed");
       }
-      if ((events[0].events & EPOLLIN) > 0) {
-        bool finished = subject.handle_epollin();
-        while (!finished) {
-          finished = subject.handle_epollin();
+      for (int i = 0; i < event_count; i++) {
+        if (events[i].data.fd == epoll_ctl_cfg.data.fd) {
+          handle_subject_event(events[i].events);
+        } else {
+          handle_auxiliary_event(events[i].data.fd);
         }
       }
-      if ((events[0].events & EPOLLOUT) > 0) {
-        ready_to_send = true;
-      }
+      subject.handle_tick();
     }
   }
 };
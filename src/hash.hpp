@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace tinydhcpd {
+// finalizer of splitmix64, spreads the key bits over the whole word
+constexpr uint64_t mix(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+} // namespace tinydhcpd
@@ -0,0 +1,364 @@
+#include "interface_cache.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "log/logger.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+constexpr size_t NETLINK_BUFFER_SIZE = 32768;
+constexpr int DUMP_TIMEOUT_MS = 5000;
+constexpr int RESYNC_RETRY_INTERVAL_MS = 1000;
+
+InterfaceCache::InterfaceCache()
+    : _netlink_fd(-1), _sequence(0), _resync_needed(false),
+      _resync_failing(false), _dump_state(DumpState::IDLE), _dump_deadline(),
+      _next_resync_time(), _generation(0),
+      _receive_buffer(NETLINK_BUFFER_SIZE), _interfaces(),
+      _resync_interfaces() {
+  _netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       NETLINK_ROUTE);
+  if (_netlink_fd < 0) {
+    throw std::runtime_error(string_format(
+        "Failed to create netlink socket: %s", strerror(errno)));
+  }
+  struct sockaddr_nl local_address {};
+  local_address.nl_family = AF_NETLINK;
+  local_address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR;
+  if (bind(_netlink_fd, reinterpret_cast<struct sockaddr *>(&local_address),
+           sizeof(local_address)) < 0) {
+    close(_netlink_fd);
+    throw std::runtime_error(string_format(
+        "Failed to bind netlink socket: %s", strerror(errno)));
+  }
+  try {
+    start_resync();
+    while (_dump_state != DumpState::IDLE) {
+      if (receive()) {
+        continue;
+      }
+      struct pollfd poll_fd {
+        .fd = _netlink_fd, .events = POLLIN, .revents = 0
+      };
+      if (poll(&poll_fd, 1, DUMP_TIMEOUT_MS) <= 0) {
+        throw std::runtime_error(
+            "Timed out waiting for interface information");
+      }
+    }
+    if (_resync_failing) {
+      throw std::runtime_error("Failed to load the interfaces");
+    }
+  } catch (...) {
+    close(_netlink_fd);
+    throw;
+  }
+}
+
+InterfaceCache::~InterfaceCache() noexcept {
+  if (_netlink_fd >= 0) {
+    close(_netlink_fd);
+  }
+}
+
+InterfaceCache::operator int() const { return _netlink_fd; }
+
+const InterfaceInfo *InterfaceCache::find(const int ifindex) const {
+  if (ifindex < 0 || static_cast<size_t>(ifindex) >= _interfaces.size() ||
+      !_interfaces[ifindex].has_value()) {
+    return nullptr;
+  }
+  return &_interfaces[ifindex].value();
+}
+
+uint64_t InterfaceCache::generation() const { return _generation; }
+
+void InterfaceCache::handle_events() {
+  while (receive()) {
+  }
+  resync_if_due();
+}
+
+void InterfaceCache::handle_tick() {
+  if (_dump_state != DumpState::IDLE &&
+      std::chrono::steady_clock::now() >= _dump_deadline) {
+    abandon_resync("Timed out waiting for interface information");
+  }
+  resync_if_due();
+}
+
+void InterfaceCache::resync_if_due() {
+  if (_dump_state != DumpState::IDLE || !_resync_needed ||
+      std::chrono::steady_clock::now() < _next_resync_time) {
+    return;
+  }
+  LOG_DEBUG("Reloading all interfaces");
+  try {
+    start_resync();
+  } catch (std::runtime_error &ex) {
+    abandon_resync(ex.what());
+  }
+}
+
+void InterfaceCache::start_resync() {
+  _resync_needed = false;
+  _resync_interfaces.clear();
+  _dump_deadline = std::chrono::steady_clock::now() +
+                   std::chrono::milliseconds(DUMP_TIMEOUT_MS);
+  // only one dump can be in progress at a time, the addresses are requested
+  // once the links are complete
+  request_dump(RTM_GETLINK);
+  _dump_state = DumpState::LINKS;
+}
+
+void InterfaceCache::finish_dump() {
+  if (_dump_state == DumpState::LINKS) {
+    try {
+      request_dump(RTM_GETADDR);
+      _dump_state = DumpState::ADDRESSES;
+    } catch (std::runtime_error &ex) {
+      abandon_resync(ex.what());
+    }
+    return;
+  }
+  _interfaces.swap(_resync_interfaces);
+  _resync_interfaces.clear();
+  _generation++;
+  _dump_state = DumpState::IDLE;
+  if (_resync_failing) {
+    LOG_INFO("Reloaded all interfaces");
+    _resync_failing = false;
+  }
+}
+
+void InterfaceCache::abandon_resync(const char *reason) {
+  if (!_resync_failing) {
+    LOG_WARN("%s, using the previous interface information until reloading "
+             "succeeds",
+             reason);
+    _resync_failing = true;
+  }
+  _dump_state = DumpState::IDLE;
+  _resync_interfaces.clear();
+  _resync_needed = true;
+  _next_resync_time = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(RESYNC_RETRY_INTERVAL_MS);
+}
+
+void InterfaceCache::request_dump(const uint16_t type) {
+  struct {
+    struct nlmsghdr header;
+    union {
+      struct ifinfomsg link;
+      struct ifaddrmsg address;
+    } body;
+  } request{};
+  if (type == RTM_GETLINK) {
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    request.body.link.ifi_family = AF_UNSPEC;
+  } else {
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+    request.body.address.ifa_family = AF_INET;
+  }
+  request.header.nlmsg_type = type;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.header.nlmsg_seq = ++_sequence;
+
+  struct sockaddr_nl kernel_address {};
+  kernel_address.nl_family = AF_NETLINK;
+  if (sendto(_netlink_fd, &request, request.header.nlmsg_len, 0,
+             reinterpret_cast<struct sockaddr *>(&kernel_address),
+             sizeof(kernel_address)) < 0) {
+    throw std::runtime_error(string_format(
+        "Failed to request interface information: %s", strerror(errno)));
+  }
+}
+
+bool InterfaceCache::receive() {
+  ssize_t length = recv(_netlink_fd, _receive_buffer.data(),
+                        _receive_buffer.size(), MSG_DONTWAIT);
+  if (length < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return false;
+    }
+    if (errno == ENOBUFS) {
+      LOG_WARN("Lost interface notifications");
+      _resync_needed = true;
+      return true;
+    }
+    if (errno == EINTR) {
+      return true;
+    }
+    throw std::runtime_error(string_format(
+        "Failed to receive interface information: %s", strerror(errno)));
+  }
+  int remaining = static_cast<int>(length);
+  for (struct nlmsghdr *message =
+           reinterpret_cast<struct nlmsghdr *>(_receive_buffer.data());
+       NLMSG_OK(message, remaining);
+       message = NLMSG_NEXT(message, remaining)) {
+    handle_message(message);
+  }
+  return true;
+}
+
+void InterfaceCache::handle_message(struct nlmsghdr *message) {
+  // notifications have sequence number 0, and also apply to a reload in
+  // progress
+  const bool dumping = _dump_state != DumpState::IDLE;
+  const bool dump_reply = dumping && message->nlmsg_seq == _sequence;
+  switch (message->nlmsg_type) {
+  case NLMSG_DONE:
+    if (dump_reply) {
+      finish_dump();
+    }
+    break;
+  case NLMSG_ERROR: {
+    const struct nlmsgerr *error =
+        static_cast<const struct nlmsgerr *>(NLMSG_DATA(message));
+    if (error->error != 0 && dump_reply) {
+      abandon_resync(
+          string_format("Failed to dump interface information: %s",
+                        strerror(-error->error))
+              .c_str());
+    }
+    break;
+  }
+  case RTM_NEWLINK:
+  case RTM_DELLINK:
+    if (!dump_reply) {
+      handle_link(_interfaces, message);
+    }
+    if (dumping) {
+      handle_link(_resync_interfaces, message);
+    }
+    break;
+  case RTM_NEWADDR:
+  case RTM_DELADDR:
+    if (!dump_reply) {
+      handle_address(_interfaces, message);
+    }
+    if (dumping) {
+      handle_address(_resync_interfaces, message);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void InterfaceCache::handle_link(InterfaceTable &interfaces,
+                                 struct nlmsghdr *message) {
+  struct ifinfomsg *link = static_cast<struct ifinfomsg *>(NLMSG_DATA(message));
+  // a reload in progress only becomes visible once it is complete
+  const bool visible = &interfaces == &_interfaces;
+  if (message->nlmsg_type == RTM_DELLINK) {
+    if (link->ifi_index >= 0 &&
+        static_cast<size_t>(link->ifi_index) < interfaces.size() &&
+        interfaces[link->ifi_index].has_value()) {
+      if (visible) {
+        LOG_DEBUG("Interface %s removed",
+                  interfaces[link->ifi_index]->name.c_str());
+        _generation++;
+      }
+      interfaces[link->ifi_index].reset();
+    }
+    return;
+  }
+  InterfaceInfo &info = get_or_create(interfaces, link->ifi_index);
+  const std::string previous_name = info.name;
+  info.link_type = link->ifi_type;
+  int attributes_length = IFLA_PAYLOAD(message);
+  for (struct rtattr *attribute = IFLA_RTA(link);
+       RTA_OK(attribute, attributes_length);
+       attribute = RTA_NEXT(attribute, attributes_length)) {
+    if (attribute->rta_type == IFLA_IFNAME) {
+      info.name = static_cast<const char *>(RTA_DATA(attribute));
+    } else if (attribute->rta_type == IFLA_MTU) {
+      std::memcpy(&info.mtu, RTA_DATA(attribute), sizeof(info.mtu));
+    } else if (attribute->rta_type == IFLA_ADDRESS &&
+               RTA_PAYLOAD(attribute) == info.hwaddr.size()) {
+      std::memcpy(info.hwaddr.data(), RTA_DATA(attribute),
+                  info.hwaddr.size());
+    }
+  }
+  if (visible && info.name != previous_name) {
+    _generation++;
+  }
+}
+
+void InterfaceCache::handle_address(InterfaceTable &interfaces,
+                                    struct nlmsghdr *message) {
+  struct ifaddrmsg *address_message =
+      static_cast<struct ifaddrmsg *>(NLMSG_DATA(message));
+  // only the primary address is used as server identifier
+  if (address_message->ifa_family != AF_INET ||
+      (address_message->ifa_flags & IFA_F_SECONDARY) != 0) {
+    return;
+  }
+  in_addr_t local_address = INADDR_ANY;
+  in_addr_t broadcast_address = INADDR_ANY;
+  int attributes_length = IFA_PAYLOAD(message);
+  for (struct rtattr *attribute = IFA_RTA(address_message);
+       RTA_OK(attribute, attributes_length);
+       attribute = RTA_NEXT(attribute, attributes_length)) {
+    if (attribute->rta_type == IFA_LOCAL ||
+        (attribute->rta_type == IFA_ADDRESS && local_address == INADDR_ANY)) {
+      std::memcpy(&local_address, RTA_DATA(attribute), sizeof(in_addr_t));
+    } else if (attribute->rta_type == IFA_BROADCAST) {
+      std::memcpy(&broadcast_address, RTA_DATA(attribute), sizeof(in_addr_t));
+    }
+  }
+  local_address = ntohl(local_address);
+  broadcast_address = ntohl(broadcast_address);
+
+  InterfaceInfo &info = get_or_create(interfaces, address_message->ifa_index);
+  if (message->nlmsg_type == RTM_DELADDR) {
+    if (info.address == local_address) {
+      // the interface may have other primary addresses in other subnets, so
+      // reload it once the current messages have been processed
+      info.address = INADDR_ANY;
+      info.broadcast_address = INADDR_ANY;
+      _resync_needed = true;
+    }
+    return;
+  }
+  if (info.address != INADDR_ANY && info.address != local_address) {
+    // keep the first primary address
+    return;
+  }
+  if (broadcast_address == INADDR_ANY) {
+    const uint8_t prefix_length = address_message->ifa_prefixlen;
+    const in_addr_t netmask =
+        prefix_length == 0 ? 0 : ~in_addr_t{0} << (32 - prefix_length);
+    broadcast_address = local_address | ~netmask;
+  }
+  info.address = local_address;
+  info.broadcast_address = broadcast_address;
+  LOG_DEBUG("Interface %s has address %s", info.name.c_str(),
+            inet_ntoa({.s_addr = htonl(local_address)}));
+}
+
+InterfaceInfo &InterfaceCache::get_or_create(InterfaceTable &interfaces,
+                                             const int ifindex) {
+  if (static_cast<size_t>(ifindex) >= interfaces.size()) {
+    interfaces.resize(ifindex + 1);
+  }
+  if (!interfaces[ifindex].has_value()) {
+    interfaces[ifindex] = InterfaceInfo{.name = "",
+                                        .address = INADDR_ANY,
+                                        .broadcast_address = INADDR_ANY,
+                                        .mtu = 0,
+                                        .link_type = 0,
+                                        .hwaddr = {}};
+  }
+  return interfaces[ifindex].value();
+}
+} // namespace tinydhcpd
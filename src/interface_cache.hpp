@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct nlmsghdr;
+
+namespace tinydhcpd {
+struct InterfaceInfo {
+  std::string name;
+  // primary IPv4 address and its broadcast address (host byte order),
+  // INADDR_ANY if the interface has none
+  in_addr_t address;
+  in_addr_t broadcast_address;
+  uint32_t mtu;
+  // ARPHRD_* link type and, for Ethernet links, the hardware address
+  uint16_t link_type;
+  std::array<uint8_t, ETH_ALEN> hwaddr;
+};
+
+// Name, addresses, MTU and link layer of all interfaces, indexed by
+// interface index. The cache is filled from an RTNETLINK dump and then kept
+// current from the link and IPv4 address notifications, which have to be
+// consumed with handle_events() whenever the socket becomes readable.
+//
+// When notifications were lost, the cache is reloaded with another dump,
+// which is received by handle_events() like the notifications. Until it is
+// complete, lookups are answered from the previous contents. A reload that
+// fails or takes too long is retried from handle_tick().
+class InterfaceCache {
+private:
+  using InterfaceTable = std::vector<std::optional<InterfaceInfo>>;
+  enum struct DumpState { IDLE, LINKS, ADDRESSES };
+
+  int _netlink_fd;
+  uint32_t _sequence;
+  // notifications were dropped because the socket buffer overflowed, or
+  // the last reload failed
+  bool _resync_needed;
+  // set from a failed reload until one succeeds
+  bool _resync_failing;
+  DumpState _dump_state;
+  // a reload that has not finished by then is given up
+  std::chrono::steady_clock::time_point _dump_deadline;
+  std::chrono::steady_clock::time_point _next_resync_time;
+  uint64_t _generation;
+  std::vector<uint8_t> _receive_buffer;
+  InterfaceTable _interfaces;
+  // filled by the reload in progress, replaces _interfaces once complete
+  InterfaceTable _resync_interfaces;
+
+  void resync_if_due();
+  void start_resync();
+  void request_dump(const uint16_t type);
+  void finish_dump();
+  void abandon_resync(const char *reason);
+  // processes one read worth of messages, returns false once the socket has
+  // been drained
+  bool receive();
+  void handle_message(struct nlmsghdr *message);
+  void handle_link(InterfaceTable &interfaces, struct nlmsghdr *message);
+  void handle_address(InterfaceTable &interfaces, struct nlmsghdr *message);
+  static InterfaceInfo &get_or_create(InterfaceTable &interfaces,
+                                      const int ifindex);
+
+public:
+  // Loads all interfaces, waiting for at most a few seconds.
+  InterfaceCache();
+  ~InterfaceCache() noexcept;
+  InterfaceCache(const InterfaceCache &other) = delete;
+
+  operator int() const;
+
+  // returns nullptr for unknown interfaces
+  const InterfaceInfo *find(const int ifindex) const;
+  // changes whenever an interface appears, disappears or is renamed
+  uint64_t generation() const;
+  void handle_events();
+  // Starts a reload that is due and gives up on one that takes too long.
+  void handle_tick();
+};
+} // namespace tinydhcpd
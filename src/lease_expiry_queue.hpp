@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "lease_table.hpp"
+
+namespace tinydhcpd {
+// Min-heap of lease timeouts. Entries are never removed when a lease is
+// renewed or released; instead, the owner compares the popped timeout with
+// the lease's current one and ignores stale entries.
+class LeaseExpiryQueue {
+private:
+  struct Entry {
+    uint64_t timeout_timestamp;
+    HardwareAddress hwaddr;
+
+    bool operator>(const Entry &other) const {
+      return timeout_timestamp > other.timeout_timestamp;
+    }
+  };
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> _queue;
+
+public:
+  void schedule(const HardwareAddress &hwaddr,
+                const uint64_t timeout_timestamp) {
+    _queue.push(Entry{.timeout_timestamp = timeout_timestamp,
+                      .hwaddr = hwaddr});
+  }
+
+  // Pops every entry with a timeout at or before current_time and hands it to
+  // callback(hwaddr, timeout_timestamp).
+  template <typename F> void pop_due(const uint64_t current_time, F callback) {
+    while (!_queue.empty() &&
+           _queue.top().timeout_timestamp <= current_time) {
+      const Entry entry = _queue.top();
+      _queue.pop();
+      callback(entry.hwaddr, entry.timeout_timestamp);
+    }
+  }
+
+  // Replaces all entries with the timeouts of the given leases in O(n), which
+  // is cheaper than scheduling them one by one after a bulk load.
+  void rebuild(const LeaseTable &leases) {
+    std::vector<Entry> entries;
+    entries.reserve(leases.size());
+    leases.for_each([&entries](const Lease &lease) {
+      if (lease.timeout_timestamp != UINT64_MAX) {
+        entries.push_back(Entry{.timeout_timestamp = lease.timeout_timestamp,
+                                .hwaddr = lease.hwaddr});
+      }
+    });
+    _queue = decltype(_queue)(std::greater<Entry>(), std::move(entries));
+  }
+
+  size_t size() const { return _queue.size(); }
+};
+} // namespace tinydhcpd
@@ -0,0 +1,341 @@
+#include "lease_file.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <net/ethernet.h>
+#include <stdexcept>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log/logger.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+constexpr char LEASE_FILE_DELIMITER = ',';
+constexpr char HWADDR_DELIMITER = ':';
+
+constexpr uint32_t SNAPSHOT_MAGIC = 0x534c4454; // "TDLS"
+constexpr uint16_t SNAPSHOT_VERSION = 1;
+constexpr size_t SNAPSHOT_WRITE_CHUNK = 2048;
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint64_t record_count;
+  uint64_t records_checksum;
+  uint64_t header_checksum;
+};
+static_assert(sizeof(SnapshotHeader) == 32);
+
+struct SnapshotRecord {
+  uint8_t hwaddr_length;
+  uint8_t reserved[3];
+  in_addr_t address;
+  uint64_t timeout_timestamp;
+  std::array<uint8_t, MAX_HWADDR_LENGTH> hwaddr;
+};
+static_assert(sizeof(SnapshotRecord) == 32);
+
+// Word-wise multiplicative hash, fast enough to check millions of records.
+// The data may be fed in pieces as long as all but the last one are a
+// multiple of 8 bytes long.
+static uint64_t checksum_begin(const size_t total_length) {
+  return 0xcbf29ce484222325ULL ^ total_length;
+}
+
+static uint64_t checksum_update(uint64_t hash, const uint8_t *data,
+                                const size_t length) {
+  for (size_t offset = 0; offset < length; offset += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    std::memcpy(&word, data + offset,
+                std::min(sizeof(uint64_t), length - offset));
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+static uint64_t checksum(const uint8_t *data, const size_t length) {
+  return checksum_update(checksum_begin(length), data, length);
+}
+
+static uint64_t header_checksum(SnapshotHeader header) {
+  header.header_checksum = 0;
+  return checksum(reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+}
+
+static void read_binary_lease_file(
+    const std::string &path, const uint8_t *data, const size_t size,
+    const std::function<void(const Lease &)> &callback) {
+  SnapshotHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.header_checksum != header_checksum(header) ||
+      header.version != SNAPSHOT_VERSION ||
+      header.record_size != sizeof(SnapshotRecord) ||
+      size !=
+          sizeof(header) + header.record_count * sizeof(SnapshotRecord)) {
+    LOG_ERROR("Lease file %s has an invalid header, ignoring it", path.c_str());
+    return;
+  }
+  const uint8_t *records_data = data + sizeof(header);
+  if (header.records_checksum !=
+      checksum(records_data, size - sizeof(header))) {
+    LOG_ERROR("Lease file %s is corrupt, ignoring it", path.c_str());
+    return;
+  }
+
+  const SnapshotRecord *records =
+      reinterpret_cast<const SnapshotRecord *>(records_data);
+  for (size_t i = 0; i < header.record_count; i++) {
+    const SnapshotRecord &record = records[i];
+    callback(Lease{.hwaddr = record.hwaddr_length == 0
+                                 ? HardwareAddress::for_declined(record.address)
+                                 : HardwareAddress(record.hwaddr.data(),
+                                                   record.hwaddr_length),
+                   .address = record.address,
+                   .timeout_timestamp = record.timeout_timestamp});
+  }
+}
+
+static bool parse_text_lease(const std::string_view line, Lease &lease) {
+  const size_t first_delim_pos = line.find(LEASE_FILE_DELIMITER);
+  const size_t last_delim_pos = line.rfind(LEASE_FILE_DELIMITER);
+  if (first_delim_pos == std::string_view::npos ||
+      first_delim_pos == last_delim_pos) {
+    return false;
+  }
+
+  std::string_view hwaddr_string = line.substr(0, first_delim_pos);
+  const std::string_view ipaddr_string = line.substr(
+      first_delim_pos + 1, last_delim_pos - first_delim_pos - 1);
+  const std::string_view timeout_string = line.substr(last_delim_pos + 1);
+
+  std::array<uint8_t, MAX_HWADDR_LENGTH> hwaddr_octets{};
+  size_t hwaddr_length = 0;
+  while (!hwaddr_string.empty() && hwaddr_length < MAX_HWADDR_LENGTH) {
+    const auto [end, error] = std::from_chars(
+        hwaddr_string.begin(), hwaddr_string.end(),
+        hwaddr_octets[hwaddr_length], 16);
+    if (error != std::errc()) {
+      return false;
+    }
+    hwaddr_length++;
+    hwaddr_string.remove_prefix(end - hwaddr_string.begin());
+    if (!hwaddr_string.empty() &&
+        hwaddr_string.front() == HWADDR_DELIMITER) {
+      hwaddr_string.remove_prefix(1);
+    }
+  }
+  if (hwaddr_length == MAX_HWADDR_LENGTH &&
+      std::all_of(hwaddr_octets.cbegin() + ETH_ALEN, hwaddr_octets.cend(),
+                  [](uint8_t octet) { return octet == 0; })) {
+    // older lease files always contain all 16 octets
+    hwaddr_length = ETH_ALEN;
+  }
+
+  char address_buffer[INET_ADDRSTRLEN] = {};
+  struct in_addr ip_addr {};
+  if (ipaddr_string.size() >= sizeof(address_buffer)) {
+    return false;
+  }
+  std::copy(ipaddr_string.begin(), ipaddr_string.end(), address_buffer);
+  if (inet_pton(AF_INET, address_buffer, &ip_addr) != 1) {
+    return false;
+  }
+  lease.address = ntohl(ip_addr.s_addr);
+
+  if (std::from_chars(timeout_string.begin(), timeout_string.end(),
+                      lease.timeout_timestamp)
+          .ec != std::errc()) {
+    return false;
+  }
+  lease.hwaddr = hwaddr_length == 0
+                     ? HardwareAddress::for_declined(lease.address)
+                     : HardwareAddress(hwaddr_octets,
+                                       static_cast<uint8_t>(hwaddr_length));
+  return true;
+}
+
+static void
+read_text_lease_file(const std::string &path,
+                     const std::function<void(const Lease &)> &callback) {
+  std::ifstream lease_file(path);
+  std::string current_line;
+  Lease lease;
+  while (std::getline(lease_file, current_line)) {
+    if (current_line.empty()) {
+      continue;
+    }
+    if (!parse_text_lease(current_line, lease)) {
+      LOG_WARN("Invalid entry in lease file: %s", current_line.c_str());
+      continue;
+    }
+    callback(lease);
+  }
+}
+
+bool read_lease_file(const std::string &path,
+                     const std::function<void(const Lease &)> &callback) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat {};
+  fstat(fd, &file_stat);
+  const size_t size = static_cast<size_t>(file_stat.st_size);
+
+  if (size == 0) {
+    close(fd);
+    return true;
+  }
+  uint32_t magic = 0;
+  if (size < sizeof(SnapshotHeader) ||
+      pread(fd, &magic, sizeof(magic), 0) != sizeof(magic) ||
+      magic != SNAPSHOT_MAGIC) {
+    close(fd);
+    LOG_INFO("Importing text lease file %s", path.c_str());
+    read_text_lease_file(path, callback);
+    return true;
+  }
+
+  void *data =
+      mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(string_format("Failed to map lease file %s: %s",
+                                           path.c_str(), strerror(errno)));
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+  read_binary_lease_file(path, static_cast<const uint8_t *>(data), size,
+                         callback);
+  munmap(data, size);
+  return true;
+}
+
+static void write_fully(const int fd, const void *data, size_t length) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  while (length > 0) {
+    const ssize_t written = write(fd, bytes, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(
+          string_format("Failed to write lease file: %s", strerror(errno)));
+    }
+    bytes += written;
+    length -= static_cast<size_t>(written);
+  }
+}
+
+static void write_binary_lease_file(const int fd,
+                                    const std::vector<Lease> &leases) {
+  SnapshotHeader header{.magic = SNAPSHOT_MAGIC,
+                        .version = SNAPSHOT_VERSION,
+                        .record_size = sizeof(SnapshotRecord),
+                        .record_count = leases.size(),
+                        .records_checksum = 0,
+                        .header_checksum = 0};
+  // the checksum is only known at the end, so the header is written last
+  if (lseek(fd, sizeof(header), SEEK_SET) < 0) {
+    throw std::runtime_error(
+        string_format("Failed to seek in lease file: %s", strerror(errno)));
+  }
+
+  std::vector<SnapshotRecord> chunk;
+  chunk.reserve(SNAPSHOT_WRITE_CHUNK);
+  uint64_t records_checksum =
+      checksum_begin(leases.size() * sizeof(SnapshotRecord));
+  for (size_t offset = 0; offset < leases.size();
+       offset += SNAPSHOT_WRITE_CHUNK) {
+    chunk.clear();
+    const size_t end = std::min(leases.size(), offset + SNAPSHOT_WRITE_CHUNK);
+    for (size_t i = offset; i < end; i++) {
+      chunk.push_back(
+          SnapshotRecord{.hwaddr_length = leases[i].hwaddr.length,
+                         .reserved = {},
+                         .address = leases[i].address,
+                         .timeout_timestamp = leases[i].timeout_timestamp,
+                         .hwaddr = leases[i].hwaddr.octets});
+    }
+    const size_t chunk_size = chunk.size() * sizeof(SnapshotRecord);
+    records_checksum = checksum_update(
+        records_checksum, reinterpret_cast<const uint8_t *>(chunk.data()),
+        chunk_size);
+    write_fully(fd, chunk.data(), chunk_size);
+  }
+
+  header.records_checksum = records_checksum;
+  header.header_checksum = header_checksum(header);
+  if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    throw std::runtime_error(string_format(
+        "Failed to write lease file header: %s", strerror(errno)));
+  }
+}
+
+static void write_text_lease_file(const int fd,
+                                  const std::vector<Lease> &leases) {
+  std::string buffer;
+  char line[128];
+  char address_buffer[INET_ADDRSTRLEN];
+  struct in_addr ip_addr;
+  for (const Lease &lease : leases) {
+    // declined addresses are written without a hardware address
+    for (size_t i = 0; i < lease.hwaddr.length; i++) {
+      const int length =
+          std::snprintf(line, sizeof(line), i > 0 ? ":%02x" : "%02x",
+                        lease.hwaddr.octets[i]);
+      buffer.append(line, length);
+    }
+    ip_addr.s_addr = htonl(lease.address);
+    inet_ntop(AF_INET, &ip_addr, address_buffer, sizeof(address_buffer));
+    const int length =
+        std::snprintf(line, sizeof(line), ",%s,%lu\n", address_buffer,
+                      static_cast<unsigned long>(lease.timeout_timestamp));
+    buffer.append(line, length);
+  }
+  write_fully(fd, buffer.data(), buffer.size());
+}
+
+// Does not log, since it also runs on the lease journal's compaction thread.
+void write_lease_file(const std::string &path,
+                      const std::vector<Lease> &leases,
+                      const LeaseFileFormat format) {
+  const std::string temporary_path = path + ".tmp";
+  const int fd = open(temporary_path.c_str(),
+                      O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+  if (fd < 0) {
+    throw std::runtime_error(string_format("Failed to open %s: %s",
+                                           temporary_path.c_str(),
+                                           strerror(errno)));
+  }
+  try {
+    if (format == LeaseFileFormat::BINARY) {
+      write_binary_lease_file(fd, leases);
+    } else {
+      write_text_lease_file(fd, leases);
+    }
+    if (fsync(fd) != 0) {
+      throw std::runtime_error(
+          string_format("Failed to sync lease file: %s", strerror(errno)));
+    }
+  } catch (std::runtime_error &) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+  if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+    throw std::runtime_error(string_format(
+        "Failed to replace lease file %s: %s", path.c_str(), strerror(errno)));
+  }
+}
+} // namespace tinydhcpd
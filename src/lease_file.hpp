@@ -0,0 +1,27 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "lease_table.hpp"
+
+namespace tinydhcpd {
+enum struct LeaseFileFormat {
+  // versioned fixed-size records in native byte order, loaded via mmap
+  BINARY,
+  // one `hwaddr,address,timeout` line per lease
+  TEXT
+};
+
+// Reads the lease file and hands every valid entry to the callback. The
+// format is detected from the file contents, so text files written by older
+// versions are imported transparently. Returns false if the file does not
+// exist.
+bool read_lease_file(const std::string &path,
+                     const std::function<void(const Lease &)> &callback);
+// Atomically replaces the lease file with the given leases.
+void write_lease_file(const std::string &path,
+                      const std::vector<Lease> &leases,
+                      const LeaseFileFormat format);
+} // namespace tinydhcpd
@@ -0,0 +1,345 @@
+#include "lease_journal.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "lease_file.hpp"
+#include "log/logger.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+const std::string JOURNAL_SUFFIX = ".journal";
+const std::string COMPACTING_JOURNAL_SUFFIX = ".journal.old";
+const std::string MERGING_JOURNAL_SUFFIX = ".journal.merge";
+const int JOURNAL_OPEN_FLAGS = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+
+LeaseJournal::LeaseJournal(const std::string &lease_file_path,
+                           const LeaseJournalConfiguration &config,
+                           WorkerMetrics &metrics)
+    : _path(lease_file_path + JOURNAL_SUFFIX),
+      _compacting_path(lease_file_path + COMPACTING_JOURNAL_SUFFIX),
+      _merging_path(lease_file_path + MERGING_JOURNAL_SUFFIX), _config(config),
+      _metrics(metrics), _fd(-1), _pending(), _first_pending_time(),
+      _write_failing(false), _rotate_failing(false), _record_count(0),
+      _valid_length(0), _compacting_valid_length(0), _merging_valid_length(0),
+      _compaction_thread(), _compaction_running(false),
+      _compaction_failed(false), _compaction_error() {
+  _pending.reserve(std::max<uint32_t>(config.batch_size, 1));
+}
+
+LeaseJournal::~LeaseJournal() noexcept {
+  flush();
+  join_compaction();
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+uint16_t LeaseJournal::checksum(const Record &record) {
+  Record copy = record;
+  copy.checksum = 0;
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&copy);
+  // Fletcher-16, enough to detect a torn or garbage record
+  uint16_t sum1 = 0, sum2 = 0;
+  for (size_t i = 0; i < sizeof(Record); i++) {
+    sum1 = (sum1 + bytes[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return static_cast<uint16_t>((sum2 << 8) | sum1);
+}
+
+size_t LeaseJournal::replay_file(
+    const std::string &path,
+    const std::function<void(LeaseEvent, const Lease &)> &callback) {
+  std::ifstream journal_file(path, std::ios::binary);
+  if (!journal_file.is_open()) {
+    return 0;
+  }
+  Record record;
+  size_t record_count = 0;
+  while (
+      journal_file.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    if (record.checksum != checksum(record)) {
+      // everything after a torn write is unreliable
+      LOG_WARN("Corrupt record %lu in lease journal %s, "
+               "ignoring the rest of it",
+               record_count, path.c_str());
+      return record_count * sizeof(Record);
+    }
+    // declined addresses are keyed by the address, not by a client
+    callback(record.event,
+             Lease{.hwaddr = record.hwaddr_length == 0
+                                 ? HardwareAddress::for_declined(record.address)
+                                 : HardwareAddress(record.hwaddr.data(),
+                                                   record.hwaddr_length),
+                   .address = record.address,
+                   .timeout_timestamp = record.timeout_timestamp});
+    record_count++;
+  }
+  LOG_DEBUG("Replayed %lu records from lease journal %s", record_count,
+            path.c_str());
+  // a partial record at the end is left out as well
+  return record_count * sizeof(Record);
+}
+
+void LeaseJournal::discard_invalid_tail(const std::string &path,
+                                        const size_t valid_length) {
+  if (!std::filesystem::exists(path)) {
+    return;
+  }
+  const size_t file_size = std::filesystem::file_size(path);
+  if (file_size <= valid_length) {
+    return;
+  }
+  // otherwise new records would be appended after the garbage, where the
+  // next replay never reaches them
+  LOG_WARN("Discarding %lu invalid bytes at the end of lease journal %s",
+           file_size - valid_length, path.c_str());
+  std::filesystem::resize_file(path, valid_length);
+}
+
+void LeaseJournal::replay(
+    const std::function<void(LeaseEvent, const Lease &)> &callback) {
+  _compacting_valid_length = replay_file(_compacting_path, callback);
+  _merging_valid_length = replay_file(_merging_path, callback);
+  _valid_length = replay_file(_path, callback);
+}
+
+void LeaseJournal::append_file(const std::string &from_path,
+                               const std::string &to_path) {
+  std::ifstream from_file(from_path, std::ios::binary);
+  std::ofstream to_file(to_path, std::ios::binary | std::ios::app);
+  if (from_file.peek() != std::ifstream::traits_type::eof()) {
+    to_file << from_file.rdbuf();
+  }
+  to_file.flush();
+  if (!to_file) {
+    throw std::runtime_error(string_format("Failed to append %s to %s",
+                                           from_path.c_str(), to_path.c_str()));
+  }
+}
+
+void LeaseJournal::open() {
+  discard_invalid_tail(_compacting_path, _compacting_valid_length);
+  discard_invalid_tail(_merging_path, _merging_valid_length);
+  discard_invalid_tail(_path, _valid_length);
+  merge_journals();
+  if (std::filesystem::exists(_compacting_path)) {
+    // a previous compaction did not finish, so the lease file does not
+    // contain the events of its journal yet
+    append_file(_path, _compacting_path);
+    std::filesystem::rename(_compacting_path, _path);
+  }
+  open_file();
+}
+
+void LeaseJournal::open_file() {
+  _fd = ::open(_path.c_str(), JOURNAL_OPEN_FLAGS, 0640);
+  if (_fd < 0) {
+    throw std::runtime_error(
+        string_format("Failed to open lease journal %s: %s", _path.c_str(),
+                      strerror(errno)));
+  }
+  _record_count = std::filesystem::file_size(_path) / sizeof(Record);
+}
+
+void LeaseJournal::rotate_file() {
+  // the last compaction failed, so its journal is still needed and the
+  // current one is appended to it on the compaction thread
+  const std::string &rotated_path = std::filesystem::exists(_compacting_path)
+                                        ? _merging_path
+                                        : _compacting_path;
+  std::filesystem::rename(_path, rotated_path);
+  const int fd = ::open(_path.c_str(), JOURNAL_OPEN_FLAGS, 0640);
+  if (fd < 0) {
+    const int open_errno = errno;
+    // keep appending to the current journal under its old name
+    std::filesystem::rename(rotated_path, _path);
+    throw std::runtime_error(
+        string_format("Failed to open lease journal %s: %s", _path.c_str(),
+                      strerror(open_errno)));
+  }
+  close(_fd);
+  _fd = fd;
+  _record_count = 0;
+}
+
+void LeaseJournal::merge_journals() {
+  if (!std::filesystem::exists(_merging_path)) {
+    return;
+  }
+  append_file(_merging_path, _compacting_path);
+  std::filesystem::remove(_merging_path);
+}
+
+void LeaseJournal::append(const LeaseEvent event, const Lease &lease) {
+  if (_fd < 0) {
+    return;
+  }
+  if (_pending.empty()) {
+    _first_pending_time = std::chrono::steady_clock::now();
+  }
+  Record &record = _pending.emplace_back(
+      Record{.event = event,
+             .hwaddr_length = lease.hwaddr.length,
+             .checksum = 0,
+             .address = lease.address,
+             .timeout_timestamp = lease.timeout_timestamp,
+             .hwaddr = lease.hwaddr.octets});
+  record.checksum = checksum(record);
+  if (_pending.size() >= _config.batch_size) {
+    flush();
+  }
+}
+
+void LeaseJournal::flush_if_due() {
+  if (_pending.empty()) {
+    return;
+  }
+  const auto pending_for =
+      std::chrono::steady_clock::now() - _first_pending_time;
+  if (pending_for >= std::chrono::milliseconds(_config.flush_interval_ms)) {
+    flush();
+  }
+}
+
+void LeaseJournal::flush() {
+  if (_pending.empty() || _fd < 0) {
+    return;
+  }
+  const off_t previous_size = lseek(_fd, 0, SEEK_END);
+  try {
+    write_pending();
+  } catch (std::runtime_error &ex) {
+    _metrics.count(Counter::JOURNAL_WRITE_ERROR);
+    if (!_write_failing) {
+      LOG_ERROR("%s, lease changes are not journaled until writes succeed "
+                "again",
+                ex.what());
+      _write_failing = true;
+    }
+    // a partial record would hide everything appended after it from replay
+    if (previous_size >= 0 && ftruncate(_fd, previous_size) != 0) {
+      LOG_ERROR("Failed to truncate lease journal: %s", strerror(errno));
+    }
+    _pending.clear();
+    return;
+  }
+  if (_write_failing) {
+    LOG_INFO("Writing the lease journal succeeded again");
+    _write_failing = false;
+  }
+  if (_config.sync_policy == JournalSyncPolicy::BATCH &&
+      fdatasync(_fd) != 0) {
+    LOG_ERROR("Failed to sync lease journal: %s", strerror(errno));
+  }
+  _record_count += _pending.size();
+  _pending.clear();
+}
+
+void LeaseJournal::write_pending() {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(_pending.data());
+  size_t remaining = _pending.size() * sizeof(Record);
+  while (remaining > 0) {
+    ssize_t written = write(_fd, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(string_format(
+          "Failed to write lease journal: %s", strerror(errno)));
+    }
+    data += written;
+    remaining -= static_cast<size_t>(written);
+  }
+}
+
+void LeaseJournal::join_compaction() {
+  if (!_compaction_thread.joinable()) {
+    return;
+  }
+  _compaction_thread.join();
+  if (_compaction_failed) {
+    _metrics.count(Counter::JOURNAL_COMPACTION_ERROR);
+    LOG_ERROR("Lease file compaction failed: %s", _compaction_error.c_str());
+    _compaction_failed = false;
+  } else {
+    LOG_DEBUG("Lease file compaction finished");
+  }
+}
+
+bool LeaseJournal::compaction_due() {
+  if (_compaction_running) {
+    return false;
+  }
+  join_compaction();
+  return _fd >= 0 && _record_count >= _config.compaction_threshold;
+}
+
+void LeaseJournal::start_compaction(std::vector<Lease> &&snapshot,
+                                    const std::string &lease_file_path,
+                                    const LeaseFileFormat format) {
+  flush();
+  join_compaction();
+  // set if the thread of the last compaction failed to merge the journals
+  bool merge_pending;
+  try {
+    merge_pending = std::filesystem::exists(_merging_path);
+    if (!merge_pending) {
+      rotate_file();
+    }
+  } catch (std::runtime_error &ex) {
+    // retried on every tick until it works
+    _metrics.count(Counter::JOURNAL_COMPACTION_ERROR);
+    if (!_rotate_failing) {
+      LOG_ERROR("Failed to move the lease journal aside for compaction: %s",
+                ex.what());
+      _rotate_failing = true;
+    }
+    return;
+  }
+  _rotate_failing = false;
+
+  if (merge_pending) {
+    LOG_DEBUG("Merging the lease journals of a failed compaction");
+  } else {
+    LOG_DEBUG("Compacting %lu leases into %s", snapshot.size(),
+              lease_file_path.c_str());
+  }
+  _compaction_running = true;
+  _compaction_thread = std::thread(
+      [this, lease_file_path, format,
+       merge_pending](std::vector<Lease> leases) {
+        try {
+          merge_journals();
+          // the current journal was not moved aside, and the snapshot
+          // contains its events, so the next compaction writes the file
+          if (!merge_pending) {
+            write_lease_file(lease_file_path, leases, format);
+            std::filesystem::remove(_compacting_path);
+          }
+        } catch (std::exception &ex) {
+          _compaction_error = ex.what();
+          _compaction_failed = true;
+        }
+        _compaction_running = false;
+      },
+      std::move(snapshot));
+}
+
+void LeaseJournal::reset() {
+  join_compaction();
+  _pending.clear();
+  std::filesystem::remove(_compacting_path);
+  std::filesystem::remove(_merging_path);
+  if (_fd >= 0 && ftruncate(_fd, 0) != 0) {
+    LOG_ERROR("Failed to truncate lease journal: %s", strerror(errno));
+  }
+  _record_count = 0;
+}
+} // namespace tinydhcpd
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lease_file.hpp"
+#include "lease_table.hpp"
+#include "metrics.hpp"
+
+namespace tinydhcpd {
+enum struct LeaseEvent : uint8_t {
+  OFFER = 1,
+  ACK = 2,
+  RELEASE = 3,
+  DECLINE = 4,
+  EXPIRE = 5
+};
+
+enum struct JournalSyncPolicy {
+  NONE, // leave write-back to the kernel
+  BATCH // fdatasync after every batch
+};
+
+struct LeaseJournalConfiguration {
+  uint32_t flush_interval_ms;
+  uint32_t batch_size;
+  JournalSyncPolicy sync_policy;
+  uint32_t compaction_threshold;
+};
+
+// Append-only log of lease events, stored next to the lease file as
+// `<lease file>.journal`. Events are buffered and written in batches, either
+// when the batch is full or when the oldest buffered event is older than the
+// flush interval.
+//
+// Compaction moves the current journal aside, starts a new one and rewrites
+// the lease file from a copy of the lease table on a background thread. The
+// moved journal is only deleted once the new lease file is in place, so a
+// crash at any point can be recovered by replaying both journals on top of
+// the lease file. If the moved journal of a failed compaction is still there,
+// the current one is moved to `<lease file>.journal.merge` instead and the
+// background thread appends it to the older one, so the worker only ever
+// renames files.
+class LeaseJournal {
+private:
+  struct Record {
+    LeaseEvent event;
+    uint8_t hwaddr_length;
+    uint16_t checksum;
+    in_addr_t address;
+    uint64_t timeout_timestamp;
+    std::array<uint8_t, MAX_HWADDR_LENGTH> hwaddr;
+  };
+  static_assert(sizeof(Record) == 32, "journal records must not be padded");
+
+  const std::string _path;
+  const std::string _compacting_path;
+  const std::string _merging_path;
+  const LeaseJournalConfiguration _config;
+  WorkerMetrics &_metrics;
+  int _fd;
+  std::vector<Record> _pending;
+  std::chrono::steady_clock::time_point _first_pending_time;
+  // set from a failed write until the next one succeeds
+  bool _write_failing;
+  // set from a failed attempt to move the journal aside until one succeeds
+  bool _rotate_failing;
+  size_t _record_count;
+  // bytes of complete, intact records found by replay()
+  size_t _valid_length;
+  size_t _compacting_valid_length;
+  size_t _merging_valid_length;
+  std::thread _compaction_thread;
+  std::atomic<bool> _compaction_running;
+  std::atomic<bool> _compaction_failed;
+  std::string _compaction_error;
+
+  static uint16_t checksum(const Record &record);
+  // returns the length of the intact records at the start of the file
+  static size_t replay_file(
+      const std::string &path,
+      const std::function<void(LeaseEvent, const Lease &)> &callback);
+  static void discard_invalid_tail(const std::string &path,
+                                   const size_t valid_length);
+  static void append_file(const std::string &from_path,
+                          const std::string &to_path);
+  void open_file();
+  // moves the current journal aside and starts a new one
+  void rotate_file();
+  void merge_journals();
+  void write_pending();
+  void join_compaction();
+
+public:
+  LeaseJournal(const std::string &lease_file_path,
+               const LeaseJournalConfiguration &config,
+               WorkerMetrics &metrics);
+  ~LeaseJournal() noexcept;
+  LeaseJournal(const LeaseJournal &other) = delete;
+
+  // Replays leftovers of interrupted compactions and the current journal, in
+  // the order in which they were written.
+  void replay(const std::function<void(LeaseEvent, const Lease &)> &callback);
+  // Opens the journal for appending, merging the leftovers of an interrupted
+  // compaction into it. Torn or corrupt records found by replay() are cut
+  // off first. Must only be called after replay().
+  void open();
+  // A batch that cannot be written, e.g. because the disk is full, is
+  // dropped and counted instead of interrupting the caller. The lease file
+  // written by the next compaction or at shutdown still contains it.
+  void append(const LeaseEvent event, const Lease &lease);
+  void flush_if_due();
+  void flush();
+
+  bool compaction_due();
+  // Errors while moving the journal aside are logged and counted, the events
+  // are then appended to the current journal until the next attempt.
+  void start_compaction(std::vector<Lease> &&snapshot,
+                        const std::string &lease_file_path,
+                        const LeaseFileFormat format);
+  // Discards all journal contents once the lease file has been rewritten
+  // synchronously, e.g. at shutdown.
+  void reset();
+};
+} // namespace tinydhcpd
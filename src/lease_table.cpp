@@ -0,0 +1,224 @@
+#include "lease_table.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "hash.hpp"
+
+namespace tinydhcpd {
+constexpr size_t INITIAL_INDEX_CAPACITY = 64;
+constexpr size_t NOT_FOUND = SIZE_MAX;
+
+HardwareAddress::HardwareAddress() : length(0), octets() {}
+
+HardwareAddress::HardwareAddress(
+    const std::array<uint8_t, MAX_HWADDR_LENGTH> &hwaddr,
+    const uint8_t hwaddr_len)
+    : HardwareAddress(hwaddr.data(), hwaddr_len) {}
+
+HardwareAddress::HardwareAddress(const uint8_t *hwaddr,
+                                 const uint8_t hwaddr_len)
+    : length(std::min<uint8_t>(hwaddr_len, MAX_HWADDR_LENGTH)), octets() {
+  std::copy(hwaddr, hwaddr + length, octets.begin());
+}
+
+HardwareAddress
+HardwareAddress::for_declined(const in_addr_t address_hostorder) {
+  HardwareAddress key;
+  std::memcpy(key.octets.data(), &address_hostorder,
+              sizeof(address_hostorder));
+  return key;
+}
+
+LeaseTable::LeaseTable()
+    : _slab(), _slab_in_use(), _free_slots(),
+      _hwaddr_index(INITIAL_INDEX_CAPACITY, EMPTY_SLOT),
+      _address_index(INITIAL_INDEX_CAPACITY, EMPTY_SLOT), _size(0) {}
+
+size_t LeaseTable::hwaddr_bucket(const HardwareAddress &hwaddr) const {
+  uint64_t low, high;
+  std::memcpy(&low, hwaddr.octets.data(), sizeof(low));
+  std::memcpy(&high, hwaddr.octets.data() + sizeof(low), sizeof(high));
+  return mix(low ^ mix(high ^ hwaddr.length)) & (_hwaddr_index.size() - 1);
+}
+
+size_t LeaseTable::address_bucket(const in_addr_t address) const {
+  return mix(address) & (_address_index.size() - 1);
+}
+
+size_t LeaseTable::find_hwaddr_position(const HardwareAddress &hwaddr) const {
+  const size_t mask = _hwaddr_index.size() - 1;
+  for (size_t position = hwaddr_bucket(hwaddr);;
+       position = (position + 1) & mask) {
+    const uint32_t slot = _hwaddr_index[position];
+    if (slot == EMPTY_SLOT) {
+      return NOT_FOUND;
+    }
+    if (_slab[slot].hwaddr == hwaddr) {
+      return position;
+    }
+  }
+}
+
+size_t LeaseTable::find_address_position(const in_addr_t address) const {
+  const size_t mask = _address_index.size() - 1;
+  for (size_t position = address_bucket(address);;
+       position = (position + 1) & mask) {
+    const uint32_t slot = _address_index[position];
+    if (slot == EMPTY_SLOT) {
+      return NOT_FOUND;
+    }
+    if (_slab[slot].address == address) {
+      return position;
+    }
+  }
+}
+
+void LeaseTable::insert_into_address_index(const uint32_t slot) {
+  const size_t mask = _address_index.size() - 1;
+  const in_addr_t address = _slab[slot].address;
+  size_t position = address_bucket(address);
+  // if another lease claims the same address, the most recent one wins
+  while (_address_index[position] != EMPTY_SLOT &&
+         _slab[_address_index[position]].address != address) {
+    position = (position + 1) & mask;
+  }
+  _address_index[position] = slot;
+}
+
+// Backward-shift deletion: entries following the erased one are moved up
+// unless that would put them before their home bucket. This keeps every
+// probe sequence free of holes without needing tombstones.
+void LeaseTable::erase_from_index(std::vector<uint32_t> &index,
+                                  size_t position, const bool by_hwaddr) {
+  const size_t mask = index.size() - 1;
+  size_t next = position;
+  while (true) {
+    next = (next + 1) & mask;
+    const uint32_t slot = index[next];
+    if (slot == EMPTY_SLOT) {
+      break;
+    }
+    const size_t home = by_hwaddr ? hwaddr_bucket(_slab[slot].hwaddr)
+                                  : address_bucket(_slab[slot].address);
+    const bool home_between = position <= next
+                                  ? (position < home && home <= next)
+                                  : (position < home || home <= next);
+    if (!home_between) {
+      index[position] = slot;
+      position = next;
+    }
+  }
+  index[position] = EMPTY_SLOT;
+}
+
+void LeaseTable::grow_indices() {
+  const size_t new_capacity = _hwaddr_index.size() * 2;
+  _hwaddr_index.assign(new_capacity, EMPTY_SLOT);
+  _address_index.assign(new_capacity, EMPTY_SLOT);
+  const size_t mask = new_capacity - 1;
+  for (uint32_t slot = 0; slot < _slab.size(); slot++) {
+    if (!_slab_in_use[slot]) {
+      continue;
+    }
+    size_t position = hwaddr_bucket(_slab[slot].hwaddr);
+    while (_hwaddr_index[position] != EMPTY_SLOT) {
+      position = (position + 1) & mask;
+    }
+    _hwaddr_index[position] = slot;
+    insert_into_address_index(slot);
+  }
+}
+
+Lease *LeaseTable::find(const HardwareAddress &hwaddr) {
+  const size_t position = find_hwaddr_position(hwaddr);
+  if (position == NOT_FOUND) {
+    return nullptr;
+  }
+  return &_slab[_hwaddr_index[position]];
+}
+
+Lease *LeaseTable::find_by_address(const in_addr_t address_hostorder) {
+  const size_t position = find_address_position(address_hostorder);
+  if (position == NOT_FOUND) {
+    return nullptr;
+  }
+  return &_slab[_address_index[position]];
+}
+
+Lease &LeaseTable::insert_or_assign(const HardwareAddress &hwaddr,
+                                    const in_addr_t address_hostorder,
+                                    const uint64_t timeout_timestamp) {
+  const size_t existing_position = find_hwaddr_position(hwaddr);
+  if (existing_position != NOT_FOUND) {
+    const uint32_t slot = _hwaddr_index[existing_position];
+    Lease &lease = _slab[slot];
+    if (lease.address != address_hostorder) {
+      const size_t address_position = find_address_position(lease.address);
+      if (address_position != NOT_FOUND &&
+          _address_index[address_position] == slot) {
+        erase_from_index(_address_index, address_position, false);
+      }
+      lease.address = address_hostorder;
+      insert_into_address_index(slot);
+    }
+    lease.timeout_timestamp = timeout_timestamp;
+    return lease;
+  }
+
+  if ((_size + 1) * 2 > _hwaddr_index.size()) {
+    grow_indices();
+  }
+  uint32_t slot;
+  if (!_free_slots.empty()) {
+    slot = _free_slots.back();
+    _free_slots.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(_slab.size());
+    _slab.emplace_back();
+    _slab_in_use.push_back(false);
+  }
+  _slab[slot] = Lease{.hwaddr = hwaddr,
+                      .address = address_hostorder,
+                      .timeout_timestamp = timeout_timestamp};
+  _slab_in_use[slot] = true;
+
+  const size_t mask = _hwaddr_index.size() - 1;
+  size_t position = hwaddr_bucket(hwaddr);
+  while (_hwaddr_index[position] != EMPTY_SLOT) {
+    position = (position + 1) & mask;
+  }
+  _hwaddr_index[position] = slot;
+  insert_into_address_index(slot);
+  _size++;
+  return _slab[slot];
+}
+
+bool LeaseTable::erase(const HardwareAddress &hwaddr) {
+  const size_t position = find_hwaddr_position(hwaddr);
+  if (position == NOT_FOUND) {
+    return false;
+  }
+  const uint32_t slot = _hwaddr_index[position];
+  const size_t address_position = find_address_position(_slab[slot].address);
+  if (address_position != NOT_FOUND &&
+      _address_index[address_position] == slot) {
+    erase_from_index(_address_index, address_position, false);
+  }
+  erase_from_index(_hwaddr_index, position, true);
+  _slab_in_use[slot] = false;
+  _free_slots.push_back(slot);
+  _size--;
+  return true;
+}
+
+void LeaseTable::reserve(const size_t lease_count) {
+  _slab.reserve(lease_count);
+  _slab_in_use.reserve(lease_count);
+  while (lease_count * 2 > _hwaddr_index.size()) {
+    grow_indices();
+  }
+}
+
+size_t LeaseTable::size() const { return _size; }
+} // namespace tinydhcpd
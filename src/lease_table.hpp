@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <vector>
+
+namespace tinydhcpd {
+constexpr size_t MAX_HWADDR_LENGTH = 16;
+
+// The client hardware address as it was actually sent, i.e. only the first
+// `length` octets are significant (the rest is always zero).
+struct HardwareAddress {
+  uint8_t length;
+  std::array<uint8_t, MAX_HWADDR_LENGTH> octets;
+
+  HardwareAddress();
+  HardwareAddress(const std::array<uint8_t, MAX_HWADDR_LENGTH> &hwaddr,
+                  const uint8_t hwaddr_len);
+  HardwareAddress(const uint8_t *hwaddr, const uint8_t hwaddr_len);
+  // Declined addresses are not owned by any client, so they are held under a
+  // zero-length key derived from the address itself.
+  static HardwareAddress for_declined(const in_addr_t address_hostorder);
+
+  bool operator==(const HardwareAddress &other) const = default;
+};
+
+struct Lease {
+  HardwareAddress hwaddr;
+  in_addr_t address;
+  uint64_t timeout_timestamp;
+};
+
+// Flat lease storage with two open-addressing indices, one keyed by hardware
+// address and one keyed by leased address. Leases live in a slab whose slots
+// are recycled, so lease churn does not allocate once the table has grown.
+//
+// Pointers returned by find() and find_by_address() stay valid until the next
+// call to insert_or_assign().
+class LeaseTable {
+private:
+  static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+  std::vector<Lease> _slab;
+  std::vector<bool> _slab_in_use;
+  std::vector<uint32_t> _free_slots;
+  std::vector<uint32_t> _hwaddr_index;
+  std::vector<uint32_t> _address_index;
+  size_t _size;
+
+  size_t hwaddr_bucket(const HardwareAddress &hwaddr) const;
+  size_t address_bucket(const in_addr_t address) const;
+  size_t find_hwaddr_position(const HardwareAddress &hwaddr) const;
+  size_t find_address_position(const in_addr_t address) const;
+  void insert_into_address_index(const uint32_t slot);
+  void erase_from_index(std::vector<uint32_t> &index, size_t position,
+                        const bool by_hwaddr);
+  void grow_indices();
+
+public:
+  LeaseTable();
+
+  Lease *find(const HardwareAddress &hwaddr);
+  Lease *find_by_address(const in_addr_t address_hostorder);
+  Lease &insert_or_assign(const HardwareAddress &hwaddr,
+                          const in_addr_t address_hostorder,
+                          const uint64_t timeout_timestamp);
+  bool erase(const HardwareAddress &hwaddr);
+  void reserve(const size_t lease_count);
+  size_t size() const;
+
+  template <typename F> void for_each(F callback) const {
+    for (size_t slot = 0; slot < _slab.size(); slot++) {
+      if (_slab_in_use[slot]) {
+        callback(_slab[slot]);
+      }
+    }
+  }
+};
+} // namespace tinydhcpd
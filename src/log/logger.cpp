@@ -1,31 +1,122 @@
 #include "logger.hpp"
 
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <pthread.h>
+
 namespace tinydhcpd {
 Level current_global_log_level = Level::INFO;
+std::unique_ptr<Logger> global_logger;
+
+Logger::Logger(LogSink &sink)
+    : _sink(sink), _sink_mutex(), _ring(new Record[RING_SIZE]),
+      _enqueue_position(0), _dequeue_position(0), _published(0), _dropped(0),
+      _writer_started(false), _stopping(false), _writer() {
+  for (size_t i = 0; i < RING_SIZE; i++) {
+    _ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
 
-Logger::Logger(const LogSink &sink) : sink(sink) {}
+Logger::~Logger() {
+  if (_writer.joinable()) {
+    _stopping.store(true);
+    _published.fetch_add(1, std::memory_order_release);
+    _published.notify_one();
+    _writer.join();
+  }
+}
 
-void Logger::operator()(const std::string &message, const Level lvl) {
-  if (static_cast<int>(lvl) < current_global_log_level)
+void Logger::start_writer() {
+  _writer = std::thread(&Logger::run_writer, this);
+  _writer_started.store(true, std::memory_order_release);
+}
+
+void Logger::operator()(const std::string_view message, const Level lvl) {
+  if (!_writer_started.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(_sink_mutex);
+    _sink.write(message, lvl, std::time(nullptr));
+    _sink.flush();
     return;
-  sink.write(message, lvl);
+  }
+  while (!try_enqueue(message, lvl)) {
+    if (lvl < Level::FATAL) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    std::this_thread::yield();
+  }
+  _published.fetch_add(1, std::memory_order_release);
+  _published.notify_one();
 }
 
-void LOG(const std::string &message, const Level &level) {
-  (*tinydhcpd::global_logger)(message, level);
+bool Logger::try_enqueue(const std::string_view message,
+                         const Level level) {
+  uint64_t position = _enqueue_position.load(std::memory_order_relaxed);
+  Record *record;
+  while (true) {
+    record = &_ring[position % RING_SIZE];
+    const uint64_t sequence = record->sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (_enqueue_position.compare_exchange_weak(position, position + 1,
+                                                  std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < position) {
+      // the writer has not consumed this record yet
+      return false;
+    } else {
+      position = _enqueue_position.load(std::memory_order_relaxed);
+    }
+  }
+  record->timestamp = std::time(nullptr);
+  record->level = level;
+  record->length =
+      static_cast<uint16_t>(std::min(message.size(), MAX_MESSAGE_SIZE));
+  std::memcpy(record->message, message.data(), record->length);
+  record->sequence.store(position + 1, std::memory_order_release);
+  return true;
 }
 
-void LOG_TRACE([[maybe_unused]] const std::string &msg) {
-#ifdef ENABLE_TRACE
-  LOG(msg, Level::TRACE);
-#else
-  return;
-#endif
+bool Logger::write_next() {
+  Record &record = _ring[_dequeue_position % RING_SIZE];
+  if (record.sequence.load(std::memory_order_acquire) !=
+      _dequeue_position + 1) {
+    return false;
+  }
+  _sink.write(std::string_view(record.message, record.length), record.level,
+              record.timestamp);
+  record.sequence.store(_dequeue_position + RING_SIZE,
+                        std::memory_order_release);
+  _dequeue_position++;
+  return true;
 }
 
-void LOG_DEBUG(const std::string &msg) { LOG(msg, Level::DEBUG); }
-void LOG_INFO(const std::string &msg) { LOG(msg, Level::INFO); }
-void LOG_WARN(const std::string &msg) { LOG(msg, Level::WARN); }
-void LOG_ERROR(const std::string &msg) { LOG(msg, Level::ERROR); }
-void LOG_FATAL(const std::string &msg) { LOG(msg, Level::FATAL); }
+void Logger::run_writer() {
+  // signals are meant for the workers
+  sigset_t signals;
+  sigfillset(&signals);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  while (true) {
+    const uint32_t published = _published.load(std::memory_order_acquire);
+    bool written = false;
+    while (write_next()) {
+      written = true;
+    }
+    const uint64_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+      _sink.write("Dropped " + std::to_string(dropped) + " log messages",
+                  Level::WARN, std::time(nullptr));
+      written = true;
+    }
+    // one flush per batch instead of one per message
+    if (written) {
+      _sink.flush();
+    }
+    if (_stopping.load()) {
+      return;
+    }
+    _published.wait(published, std::memory_order_acquire);
+  }
+}
 } // namespace tinydhcpd
@@ -1,29 +1,129 @@
 #pragma once
 
 #include "logsink.hpp"
+#include "src/string-format.hpp"
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <string_view>
+#include <thread>
+
+// Messages below this level are compiled out, see the min_log_level build
+// option.
+#ifndef MIN_LOG_LEVEL
+#ifdef ENABLE_TRACE
+#define MIN_LOG_LEVEL 0
+#else
+#define MIN_LOG_LEVEL 1
+#endif
+#endif
 
 namespace tinydhcpd {
+constexpr Level COMPILED_LOG_LEVEL = static_cast<Level>(MIN_LOG_LEVEL);
 
 extern Level current_global_log_level;
 
+// Hands messages to a writer thread through a bounded lock-free ring, so
+// that a slow sink never delays the workers. Until start_writer() has been
+// called, messages are written synchronously instead.
+//
+// When the ring is full, messages are dropped and counted, the writer reports
+// the number once it has caught up. Only FATAL messages, which are logged at
+// startup and shutdown, wait for the writer to make room, so a flood of
+// messages caused by clients never stalls the workers.
 class Logger {
 private:
-  const LogSink &sink;
+  static constexpr size_t RING_SIZE = 4096; // power of 2
+  static constexpr size_t MAX_MESSAGE_SIZE = 232; // longer ones are cut off
+
+  struct Record {
+    // Vyukov's bounded queue: equals the position when the record is free,
+    // position + 1 once it has been filled
+    std::atomic<uint64_t> sequence;
+    std::time_t timestamp;
+    Level level;
+    uint16_t length;
+    char message[MAX_MESSAGE_SIZE];
+  };
+
+  LogSink &_sink;
+  // serializes writes before the writer has been started
+  std::mutex _sink_mutex;
+  std::unique_ptr<Record[]> _ring;
+  alignas(64) std::atomic<uint64_t> _enqueue_position;
+  // only touched by the writer
+  alignas(64) uint64_t _dequeue_position;
+  // bumped after every enqueue, the writer sleeps on it
+  std::atomic<uint32_t> _published;
+  std::atomic<uint64_t> _dropped;
+  std::atomic<bool> _writer_started;
+  std::atomic<bool> _stopping;
+  std::thread _writer;
+
+  bool try_enqueue(const std::string_view message, const Level level);
+  void run_writer();
+  // returns false if the ring is empty
+  bool write_next();
 
 public:
-  Logger(const LogSink &sink);
-  void operator()(const std::string &message, const Level level);
+  Logger(LogSink &sink);
+  ~Logger();
+  Logger(const Logger &other) = delete;
+
+  // Starts the writer thread. Must happen after daemonizing, because threads
+  // do not survive fork().
+  void start_writer();
+  void operator()(const std::string_view message, const Level level);
 };
 
 extern std::unique_ptr<Logger> global_logger;
 
-void LOG(Logger &Logger, const std::string &message, Level &level);
-void LOG_TRACE(const std::string &msg);
-void LOG_DEBUG(const std::string &msg);
-void LOG_INFO(const std::string &msg);
-void LOG_WARN(const std::string &msg);
-void LOG_ERROR(const std::string &msg);
-void LOG_FATAL(const std::string &msg);
+// Guards work that only serves a log message, e.g. building a hex dump.
+inline bool log_enabled(const Level level) {
+  return level >= COMPILED_LOG_LEVEL && level >= current_global_log_level;
+}
+
+// Formats the message printf-style, but only if its level is enabled. A
+// format without arguments is logged as it is.
+template <Level LEVEL, typename... Args>
+void log_message(const char *format, Args... args) {
+  if constexpr (LEVEL >= COMPILED_LOG_LEVEL) {
+    if (!log_enabled(LEVEL)) {
+      return;
+    }
+    if constexpr (sizeof...(Args) == 0) {
+      (*global_logger)(format, LEVEL);
+    } else {
+      (*global_logger)(format_to_buffer(format, args...), LEVEL);
+    }
+  }
+}
+
+template <Level LEVEL> void log_message(const std::string &message) {
+  if constexpr (LEVEL >= COMPILED_LOG_LEVEL) {
+    if (log_enabled(LEVEL)) {
+      (*global_logger)(message, LEVEL);
+    }
+  }
+}
+
+template <typename... Args> void LOG_TRACE(Args &&...args) {
+  log_message<Level::TRACE>(std::forward<Args>(args)...);
+}
+template <typename... Args> void LOG_DEBUG(Args &&...args) {
+  log_message<Level::DEBUG>(std::forward<Args>(args)...);
+}
+template <typename... Args> void LOG_INFO(Args &&...args) {
+  log_message<Level::INFO>(std::forward<Args>(args)...);
+}
+template <typename... Args> void LOG_WARN(Args &&...args) {
+  log_message<Level::WARN>(std::forward<Args>(args)...);
+}
+template <typename... Args> void LOG_ERROR(Args &&...args) {
+  log_message<Level::ERROR>(std::forward<Args>(args)...);
+}
+template <typename... Args> void LOG_FATAL(Args &&...args) {
+  log_message<Level::FATAL>(std::forward<Args>(args)...);
+}
 } // namespace tinydhcpd
@@ -1,5 +1,7 @@
 #pragma once
+#include <ctime>
 #include <iostream>
+#include <string_view>
 
 namespace tinydhcpd {
 enum Level { TRACE = 0, DEBUG, INFO, WARN, ERROR, FATAL };
@@ -7,16 +9,15 @@ enum Level { TRACE = 0, DEBUG, INFO, WARN, ERROR, FATAL };
 class LogSink {
 protected:
   std::ostream &sink;
-  virtual std::string format_message(const std::string &msg,
-                                     Level level) const = 0;
 
 public:
   LogSink(std::ostream &sink) : sink(sink) {}
 
-  void write(const std::string &msg, Level level) const {
-    const std::string formatted = format_message(msg, level);
-    sink << formatted << std::endl;
-  }
+  // The message may stay buffered until the next flush(). Sinks are only
+  // used by one thread at a time.
+  virtual void write(const std::string_view msg, const Level level,
+                     const std::time_t timestamp) = 0;
+  virtual void flush() { sink.flush(); }
   virtual ~LogSink() {}
 };
 } // namespace tinydhcpd
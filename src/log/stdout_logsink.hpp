@@ -1,11 +1,9 @@
 #pragma once
 
-#include <chrono>
 #include <ctime>
-#include <sstream>
+#include <string>
 
 #include "logsink.hpp"
-#include "src/string-format.hpp"
 
 namespace tinydhcpd {
 class StdoutLogSink : public LogSink {
@@ -17,45 +15,50 @@ private:
   const std::string CYAN = "\033[36m";
   const std::string BLACK_ON_RED = "\033[30;41m";
 
-  virtual std::string format_message(const std::string &msg,
-                                     Level level) const override {
-    std::stringstream buffer;
-    const std::string format = "%-6s";
+  // ctime() is only called when the second changes
+  std::time_t formatted_time = -1;
+  std::string formatted_timestamp;
+
+  const std::string &format_timestamp(const std::time_t timestamp) {
+    if (timestamp != formatted_time) {
+      formatted_time = timestamp;
+      formatted_timestamp = std::ctime(&timestamp);
+      if (formatted_timestamp.ends_with("\n")) {
+        formatted_timestamp.pop_back();
+      }
+    }
+    return formatted_timestamp;
+  }
+
+public:
+  StdoutLogSink() : LogSink(std::cout) {}
+  ~StdoutLogSink() {}
+
+  virtual void write(const std::string_view msg, const Level level,
+                     const std::time_t timestamp) override {
     switch (level) {
     case TRACE:
-      buffer << CYAN << string_format(format, "TRACE");
+      sink << CYAN << "TRACE ";
       break;
     case DEBUG:
-      buffer << MAGENTA << string_format(format, "DEBUG");
+      sink << MAGENTA << "DEBUG ";
       break;
     case WARN:
-      buffer << YELLOW << string_format(format, "WARN");
+      sink << YELLOW << "WARN  ";
       break;
     case ERROR:
-      buffer << RED << string_format(format, "ERROR");
+      sink << RED << "ERROR ";
       break;
     case FATAL:
-      buffer << BLACK_ON_RED << string_format(format, "FATAL");
+      sink << BLACK_ON_RED << "FATAL ";
       break;
     case INFO:
     default:
-      buffer << string_format(format, "INFO");
+      sink << "INFO  ";
       break;
     }
-
-    using std::chrono::system_clock;
-    auto now = system_clock::to_time_t(system_clock::now());
-    std::string ts = std::ctime(&now);
-
-    if (ts.ends_with("\n")) {
-      ts.pop_back();
-    }
-    buffer << "[" << ts << "] " << msg << FORMAT_RESET;
-    return buffer.str();
+    sink << "[" << format_timestamp(timestamp) << "] " << msg << FORMAT_RESET
+         << '\n';
   }
-
-public:
-  StdoutLogSink() : LogSink(std::cout) {}
-  ~StdoutLogSink() {}
 };
 } // namespace tinydhcpd
@@ -24,6 +24,11 @@ int SyslogBuffer::overflow(int c) {
   return c;
 }
 
+std::streamsize SyslogBuffer::xsputn(const char *s, std::streamsize n) {
+  buffer.append(s, n);
+  return n;
+}
+
 std::ostream &operator<<(std::ostream &os, const SyslogPriority &prio) {
   static_cast<SyslogBuffer *>(os.rdbuf())->next_prio = static_cast<int>(prio);
   return os;
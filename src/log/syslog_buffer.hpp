@@ -32,6 +32,7 @@ public:
 protected:
   int sync();
   int overflow(int c);
+  std::streamsize xsputn(const char *s, std::streamsize n);
 
 private:
   friend std::ostream &operator<<(std::ostream &os,
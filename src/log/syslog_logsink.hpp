@@ -1,17 +1,17 @@
 #pragma once
 
-#include <chrono>
-#include <ctime>
-#include <sstream>
-
 #include "logsink.hpp"
 #include "syslog_buffer.hpp"
 
 namespace tinydhcpd {
 class SyslogLogSink : public LogSink {
-private:
-  virtual std::string format_message(const std::string &msg,
-                                     Level level) const override {
+public:
+  SyslogLogSink() : LogSink(tinydhcpd::syslog_stream) {}
+  ~SyslogLogSink() {}
+
+  // every message is a syslog() call of its own
+  virtual void write(const std::string_view msg, const Level level,
+                     const std::time_t) override {
     switch (level) {
     case TRACE:
       sink << SYSLOG_DEBUG;
@@ -32,12 +32,7 @@ private:
       sink << SYSLOG_INFO;
       break;
     }
-
-    return msg;
+    sink << msg << std::flush;
   }
-
-public:
-  SyslogLogSink() : LogSink(tinydhcpd::syslog_stream) {}
-  ~SyslogLogSink() {}
 };
 } // namespace tinydhcpd
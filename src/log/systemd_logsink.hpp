@@ -4,28 +4,36 @@
 
 namespace tinydhcpd {
 class SystemdLogSink : public LogSink {
-private:
-  virtual std::string format_message(const std::string &msg,
-                                     Level level) const override {
+public:
+  SystemdLogSink(std::ostream &sink) : LogSink(sink) {
+    // std::cerr flushes after every output operation by default, the
+    // messages are flushed in batches instead
+    sink.unsetf(std::ios_base::unitbuf);
+  }
+  ~SystemdLogSink() {}
+
+  virtual void write(const std::string_view msg, const Level level,
+                     const std::time_t) override {
     switch (level) {
     case TRACE:
-      return SD_DEBUG + msg;
     case DEBUG:
-      return SD_DEBUG + msg;
+      sink << SD_DEBUG;
+      break;
     case WARN:
-      return SD_WARNING + msg;
+      sink << SD_WARNING;
+      break;
     case ERROR:
-      return SD_ERR + msg;
+      sink << SD_ERR;
+      break;
     case FATAL:
-      return SD_CRIT + msg;
+      sink << SD_CRIT;
+      break;
     case INFO:
     default:
-      return SD_INFO + msg;
+      sink << SD_INFO;
+      break;
     }
+    sink << msg << '\n';
   }
-
-public:
-  SystemdLogSink(std::ostream &sink) : LogSink(sink) {}
-  ~SystemdLogSink() {}
 };
 } // namespace tinydhcpd
@@ -3,13 +3,20 @@
 #include <libconfig.h++>
 
 #include <csignal>
+#include <cstring>
 #include <filesystem>
+#include <memory>
+#include <pthread.h>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include "configuration.hpp"
+#include "configuration_store.hpp"
 #include "daemon.hpp"
 #include "log/logger.hpp"
 #include "log/stdout_logsink.hpp"
+#include "metrics.hpp"
 #include "src/log/logsink.hpp"
 #include "src/log/syslog_logsink.hpp"
 #include "string-format.hpp"
@@ -47,22 +54,98 @@ const struct option long_options[] = {
     {"trace", no_argument, nullptr, TRACE_TAG},
     {nullptr, 0, nullptr, 0}};
 
+void run_worker(tinydhcpd::Daemon &worker) {
+  try {
+    worker.main_loop();
+  } catch (std::runtime_error &e) {
+    tinydhcpd::LOG_FATAL(e.what());
+    // stop the other workers as well
+    tinydhcpd::last_signal = SIGTERM;
+  }
+  worker.write_leases();
+}
+
+// Reloads the subnets whenever SIGHUP arrives, which is blocked in every
+// other thread. Returns once it is woken up after the workers have stopped.
+void run_reloader(const tinydhcpd::ProgramConfiguration &optval,
+                  tinydhcpd::ConfigurationStore &config_store) {
+  sigset_t reload_signals;
+  sigemptyset(&reload_signals);
+  sigaddset(&reload_signals, SIGHUP);
+  int signum;
+  while (sigwait(&reload_signals, &signum) == 0) {
+    if (tinydhcpd::last_signal == SIGINT || tinydhcpd::last_signal == SIGTERM) {
+      return;
+    }
+    tinydhcpd::LOG_INFO("Reloading config from file %s",
+                        optval.confpath.c_str());
+    // settings outside of the subnets only take effect after a restart
+    tinydhcpd::ProgramConfiguration reloaded = optval;
+    reloaded.subnets.clear();
+    try {
+      tinydhcpd::parse_configuration(reloaded);
+      config_store.publish(std::move(reloaded.subnets));
+    } catch (libconfig::ParseException &pex) {
+      tinydhcpd::LOG_ERROR(
+          "Failed to parse config file %s at line %d! Error: %s",
+          pex.getFile(), pex.getLine(), pex.getError());
+    } catch (libconfig::FileIOException &fex) {
+      tinydhcpd::LOG_ERROR("Error reading file %s.", optval.confpath.c_str());
+    } catch (std::exception &ex) {
+      tinydhcpd::LOG_ERROR("Keeping the current configuration: %s",
+                           ex.what());
+    }
+  }
+}
+
+void pin_to_cpu(const pthread_t thread, const uint32_t worker_index,
+                const std::vector<int> &cpus) {
+  if (cpus.empty()) {
+    return;
+  }
+  const int cpu = cpus[worker_index % cpus.size()];
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  const int error = pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set);
+  if (error != 0) {
+    tinydhcpd::LOG_WARN("Failed to pin worker %u to CPU %d: %s", worker_index,
+                        cpu, strerror(error));
+  }
+}
+
 int main(int argc, char *const argv[]) {
   std::signal(SIGINT, tinydhcpd::sighandler);
   std::signal(SIGHUP, tinydhcpd::sighandler);
 
   tinydhcpd::ProgramConfiguration optval = {
       .address = {.s_addr = INADDR_ANY},
-      .interface = "",
+      .interfaces = {},
       .confpath = "/etc/tinydhcpd/tinydhcpd.conf",
       .lease_file_path = "/var/lib/tinydhcpd/leases",
+      .lease_file_format = tinydhcpd::LeaseFileFormat::BINARY,
+      .io_batch_size = tinydhcpd::DEFAULT_IO_BATCH_SIZE,
+      .worker_count = 1,
+      .worker_cpus = {},
+      .raw_unicast = false,
+      .receive_backend = tinydhcpd::ReceiveBackend::SOCKET,
+      .metrics_socket_path = "",
+      .rate_limits = {.client = {.rate = 0, .burst = 0},
+                      .interface = {.rate = 0, .burst = 0},
+                      .global = {.rate = 0, .burst = 0}},
       .foreground = false,
 #ifdef HAVE_SYSTEMD
       .daemon_type = tinydhcpd::DAEMON_TYPE::SYSTEMD,
 #else
       .daemon_type = tinydhcpd::DAEMON_TYPE::SYSV,
 #endif
-      .subnet_config = {}};
+      .subnets = {},
+      .journal_config = {
+          .flush_interval_ms = tinydhcpd::DEFAULT_JOURNAL_FLUSH_INTERVAL_MS,
+          .batch_size = tinydhcpd::DEFAULT_JOURNAL_BATCH_SIZE,
+          .sync_policy = tinydhcpd::JournalSyncPolicy::BATCH,
+          .compaction_threshold =
+              tinydhcpd::DEFAULT_JOURNAL_COMPACTION_THRESHOLD}};
 
 #ifdef HAVE_SYSTEMD
   const std::string shortopts = "a:i:c:fontv";
@@ -79,7 +162,7 @@ int main(int argc, char *const argv[]) {
       break;
 
     case IFACE_TAG:
-      optval.interface = optarg;
+      optval.interfaces.push_back(optarg);
       break;
 
     case CONFIG_FILE_TAG:
@@ -128,17 +211,15 @@ int main(int argc, char *const argv[]) {
         new tinydhcpd::Logger(*(new tinydhcpd::SystemdLogSink(std::cerr))));
   }
 #endif
-  tinydhcpd::LOG_INFO(
-      tinydhcpd::string_format("tinydhcpd %s starting...", PROGRAM_VERSION));
+  tinydhcpd::LOG_INFO("tinydhcpd %s starting...", PROGRAM_VERSION);
 
   try {
     tinydhcpd::LOG_INFO(
         std::string("Loading config from file ").append(optval.confpath));
     tinydhcpd::parse_configuration(optval);
   } catch (libconfig::ParseException &pex) {
-    tinydhcpd::LOG_FATAL(tinydhcpd::string_format(
-        "Failed to parse config file %s at line %d! Error: %s", pex.getFile(),
-        pex.getLine(), pex.getError()));
+    tinydhcpd::LOG_FATAL("Failed to parse config file %s at line %d! Error: %s",
+                         pex.getFile(), pex.getLine(), pex.getError());
     std::exit(EXIT_FAILURE);
   } catch (libconfig::FileIOException &fex) {
     std::ostringstream os;
@@ -152,19 +233,46 @@ int main(int argc, char *const argv[]) {
     tinydhcpd::LOG_FATAL(ex.what());
   }
 
-  tinydhcpd::Daemon daemon(optval.address, optval.interface,
-                           optval.subnet_config, optval.lease_file_path);
+  // the sockets have to join the SO_REUSEPORT group in worker order, so the
+  // workers are created one after another
+  tinydhcpd::ConfigurationStore config_store(optval.subnets);
+  tinydhcpd::MetricsRegistry metrics(optval.subnets, optval.worker_count);
+  std::vector<std::unique_ptr<tinydhcpd::Daemon>> workers;
+  for (uint32_t i = 0; i < optval.worker_count; i++) {
+    workers.emplace_back(
+        std::make_unique<tinydhcpd::Daemon>(optval, i, config_store, metrics));
+  }
   tinydhcpd::LOG_INFO("Initialization finished");
 
   try {
     if (!optval.foreground) {
-      daemon.daemonize(optval.daemon_type);
+      workers.front()->daemonize(optval.daemon_type);
     } else {
       tinydhcpd::LOG_INFO("Running in foreground.");
     }
+    // only the reloader accepts SIGHUP, the mask is inherited by the threads
+    // started from here on
+    sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &reload_signals, nullptr);
+    tinydhcpd::global_logger->start_writer();
     std::signal(SIGTERM, tinydhcpd::sighandler);
-    daemon.main_loop();
-    daemon.write_leases();
+    // threads do not survive daemonizing, so they are only started now
+    std::thread reloader(run_reloader, std::cref(optval),
+                         std::ref(config_store));
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < optval.worker_count; i++) {
+      threads.emplace_back(run_worker, std::ref(*workers[i]));
+      pin_to_cpu(threads.back().native_handle(), i, optval.worker_cpus);
+    }
+    pin_to_cpu(pthread_self(), 0, optval.worker_cpus);
+    run_worker(*workers.front());
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    pthread_kill(reloader.native_handle(), SIGHUP);
+    reloader.join();
   } catch (std::runtime_error &e) {
     tinydhcpd::LOG_FATAL(e.what());
     std::exit(EXIT_FAILURE);
@@ -0,0 +1,245 @@
+#include "metrics.hpp"
+
+#include <arpa/inet.h>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "log/logger.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+namespace {
+struct CounterFamily {
+  Counter counter;
+  const char *name;
+  const char *help;
+  // distinguishes the counters of a family, nullptr if there is only one
+  const char *label;
+  const char *label_value;
+};
+
+constexpr const char *RECEIVED = "tinydhcpd_messages_received_total";
+constexpr const char *SENT = "tinydhcpd_messages_sent_total";
+constexpr const char *RATE_LIMITED = "tinydhcpd_rate_limited_total";
+constexpr const char *RATE_LIMITED_HELP =
+    "Received messages dropped by a rate limit";
+
+constexpr std::array<CounterFamily, static_cast<size_t>(Counter::COUNT)>
+    counter_families = {{
+        {Counter::DISCOVER, RECEIVED, "Received DHCP messages", "type",
+         "discover"},
+        {Counter::REQUEST, RECEIVED, "Received DHCP messages", "type",
+         "request"},
+        {Counter::DECLINE, RECEIVED, "Received DHCP messages", "type",
+         "decline"},
+        {Counter::RELEASE, RECEIVED, "Received DHCP messages", "type",
+         "release"},
+        {Counter::INFORM, RECEIVED, "Received DHCP messages", "type", "inform"},
+        {Counter::OFFER, SENT, "Sent DHCP messages", "type", "offer"},
+        {Counter::ACK, SENT, "Sent DHCP messages", "type", "ack"},
+        {Counter::NAK, SENT, "Sent DHCP messages", "type", "nak"},
+        {Counter::PARSE_ERROR, "tinydhcpd_parse_errors_total",
+         "Received messages that could not be parsed", nullptr, nullptr},
+        {Counter::SEND_WOULD_BLOCK, "tinydhcpd_send_would_block_total",
+         "Sends that found the socket buffer full", nullptr, nullptr},
+        {Counter::SEND_QUEUE_FULL, "tinydhcpd_send_queue_full_total",
+         "Replies dropped because the send queue was full", nullptr, nullptr},
+        {Counter::REPLY_CACHE_HIT, "tinydhcpd_replies_resent_total",
+         "Retransmitted requests answered with the cached reply", nullptr,
+         nullptr},
+        {Counter::RATE_LIMITED_CLIENT, RATE_LIMITED, RATE_LIMITED_HELP, "scope",
+         "client"},
+        {Counter::RATE_LIMITED_INTERFACE, RATE_LIMITED, RATE_LIMITED_HELP,
+         "scope", "interface"},
+        {Counter::RATE_LIMITED_GLOBAL, RATE_LIMITED, RATE_LIMITED_HELP, "scope",
+         "global"},
+        {Counter::JOURNAL_WRITE_ERROR, "tinydhcpd_journal_write_errors_total",
+         "Lease journal batches that could not be written", nullptr, nullptr},
+        {Counter::JOURNAL_COMPACTION_ERROR,
+         "tinydhcpd_journal_compaction_errors_total",
+         "Lease journal compactions that failed", nullptr, nullptr},
+    }};
+
+void append_header(std::string &text, const char *name, const char *type,
+                   const char *help) {
+  text += string_format("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+} // namespace
+
+WorkerMetrics::WorkerMetrics(const size_t subnet_count)
+    : _counters{}, _send_queue_depth(0), _subnets(subnet_count) {}
+
+uint64_t WorkerMetrics::get(const Counter counter) const {
+  return _counters[static_cast<size_t>(counter)].load(
+      std::memory_order_relaxed);
+}
+
+void WorkerMetrics::set_send_queue_depth(const uint64_t depth) {
+  _send_queue_depth.store(depth, std::memory_order_relaxed);
+}
+
+uint64_t WorkerMetrics::send_queue_depth() const {
+  return _send_queue_depth.load(std::memory_order_relaxed);
+}
+
+SubnetGauges &WorkerMetrics::subnet(const size_t subnet_index) {
+  return _subnets[subnet_index];
+}
+
+const SubnetGauges &WorkerMetrics::subnet(const size_t subnet_index) const {
+  return _subnets[subnet_index];
+}
+
+MetricsRegistry::MetricsRegistry(
+    const std::vector<SubnetConfiguration> &subnets,
+    const uint32_t worker_count)
+    : _subnet_labels(), _workers() {
+  for (const SubnetConfiguration &subnet_cfg : subnets) {
+    _subnet_labels.push_back(string_format(
+        "%s/%d",
+        inet_ntoa({.s_addr = subnet_cfg.subnet_address.s_addr &
+                             subnet_cfg.netmask.s_addr}),
+        std::popcount(subnet_cfg.netmask.s_addr)));
+  }
+  for (uint32_t i = 0; i < worker_count; i++) {
+    _workers.push_back(std::make_unique<WorkerMetrics>(subnets.size()));
+  }
+}
+
+WorkerMetrics &MetricsRegistry::worker(const uint32_t worker_index) {
+  return *_workers[worker_index];
+}
+
+std::string MetricsRegistry::render() const {
+  std::string text;
+  const char *previous_family = nullptr;
+  for (const CounterFamily &family : counter_families) {
+    if (family.name != previous_family) {
+      append_header(text, family.name, "counter", family.help);
+      previous_family = family.name;
+    }
+    for (size_t worker = 0; worker < _workers.size(); worker++) {
+      const uint64_t value = _workers[worker]->get(family.counter);
+      if (family.label != nullptr) {
+        text += string_format("%s{worker=\"%lu\",%s=\"%s\"} %lu\n",
+                              family.name, worker, family.label,
+                              family.label_value, value);
+      } else {
+        text += string_format("%s{worker=\"%lu\"} %lu\n", family.name, worker,
+                              value);
+      }
+    }
+  }
+
+  append_header(text, "tinydhcpd_send_queue_depth", "gauge",
+                "Replies waiting to be sent");
+  for (size_t worker = 0; worker < _workers.size(); worker++) {
+    text += string_format("tinydhcpd_send_queue_depth{worker=\"%lu\"} %lu\n",
+                          worker, _workers[worker]->send_queue_depth());
+  }
+
+  // the workers serve disjoint shards of every subnet
+  const struct {
+    const char *name;
+    const char *help;
+    std::atomic<uint64_t> SubnetGauges::*gauge;
+  } subnet_families[] = {
+      {"tinydhcpd_pool_addresses", "Addresses in the pool",
+       &SubnetGauges::pool_size},
+      {"tinydhcpd_pool_addresses_used", "Pool addresses in use",
+       &SubnetGauges::pool_used},
+      {"tinydhcpd_leases_active", "Leases that have not run out",
+       &SubnetGauges::leases_active},
+      {"tinydhcpd_leases_expiring",
+       "Leases with less than half of the lease time left",
+       &SubnetGauges::leases_expiring},
+  };
+  for (const auto &family : subnet_families) {
+    append_header(text, family.name, "gauge", family.help);
+    for (size_t subnet = 0; subnet < _subnet_labels.size(); subnet++) {
+      uint64_t sum = 0;
+      for (const std::unique_ptr<WorkerMetrics> &worker : _workers) {
+        sum += (worker->subnet(subnet).*family.gauge)
+                   .load(std::memory_order_relaxed);
+      }
+      text += string_format("%s{subnet=\"%s\"} %lu\n", family.name,
+                            _subnet_labels[subnet].c_str(), sum);
+    }
+  }
+  return text;
+}
+
+std::string MetricsRegistry::status() const {
+  uint64_t acks = 0, naks = 0, pool_size = 0, pool_used = 0;
+  for (const std::unique_ptr<WorkerMetrics> &worker : _workers) {
+    acks += worker->get(Counter::ACK);
+    naks += worker->get(Counter::NAK);
+    for (size_t subnet = 0; subnet < _subnet_labels.size(); subnet++) {
+      pool_size += worker->subnet(subnet).pool_size.load(
+          std::memory_order_relaxed);
+      pool_used += worker->subnet(subnet).pool_used.load(
+          std::memory_order_relaxed);
+    }
+  }
+  return string_format("%lu of %lu addresses in use, %lu ACKs, %lu NAKs",
+                       pool_used, pool_size, acks, naks);
+}
+
+MetricsExporter::MetricsExporter(const std::string &path,
+                                 const MetricsRegistry &registry)
+    : _socket_fd(-1), _path(path), _registry(registry) {
+  struct sockaddr_un address {};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error(
+        string_format("Metrics socket path is too long: %s", path.c_str()));
+  }
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  _socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_socket_fd < 0) {
+    throw std::runtime_error(string_format(
+        "Failed to create metrics socket: %s", strerror(errno)));
+  }
+  // left behind by an earlier run
+  unlink(path.c_str());
+  if (bind(_socket_fd, reinterpret_cast<struct sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(_socket_fd, 16) < 0) {
+    close(_socket_fd);
+    throw std::runtime_error(string_format(
+        "Failed to listen on metrics socket %s: %s", path.c_str(),
+        strerror(errno)));
+  }
+  LOG_INFO("Serving metrics on %s", path.c_str());
+}
+
+MetricsExporter::~MetricsExporter() noexcept {
+  close(_socket_fd);
+  unlink(_path.c_str());
+}
+
+MetricsExporter::operator int() const { return _socket_fd; }
+
+void MetricsExporter::handle_connections() {
+  int client_fd;
+  while ((client_fd = accept4(_socket_fd, nullptr, nullptr,
+                              SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    const std::string text = _registry.render();
+    // the text fits into the socket buffer, a client that does not read
+    // it is not waited for
+    if (send(client_fd, text.data(), text.size(), MSG_NOSIGNAL) !=
+        static_cast<ssize_t>(text.size())) {
+      LOG_WARN("Failed to send metrics: %s", strerror(errno));
+    }
+    close(client_fd);
+  }
+  if (errno != EAGAIN && errno != EWOULDBLOCK) {
+    LOG_WARN("Failed to accept metrics connection: %s", strerror(errno));
+  }
+}
+} // namespace tinydhcpd
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "subnet_config.hpp"
+
+namespace tinydhcpd {
+enum struct Counter : size_t {
+  // received
+  DISCOVER,
+  REQUEST,
+  DECLINE,
+  RELEASE,
+  INFORM,
+  // sent
+  OFFER,
+  ACK,
+  NAK,
+  PARSE_ERROR,
+  SEND_WOULD_BLOCK,
+  SEND_QUEUE_FULL,
+  // retransmitted requests answered from the reply cache
+  REPLY_CACHE_HIT,
+  // dropped by the rate limiter
+  RATE_LIMITED_CLIENT,
+  RATE_LIMITED_INTERFACE,
+  RATE_LIMITED_GLOBAL,
+  // lease journal batches lost to write errors
+  JOURNAL_WRITE_ERROR,
+  JOURNAL_COMPACTION_ERROR,
+  COUNT
+};
+
+// A worker's shard of a subnet.
+struct SubnetGauges {
+  std::atomic<uint64_t> pool_size;
+  std::atomic<uint64_t> pool_used;
+  std::atomic<uint64_t> leases_active;
+  // active leases with less than half of the lease time left, i.e. pending
+  // offers and clients that are late to renew
+  std::atomic<uint64_t> leases_expiring;
+};
+
+// The metrics of one worker. Every value is only written by the worker
+// itself, so updates are relaxed loads and stores instead of locked
+// read-modify-write instructions, and the alignment keeps the counters of
+// different workers on different cache lines.
+class alignas(64) WorkerMetrics {
+private:
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::COUNT)>
+      _counters;
+  std::atomic<uint64_t> _send_queue_depth;
+  std::vector<SubnetGauges> _subnets;
+
+public:
+  explicit WorkerMetrics(const size_t subnet_count);
+
+  void count(const Counter counter) {
+    std::atomic<uint64_t> &value = _counters[static_cast<size_t>(counter)];
+    value.store(value.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  }
+  uint64_t get(const Counter counter) const;
+  void set_send_queue_depth(const uint64_t depth);
+  uint64_t send_queue_depth() const;
+  SubnetGauges &subnet(const size_t subnet_index);
+  const SubnetGauges &subnet(const size_t subnet_index) const;
+};
+
+// The metrics of all workers, which are read without stopping them.
+class MetricsRegistry {
+private:
+  // net address and prefix length per subnet
+  std::vector<std::string> _subnet_labels;
+  std::vector<std::unique_ptr<WorkerMetrics>> _workers;
+
+public:
+  MetricsRegistry(const std::vector<SubnetConfiguration> &subnets,
+                  const uint32_t worker_count);
+
+  WorkerMetrics &worker(const uint32_t worker_index);
+  // Prometheus text exposition format
+  std::string render() const;
+  // one line summary for the STATUS of sd_notify()
+  std::string status() const;
+};
+
+// Writes the rendered metrics to every client that connects to a unix
+// socket, e.g. `socat - UNIX-CONNECT:<path>`, and closes the connection.
+class MetricsExporter {
+private:
+  int _socket_fd;
+  const std::string _path;
+  const MetricsRegistry &_registry;
+
+public:
+  MetricsExporter(const std::string &path, const MetricsRegistry &registry);
+  ~MetricsExporter() noexcept;
+  MetricsExporter(const MetricsExporter &other) = delete;
+
+  operator int() const;
+  // accepts all pending connections
+  void handle_connections();
+};
+} // namespace tinydhcpd
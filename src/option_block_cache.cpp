@@ -0,0 +1,76 @@
+#include "option_block_cache.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+namespace {
+// FNV-1a
+uint64_t hash_request_list(const std::span<const uint8_t> request_list) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const uint8_t byte : request_list) {
+    hash = (hash ^ byte) * 0x100000001b3;
+  }
+  return hash;
+}
+} // namespace
+
+OptionBlockCache::OptionBlockCache(
+    const std::map<OptionTag, std::vector<uint8_t>> &defined_options)
+    : _encoded(), _options{}, _entries() {
+  for (const auto &[tag, value] : defined_options) {
+    if (tag == OptionTag::LEASE_TIME) {
+      continue;
+    }
+    if (value.size() > UINT8_MAX) {
+      throw std::runtime_error(
+          string_format("Value of option %u is too long: %lu",
+                        static_cast<uint8_t>(tag), value.size()));
+    }
+    _options[static_cast<uint8_t>(tag)] =
+        EncodedOption{.offset = static_cast<uint16_t>(_encoded.size()),
+                      .length = static_cast<uint16_t>(2 + value.size())};
+    _encoded.push_back(static_cast<uint8_t>(tag));
+    _encoded.push_back(static_cast<uint8_t>(value.size()));
+    _encoded.insert(_encoded.end(), value.begin(), value.end());
+  }
+}
+
+void OptionBlockCache::build_block(const std::span<const uint8_t> request_list,
+                                   std::vector<uint8_t> &block) const {
+  block.clear();
+  std::array<uint64_t, 4> added{};
+  for (const uint8_t tag : request_list) {
+    const EncodedOption &option = _options[tag];
+    const uint64_t bit = uint64_t{1} << (tag % 64);
+    if (option.length == 0 || (added[tag / 64] & bit) != 0) {
+      continue;
+    }
+    added[tag / 64] |= bit;
+    block.insert(block.end(), _encoded.begin() + option.offset,
+                 _encoded.begin() + option.offset + option.length);
+  }
+}
+
+std::span<const uint8_t>
+OptionBlockCache::get(const std::span<const uint8_t> request_list) {
+  if (request_list.empty()) {
+    return {};
+  }
+  const uint64_t hash = hash_request_list(request_list);
+  Entry &entry = _entries[hash % CACHE_SIZE];
+  if (!entry.valid || entry.hash != hash ||
+      !std::equal(request_list.begin(), request_list.end(),
+                  entry.request_list.begin(), entry.request_list.end())) {
+    // the vectors keep their capacity, so replacing an entry rarely
+    // allocates
+    entry.request_list.assign(request_list.begin(), request_list.end());
+    build_block(request_list, entry.block);
+    entry.hash = hash;
+    entry.valid = true;
+  }
+  return entry.block;
+}
+} // namespace tinydhcpd
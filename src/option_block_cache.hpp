@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <vector>
+
+#include "dhcp_options.hpp"
+
+namespace tinydhcpd {
+// The configured options of a subnet, encoded as TLV bytes once at startup,
+// and the option blocks assembled from them for recently seen parameter
+// request lists. Clients running the same OS send identical lists, so most
+// replies reuse a finished block.
+class OptionBlockCache {
+private:
+  static constexpr size_t CACHE_SIZE = 64;
+
+  struct EncodedOption {
+    uint16_t offset; // into _encoded
+    uint16_t length; // including tag and length, 0 if not configured
+  };
+  struct Entry {
+    bool valid;
+    uint64_t hash;
+    std::vector<uint8_t> request_list;
+    std::vector<uint8_t> block;
+  };
+
+  std::vector<uint8_t> _encoded;
+  std::array<EncodedOption, 256> _options;
+  // direct-mapped by hash, a colliding request list replaces the entry
+  std::array<Entry, CACHE_SIZE> _entries;
+
+  void build_block(const std::span<const uint8_t> request_list,
+                   std::vector<uint8_t> &block) const;
+
+public:
+  // Options that differ per reply (e.g. the lease time) are left out. Throws
+  // std::runtime_error if a value does not fit into an option.
+  explicit OptionBlockCache(
+      const std::map<OptionTag, std::vector<uint8_t>> &defined_options);
+
+  // Returns the encoded configured options the request list asks for, in the
+  // requested order. The block stays valid until the next call.
+  std::span<const uint8_t> get(const std::span<const uint8_t> request_list);
+};
+} // namespace tinydhcpd
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace tinydhcpd {
+// How the value of an option is encoded, and written in the configuration.
+enum struct OptionType : uint8_t {
+  ADDRESS,       // "10.0.0.1"
+  ADDRESSES,     // "10.0.0.1" or ["10.0.0.1", "10.0.0.2"]
+  ADDRESS_PAIRS, // ["10.0.0.0", "255.0.0.0", ...], e.g. destination & router
+  INT32,
+  UINT8,
+  UINT16,
+  UINT16S, // [68, 296, 576, ...]
+  UINT32,
+  FLAG, // true / false, sent as 1 / 0
+  TEXT,
+  BYTES // [1, 2, 3, ...]
+};
+
+struct OptionDefinition {
+  std::string_view name; // empty for options not in the catalog
+  uint8_t code;
+  OptionType type;
+  uint8_t min_length;
+  uint8_t max_length;
+  uint8_t length_multiple;
+  // false for the options the server fills in itself
+  bool configurable;
+};
+
+namespace catalog_detail {
+constexpr OptionDefinition option(const std::string_view name,
+                                  const uint8_t code, const OptionType type,
+                                  const bool configurable = true) {
+  switch (type) {
+  case OptionType::ADDRESS:
+  case OptionType::INT32:
+  case OptionType::UINT32:
+    return {name, code, type, 4, 4, 4, configurable};
+  case OptionType::ADDRESSES:
+    return {name, code, type, 4, 252, 4, configurable};
+  case OptionType::ADDRESS_PAIRS:
+    return {name, code, type, 8, 248, 8, configurable};
+  case OptionType::UINT8:
+  case OptionType::FLAG:
+    return {name, code, type, 1, 1, 1, configurable};
+  case OptionType::UINT16:
+    return {name, code, type, 2, 2, 2, configurable};
+  case OptionType::UINT16S:
+    return {name, code, type, 2, 254, 2, configurable};
+  case OptionType::TEXT:
+  case OptionType::BYTES:
+    break;
+  }
+  return {name, code, type, 1, 255, 1, configurable};
+}
+
+constexpr OptionDefinition with_lengths(OptionDefinition definition,
+                                        const uint8_t min_length,
+                                        const uint8_t max_length) {
+  definition.min_length = min_length;
+  definition.max_length = max_length;
+  return definition;
+}
+
+using enum OptionType;
+
+// The options of RFC 2132, named like in ISC dhcpd. PAD and END carry no
+// value and are handled by the parser.
+inline constexpr std::array catalog = {
+    option("subnet-mask", 1, ADDRESS, false), // from netmask
+    option("time-offset", 2, INT32),
+    option("routers", 3, ADDRESSES),
+    option("time-servers", 4, ADDRESSES),
+    option("ien116-name-servers", 5, ADDRESSES),
+    option("domain-name-servers", 6, ADDRESSES),
+    option("log-servers", 7, ADDRESSES),
+    option("cookie-servers", 8, ADDRESSES),
+    option("lpr-servers", 9, ADDRESSES),
+    option("impress-servers", 10, ADDRESSES),
+    option("resource-location-servers", 11, ADDRESSES),
+    option("host-name", 12, TEXT),
+    option("boot-size", 13, UINT16),
+    option("merit-dump", 14, TEXT),
+    option("domain-name", 15, TEXT),
+    option("swap-server", 16, ADDRESS),
+    option("root-path", 17, TEXT),
+    option("extensions-path", 18, TEXT),
+    option("ip-forwarding", 19, FLAG),
+    option("non-local-source-routing", 20, FLAG),
+    option("policy-filter", 21, ADDRESS_PAIRS),
+    option("max-dgram-reassembly", 22, UINT16),
+    option("default-ip-ttl", 23, UINT8),
+    option("path-mtu-aging-timeout", 24, UINT32),
+    option("path-mtu-plateau-table", 25, UINT16S),
+    option("interface-mtu", 26, UINT16),
+    option("all-subnets-local", 27, FLAG),
+    option("broadcast-address", 28, ADDRESS),
+    option("perform-mask-discovery", 29, FLAG),
+    option("mask-supplier", 30, FLAG),
+    option("router-discovery", 31, FLAG),
+    option("router-solicitation-address", 32, ADDRESS),
+    option("static-routes", 33, ADDRESS_PAIRS),
+    option("trailer-encapsulation", 34, FLAG),
+    option("arp-cache-timeout", 35, UINT32),
+    option("ieee802-3-encapsulation", 36, FLAG),
+    option("default-tcp-ttl", 37, UINT8),
+    option("tcp-keepalive-interval", 38, UINT32),
+    option("tcp-keepalive-garbage", 39, FLAG),
+    option("nis-domain", 40, TEXT),
+    option("nis-servers", 41, ADDRESSES),
+    option("ntp-servers", 42, ADDRESSES),
+    option("vendor-encapsulated-options", 43, BYTES),
+    option("netbios-name-servers", 44, ADDRESSES),
+    option("netbios-dd-server", 45, ADDRESSES),
+    option("netbios-node-type", 46, UINT8),
+    option("netbios-scope", 47, TEXT),
+    option("font-servers", 48, ADDRESSES),
+    option("x-display-manager", 49, ADDRESSES),
+    option("dhcp-requested-address", 50, ADDRESS, false),
+    option("dhcp-lease-time", 51, UINT32, false), // from lease-time
+    option("dhcp-option-overload", 52, UINT8, false),
+    option("dhcp-message-type", 53, UINT8, false),
+    option("dhcp-server-identifier", 54, ADDRESS, false),
+    option("dhcp-parameter-request-list", 55, BYTES, false),
+    option("dhcp-message", 56, TEXT, false),
+    option("dhcp-max-message-size", 57, UINT16, false),
+    option("dhcp-renewal-time", 58, UINT32),
+    option("dhcp-rebinding-time", 59, UINT32),
+    option("vendor-class-identifier", 60, BYTES, false),
+    with_lengths(option("dhcp-client-identifier", 61, BYTES, false), 2, 255),
+    option("nisplus-domain", 64, TEXT),
+    option("nisplus-servers", 65, ADDRESSES),
+    option("tftp-server-name", 66, TEXT),
+    option("bootfile-name", 67, TEXT),
+    // may be empty if there are no home agents
+    with_lengths(option("mobile-ip-home-agent", 68, ADDRESSES), 0, 252),
+    option("smtp-server", 69, ADDRESSES),
+    option("pop-server", 70, ADDRESSES),
+    option("nntp-server", 71, ADDRESSES),
+    option("www-server", 72, ADDRESSES),
+    option("finger-server", 73, ADDRESSES),
+    option("irc-server", 74, ADDRESSES),
+    option("streettalk-server", 75, ADDRESSES),
+    option("streettalk-directory-assistance-server", 76, ADDRESSES),
+};
+
+constexpr bool catalog_is_consistent() {
+  std::array<bool, 256> seen{};
+  for (size_t i = 0; i < catalog.size(); i++) {
+    const OptionDefinition &definition = catalog[i];
+    if (definition.name.empty() || definition.code == 0 ||
+        definition.code == 255 || seen[definition.code] ||
+        definition.min_length > definition.max_length ||
+        definition.min_length % definition.length_multiple != 0 ||
+        definition.max_length % definition.length_multiple != 0) {
+      return false;
+    }
+    seen[definition.code] = true;
+    for (size_t j = 0; j < i; j++) {
+      if (catalog[j].name == definition.name) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+static_assert(catalog_is_consistent());
+} // namespace catalog_detail
+
+// The catalog indexed by option code. Options without an entry accept any
+// length and cannot be configured.
+inline constexpr std::array<OptionDefinition, 256> option_definitions = [] {
+  std::array<OptionDefinition, 256> definitions{};
+  for (size_t code = 0; code < definitions.size(); code++) {
+    definitions[code] =
+        OptionDefinition{.name = {},
+                         .code = static_cast<uint8_t>(code),
+                         .type = OptionType::BYTES,
+                         .min_length = 0,
+                         .max_length = 255,
+                         .length_multiple = 1,
+                         .configurable = false};
+  }
+  for (const OptionDefinition &definition : catalog_detail::catalog) {
+    definitions[definition.code] = definition;
+  }
+  return definitions;
+}();
+
+using OptionLengthSet = std::array<uint64_t, 4>;
+
+// Bit i of entry code is set if length i is legal for the option, so
+// checking a length neither branches on the type nor divides.
+inline constexpr std::array<OptionLengthSet, 256> legal_option_lengths = [] {
+  std::array<OptionLengthSet, 256> lengths{};
+  for (size_t code = 0; code < lengths.size(); code++) {
+    const OptionDefinition &definition = option_definitions[code];
+    for (size_t length = definition.min_length;
+         length <= definition.max_length;
+         length += definition.length_multiple) {
+      lengths[code][length / 64] |= uint64_t{1} << (length % 64);
+    }
+  }
+  return lengths;
+}();
+
+constexpr bool is_legal_option_length(const uint8_t code,
+                                      const uint8_t length) {
+  return (legal_option_lengths[code][length / 64] >> (length % 64)) & 1;
+}
+
+// returns nullptr for names not in the catalog
+constexpr const OptionDefinition *
+find_option_definition(const std::string_view name) {
+  for (const OptionDefinition &definition : catalog_detail::catalog) {
+    if (definition.name == name) {
+      return &option_definitions[definition.code];
+    }
+  }
+  return nullptr;
+}
+
+static_assert(is_legal_option_length(53, 1) && !is_legal_option_length(53, 2));
+static_assert(is_legal_option_length(3, 8) && !is_legal_option_length(3, 6));
+static_assert(is_legal_option_length(68, 0) && is_legal_option_length(200, 0));
+static_assert(find_option_definition("domain-name-servers")->code == 6);
+} // namespace tinydhcpd
@@ -0,0 +1,230 @@
+#include "packet_ring.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <linux/filter.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bytemanip.hpp"
+#include "datagram.hpp"
+#include "log/logger.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+constexpr uint16_t IP_FRAGMENT_MASK = 0x3fff; // MF flag and fragment offset
+
+PacketRing::PacketRing(const int ifindex, const uint32_t worker_index,
+                       const uint32_t worker_count)
+    : _socket_fd(-1), _ring(nullptr), _current_block(0) {
+  _socket_fd = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      htons(ETH_P_IP));
+  if (_socket_fd < 0) {
+    throw std::runtime_error(string_format(
+        "Failed to create packet socket: %s", strerror(errno)));
+  }
+  try {
+    int version = TPACKET_V3;
+    if (setsockopt(_socket_fd, SOL_PACKET, PACKET_VERSION, &version,
+                   sizeof(version)) < 0) {
+      throw std::runtime_error(string_format(
+          "Failed to select TPACKET_V3: %s", strerror(errno)));
+    }
+#ifdef PACKET_IGNORE_OUTGOING
+    // on older kernels, extract_payload() skips our own replies instead
+    int enable = 1;
+    setsockopt(_socket_fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &enable,
+               sizeof(enable));
+#endif
+    // filter before binding, so that no other traffic enters the ring
+    attach_filter();
+
+    struct tpacket_req3 request {};
+    request.tp_block_size = BLOCK_SIZE;
+    request.tp_block_nr = BLOCK_COUNT;
+    request.tp_frame_size = FRAME_SIZE;
+    request.tp_frame_nr = BLOCK_SIZE / FRAME_SIZE * BLOCK_COUNT;
+    request.tp_retire_blk_tov = BLOCK_TIMEOUT_MS;
+    if (setsockopt(_socket_fd, SOL_PACKET, PACKET_RX_RING, &request,
+                   sizeof(request)) < 0) {
+      throw std::runtime_error(string_format(
+          "Failed to set up the receive ring: %s", strerror(errno)));
+    }
+    void *ring = mmap(nullptr, size_t{BLOCK_SIZE} * BLOCK_COUNT,
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      _socket_fd, 0);
+    if (ring == MAP_FAILED) {
+      throw std::runtime_error(string_format(
+          "Failed to map the receive ring: %s", strerror(errno)));
+    }
+    _ring = static_cast<uint8_t *>(ring);
+
+    struct sockaddr_ll link_address {};
+    link_address.sll_family = AF_PACKET;
+    link_address.sll_protocol = htons(ETH_P_IP);
+    link_address.sll_ifindex = ifindex;
+    if (bind(_socket_fd, reinterpret_cast<struct sockaddr *>(&link_address),
+             sizeof(link_address)) < 0) {
+      throw std::runtime_error(string_format(
+          "Failed to bind packet socket: %s", strerror(errno)));
+    }
+    if (worker_count > 1) {
+      join_fanout_group(worker_index, worker_count);
+    }
+  } catch (std::runtime_error &ex) {
+    if (_ring != nullptr) {
+      munmap(_ring, size_t{BLOCK_SIZE} * BLOCK_COUNT);
+    }
+    close(_socket_fd);
+    throw;
+  }
+  LOG_INFO("Receiving through a %u KiB packet ring",
+           BLOCK_SIZE / 1024 * BLOCK_COUNT);
+}
+
+PacketRing::~PacketRing() noexcept {
+  munmap(_ring, size_t{BLOCK_SIZE} * BLOCK_COUNT);
+  close(_socket_fd);
+}
+
+PacketRing::operator int() const { return _socket_fd; }
+
+// Accepts unfragmented IPv4/UDP datagrams to the DHCP server port. The
+// program sees the frame starting at the Ethernet header.
+void PacketRing::attach_filter() {
+  struct sock_filter code[] = {
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IP, 0, 8),
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, IP_FRAGMENT_MASK, 4, 0),
+      // X = IP header length
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, DHCP_SERVER_PORT, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, UINT32_MAX),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog program {
+    .len = sizeof(code) / sizeof(code[0]), .filter = code
+  };
+  if (setsockopt(_socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &program,
+                 sizeof(program)) < 0) {
+    throw std::runtime_error(string_format(
+        "Failed to attach the packet filter: %s", strerror(errno)));
+  }
+}
+
+// Steers every frame to the ring with index hash(chaddr) % worker_count in
+// the fanout group, the same hash as the SO_REUSEPORT steering program of the
+// UDP socket. Rings are indexed in the order in which they joined, and the
+// program sees the frame starting at the IP header.
+void PacketRing::join_fanout_group(const uint32_t worker_index,
+                                   const uint32_t worker_count) {
+  // all workers run in the same process
+  const int fanout = (getpid() & 0xffff) | (PACKET_FANOUT_CBPF << 16);
+  if (setsockopt(_socket_fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+                 sizeof(fanout)) < 0) {
+    throw std::runtime_error(string_format(
+        "Failed to join the packet fanout group: %s", strerror(errno)));
+  }
+  if (worker_index != 0) {
+    return;
+  }
+  struct sock_filter code[] = {
+      // X = IP header length, chaddr starts 36 bytes after it
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+      BPF_STMT(BPF_LD | BPF_W | BPF_IND, 36),
+      BPF_STMT(BPF_ST, 0),
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 40),
+      BPF_STMT(BPF_LDX | BPF_W | BPF_MEM, 0),
+      BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+      BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, worker_count),
+      BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  struct sock_fprog program {
+    .len = sizeof(code) / sizeof(code[0]), .filter = code
+  };
+  if (setsockopt(_socket_fd, SOL_PACKET, PACKET_FANOUT_DATA, &program,
+                 sizeof(program)) < 0) {
+    throw std::runtime_error(string_format(
+        "Failed to attach the fanout steering program: %s", strerror(errno)));
+  }
+}
+
+struct tpacket_block_desc *PacketRing::ready_block() {
+  struct tpacket_block_desc *block =
+      reinterpret_cast<struct tpacket_block_desc *>(
+          _ring + size_t{_current_block} * BLOCK_SIZE);
+  // pairs with the kernel publishing the block contents
+  if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+       TP_STATUS_USER) == 0) {
+    return nullptr;
+  }
+  return block;
+}
+
+void PacketRing::release_block(struct tpacket_block_desc *block) {
+  __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                   __ATOMIC_RELEASE);
+  _current_block = (_current_block + 1) % BLOCK_COUNT;
+}
+
+bool PacketRing::extract_payload(struct tpacket3_hdr *packet,
+                                 uint8_t *&payload, size_t &length,
+                                 int &ifindex, in_addr_t &destination) {
+  const struct sockaddr_ll *link_address =
+      reinterpret_cast<const struct sockaddr_ll *>(
+          reinterpret_cast<uint8_t *>(packet) +
+          TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+  // frames to other hosts are only seen in promiscuous mode
+  if (link_address->sll_pkttype == PACKET_OUTGOING ||
+      link_address->sll_pkttype == PACKET_OTHERHOST) {
+    return false;
+  }
+  if (packet->tp_snaplen < packet->tp_len) {
+    LOG_WARN("Dropping truncated frame");
+    return false;
+  }
+  uint8_t *ip = reinterpret_cast<uint8_t *>(packet) + packet->tp_net;
+  const size_t ip_available =
+      packet->tp_snaplen - (packet->tp_net - packet->tp_mac);
+  if (ip_available < 20) {
+    return false;
+  }
+  const size_t ip_header_length = (ip[0] & 0x0f) * 4;
+  if (ip_header_length < 20 || ip_available < ip_header_length + 8 ||
+      ip[9] != IPPROTO_UDP ||
+      (load_network_order<uint16_t>(ip + 6) & IP_FRAGMENT_MASK) != 0) {
+    return false;
+  }
+  uint8_t *udp = ip + ip_header_length;
+  const uint16_t udp_length = load_network_order<uint16_t>(udp + 4);
+  if (load_network_order<uint16_t>(udp + 2) != DHCP_SERVER_PORT ||
+      udp_length < 8 || udp_length > ip_available - ip_header_length) {
+    return false;
+  }
+  // unlike the UDP socket, the packet socket leaves checksums to us
+  const uint16_t udp_checksum = load_network_order<uint16_t>(udp + 6);
+  if (udp_checksum != 0 &&
+      (packet->tp_status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY)) ==
+          0) {
+    uint32_t sum = add_to_checksum(IPPROTO_UDP + udp_length, ip + 12, 8);
+    if (finish_checksum(add_to_checksum(sum, udp, udp_length)) != 0) {
+      LOG_WARN("Dropping datagram with invalid UDP checksum");
+      return false;
+    }
+  }
+  payload = udp + 8;
+  length = udp_length - 8;
+  ifindex = link_address->sll_ifindex;
+  destination = load_network_order<uint32_t>(ip + 16);
+  return true;
+}
+} // namespace tinydhcpd
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/if_packet.h>
+#include <netinet/in.h>
+
+namespace tinydhcpd {
+// Receives DHCP requests through a memory-mapped TPACKET_V3 ring on a packet
+// socket. The kernel fills whole blocks of frames, which are parsed in place
+// and handed back once all of their messages have been processed, so
+// receiving needs neither a copy nor a syscall per message.
+class PacketRing {
+private:
+  static constexpr uint32_t BLOCK_SIZE = 1 << 18;
+  static constexpr uint32_t BLOCK_COUNT = 64;
+  static constexpr uint32_t FRAME_SIZE = 2048;
+  // a partially filled block is handed over after this long
+  static constexpr uint32_t BLOCK_TIMEOUT_MS = 4;
+
+  int _socket_fd;
+  uint8_t *_ring;
+  uint32_t _current_block;
+
+  void attach_filter();
+  void join_fanout_group(const uint32_t worker_index,
+                         const uint32_t worker_count);
+  // returns nullptr if the kernel has not handed over the next block yet
+  struct tpacket_block_desc *ready_block();
+  void release_block(struct tpacket_block_desc *block);
+  // Finds the UDP payload and the destination address (host byte order) of
+  // a frame, returns false for frames that are not incoming DHCP requests.
+  static bool extract_payload(struct tpacket3_hdr *packet, uint8_t *&payload,
+                              size_t &length, int &ifindex,
+                              in_addr_t &destination);
+
+public:
+  // Binds to the interface with the given index, or to all interfaces if it
+  // is 0. With worker_count > 1, the rings of all workers form a fanout group
+  // which distributes requests by client hardware address, just like the
+  // SO_REUSEPORT group of the UDP sockets. Requires CAP_NET_RAW.
+  PacketRing(const int ifindex, const uint32_t worker_index,
+             const uint32_t worker_count);
+  ~PacketRing() noexcept;
+  PacketRing(const PacketRing &other) = delete;
+
+  operator int() const;
+
+  // Calls callback(payload, length, ifindex, destination) for every DHCP
+  // request in the blocks that are ready, until the ring has been drained.
+  template <typename F> void drain(F callback) {
+    struct tpacket_block_desc *block;
+    while ((block = ready_block()) != nullptr) {
+      uint8_t *position = reinterpret_cast<uint8_t *>(block) +
+                          block->hdr.bh1.offset_to_first_pkt;
+      for (uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++) {
+        struct tpacket3_hdr *packet =
+            reinterpret_cast<struct tpacket3_hdr *>(position);
+        uint8_t *payload;
+        size_t length;
+        int ifindex;
+        in_addr_t destination;
+        if (extract_payload(packet, payload, length, ifindex, destination)) {
+          callback(payload, length, ifindex, destination);
+        }
+        position += packet->tp_next_offset;
+      }
+      release_block(block);
+    }
+  }
+};
+} // namespace tinydhcpd
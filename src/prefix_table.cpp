@@ -0,0 +1,83 @@
+#include "prefix_table.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <stdexcept>
+
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+namespace {
+uint64_t last_address(const PrefixTable::Prefix &prefix) {
+  return uint64_t{prefix.network} + (uint64_t{1} << (32 - prefix.length)) - 1;
+}
+} // namespace
+
+PrefixTable::PrefixTable(std::vector<Prefix> prefixes) : _intervals() {
+  for (Prefix &prefix : prefixes) {
+    prefix.network &=
+        prefix.length == 0 ? 0 : UINT32_MAX << (32 - prefix.length);
+  }
+  // a prefix sorts before every prefix it contains
+  std::sort(prefixes.begin(), prefixes.end(),
+            [](const Prefix &lhs, const Prefix &rhs) {
+              return lhs.network != rhs.network ? lhs.network < rhs.network
+                                                : lhs.length < rhs.length;
+            });
+  for (size_t i = 1; i < prefixes.size(); i++) {
+    if (prefixes[i].network == prefixes[i - 1].network &&
+        prefixes[i].length == prefixes[i - 1].length) {
+      throw std::invalid_argument(string_format(
+          "Prefix %s/%u is given more than once",
+          inet_ntoa({.s_addr = htonl(prefixes[i].network)}),
+          prefixes[i].length));
+    }
+  }
+
+  // Prefixes either nest or are disjoint, so the ones containing the current
+  // position form a stack with the most specific one on top.
+  std::vector<const Prefix *> enclosing;
+  uint64_t next = 0; // first address without an interval yet
+  const auto emit = [this, &next](const uint64_t last, const uint32_t value) {
+    if (next <= last) {
+      _intervals.push_back(Interval{.first = static_cast<in_addr_t>(next),
+                                    .last = static_cast<in_addr_t>(last),
+                                    .value = value});
+    }
+    next = last + 1;
+  };
+  for (const Prefix &prefix : prefixes) {
+    while (!enclosing.empty() && last_address(*enclosing.back()) <
+                                     uint64_t{prefix.network}) {
+      emit(last_address(*enclosing.back()), enclosing.back()->value);
+      enclosing.pop_back();
+    }
+    if (!enclosing.empty() && prefix.network > next) {
+      emit(prefix.network - 1, enclosing.back()->value);
+    }
+    next = prefix.network;
+    enclosing.push_back(&prefix);
+  }
+  while (!enclosing.empty()) {
+    emit(last_address(*enclosing.back()), enclosing.back()->value);
+    enclosing.pop_back();
+  }
+}
+
+std::optional<uint32_t>
+PrefixTable::find(const in_addr_t address_hostorder) const {
+  auto interval = std::upper_bound(
+      _intervals.cbegin(), _intervals.cend(), address_hostorder,
+      [](const in_addr_t address, const Interval &candidate) {
+        return address < candidate.first;
+      });
+  if (interval == _intervals.cbegin()) {
+    return std::nullopt;
+  }
+  --interval;
+  if (address_hostorder > interval->last) {
+    return std::nullopt;
+  }
+  return interval->value;
+}
+} // namespace tinydhcpd
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <netinet/in.h>
+#include <optional>
+#include <vector>
+
+namespace tinydhcpd {
+// Longest prefix match over a fixed set of IPv4 prefixes. The prefixes are
+// flattened into disjoint address intervals, each labelled with the most
+// specific prefix that covers it, so a lookup is a single binary search over
+// a flat array no matter how deeply the prefixes nest.
+class PrefixTable {
+public:
+  struct Prefix {
+    in_addr_t network; // host byte order
+    uint8_t length;
+    uint32_t value;
+  };
+
+private:
+  struct Interval {
+    in_addr_t first;
+    in_addr_t last;
+    uint32_t value;
+  };
+
+  // sorted by first address
+  std::vector<Interval> _intervals;
+
+public:
+  PrefixTable() = default;
+  // Throws std::invalid_argument if a prefix is given more than once.
+  explicit PrefixTable(std::vector<Prefix> prefixes);
+
+  // returns the value of the longest prefix containing the address
+  std::optional<uint32_t> find(const in_addr_t address_hostorder) const;
+};
+} // namespace tinydhcpd
@@ -0,0 +1,129 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <ctime>
+
+namespace tinydhcpd {
+namespace {
+constexpr size_t HWADDR_LENGTH_OFFSET = 2;
+constexpr size_t CLIENT_HWADDR_OFFSET = 28;
+constexpr size_t CLIENT_HWADDR_SIZE = 16;
+
+// wraps after 49 days, which only matters for buckets idle for that long
+uint32_t coarse_time_ms() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return static_cast<uint32_t>(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+RateLimit split_limit(const RateLimit &limit, const uint32_t worker_count) {
+  if (limit.rate == 0) {
+    return limit;
+  }
+  return RateLimit{.rate = std::max<uint32_t>(limit.rate / worker_count, 1),
+                   .burst = std::max<uint32_t>(limit.burst / worker_count, 1)};
+}
+} // namespace
+
+RateLimiter::RateLimiter(const RateLimitConfiguration &config,
+                         const uint32_t worker_count)
+    : _client_limit(config.client),
+      _interface_limit(split_limit(config.interface, worker_count)),
+      _global_limit(split_limit(config.global, worker_count)),
+      _clients(config.client.rate > 0 ? CLIENT_TABLE_SIZE : 0),
+      _interfaces(),
+      _global{.tokens = _global_limit.burst * TOKEN,
+              .last_refill_ms = coarse_time_ms()} {}
+
+bool RateLimiter::refill(TokenBucket &bucket, const RateLimit &limit,
+                         const uint32_t now_ms) {
+  const uint32_t elapsed_ms = now_ms - bucket.last_refill_ms;
+  // `rate` tokens per second are `rate` thousandths per millisecond
+  bucket.tokens = std::min(limit.burst * TOKEN,
+                           bucket.tokens + uint64_t{elapsed_ms} * limit.rate);
+  bucket.last_refill_ms = now_ms;
+  return bucket.tokens >= TOKEN;
+}
+
+void RateLimiter::take(TokenBucket &bucket) {
+  bucket.tokens -= TOKEN;
+}
+
+RateLimiter::TokenBucket *RateLimiter::find_client(const uint8_t *payload,
+                                                   const size_t length,
+                                                   const uint32_t now_ms) {
+  if (length < CLIENT_HWADDR_OFFSET + CLIENT_HWADDR_SIZE) {
+    // not a DHCP message, the parser rejects it
+    return nullptr;
+  }
+  const size_t hwaddr_length =
+      std::min<size_t>(payload[HWADDR_LENGTH_OFFSET], CLIENT_HWADDR_SIZE);
+  std::array<uint8_t, CLIENT_HWADDR_SIZE> hwaddr{};
+  std::memcpy(hwaddr.data(), payload + CLIENT_HWADDR_OFFSET, hwaddr_length);
+  uint64_t low, high;
+  std::memcpy(&low, hwaddr.data(), sizeof(low));
+  std::memcpy(&high, hwaddr.data() + sizeof(low), sizeof(high));
+  uint64_t hash = low * 0x9e3779b97f4a7c15 ^
+                  (high + hwaddr_length) * 0xc2b2ae3d27d4eb4f;
+  hash ^= hash >> 29;
+  const uint64_t key = hash | 1;
+
+  ClientEntry &entry = _clients[(hash >> 7) & (CLIENT_TABLE_SIZE - 1)];
+  if (entry.key != key) {
+    entry.key = key;
+    entry.bucket = TokenBucket{.tokens = _client_limit.burst * TOKEN,
+                               .last_refill_ms = now_ms};
+  }
+  return &entry.bucket;
+}
+
+RateLimiter::TokenBucket *RateLimiter::find_interface(const int ifindex,
+                                                      const uint32_t now_ms) {
+  if (ifindex < 0) {
+    return nullptr;
+  }
+  if (static_cast<size_t>(ifindex) >= _interfaces.size()) {
+    _interfaces.resize(ifindex + 1,
+                       TokenBucket{.tokens = _interface_limit.burst * TOKEN,
+                                   .last_refill_ms = now_ms});
+  }
+  return &_interfaces[ifindex];
+}
+
+RateLimitVerdict RateLimiter::admit(const uint8_t *payload,
+                                    const size_t length, const int ifindex) {
+  if (_client_limit.rate == 0 && _interface_limit.rate == 0 &&
+      _global_limit.rate == 0) {
+    return RateLimitVerdict::ACCEPT;
+  }
+  const uint32_t now_ms = coarse_time_ms();
+  TokenBucket *client = _client_limit.rate > 0
+                            ? find_client(payload, length, now_ms)
+                            : nullptr;
+  if (client != nullptr && !refill(*client, _client_limit, now_ms)) {
+    return RateLimitVerdict::CLIENT;
+  }
+  TokenBucket *interface = _interface_limit.rate > 0
+                               ? find_interface(ifindex, now_ms)
+                               : nullptr;
+  if (interface != nullptr && !refill(*interface, _interface_limit, now_ms)) {
+    return RateLimitVerdict::INTERFACE;
+  }
+  if (_global_limit.rate > 0 && !refill(_global, _global_limit, now_ms)) {
+    return RateLimitVerdict::GLOBAL;
+  }
+
+  if (client != nullptr) {
+    take(*client);
+  }
+  if (interface != nullptr) {
+    take(*interface);
+  }
+  if (_global_limit.rate > 0) {
+    take(_global);
+  }
+  return RateLimitVerdict::ACCEPT;
+}
+} // namespace tinydhcpd
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tinydhcpd {
+struct RateLimit {
+  // messages per second, 0 = unlimited
+  uint32_t rate;
+  // messages that may arrive at once after a quiet period
+  uint32_t burst;
+};
+
+struct RateLimitConfiguration {
+  // per client hardware address
+  RateLimit client;
+  // per receiving interface, shared by all workers
+  RateLimit interface;
+  // for the whole server, shared by all workers
+  RateLimit global;
+};
+
+enum struct RateLimitVerdict { ACCEPT, CLIENT, INTERFACE, GLOBAL };
+
+// Token buckets that decide whether a message is handled at all, before its
+// options are parsed. A message is only accepted if the buckets of its
+// client, its interface and the server all have a token left, so a client
+// that floods the server runs out of tokens before the others.
+//
+// Clients are tracked in a fixed-size table indexed by a hash of their
+// hardware address. A client that hashes to a taken slot replaces its
+// previous owner, which starts over with a full bucket when it returns, so
+// collisions can only make the limit more lenient.
+class RateLimiter {
+private:
+  static constexpr size_t CLIENT_TABLE_SIZE = 4096; // power of 2
+  // a message costs one token, buckets are kept in thousandths
+  static constexpr uint64_t TOKEN = 1000;
+
+  struct TokenBucket {
+    uint64_t tokens;
+    uint32_t last_refill_ms;
+  };
+  struct ClientEntry {
+    uint64_t key; // hash of the hardware address, 0 = unused
+    TokenBucket bucket;
+  };
+
+  const RateLimit _client_limit;
+  const RateLimit _interface_limit;
+  const RateLimit _global_limit;
+  std::vector<ClientEntry> _clients;
+  // indexed by interface index
+  std::vector<TokenBucket> _interfaces;
+  TokenBucket _global;
+
+  static bool refill(TokenBucket &bucket, const RateLimit &limit,
+                     const uint32_t now_ms);
+  static void take(TokenBucket &bucket);
+  TokenBucket *find_client(const uint8_t *payload, const size_t length,
+                           const uint32_t now_ms);
+  TokenBucket *find_interface(const int ifindex, const uint32_t now_ms);
+
+public:
+  // The interface and global limits are split evenly between the workers.
+  RateLimiter(const RateLimitConfiguration &config,
+              const uint32_t worker_count);
+
+  // Takes a token from every bucket of the raw message, unless one of them
+  // is empty.
+  RateLimitVerdict admit(const uint8_t *payload, const size_t length,
+                         const int ifindex);
+};
+} // namespace tinydhcpd
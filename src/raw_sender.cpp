@@ -0,0 +1,156 @@
+#include "raw_sender.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <linux/if_packet.h>
+#include <net/if_arp.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bytemanip.hpp"
+#include "log/logger.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+constexpr uint8_t DEFAULT_TTL = 64;
+
+RawSender::RawSender() : _socket_fd(-1), _templates(), _frame() {
+  // protocol 0, so the socket never receives anything
+  _socket_fd = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_socket_fd < 0) {
+    throw std::runtime_error(string_format(
+        "Failed to create packet socket: %s", strerror(errno)));
+  }
+}
+
+RawSender::~RawSender() noexcept {
+  if (_socket_fd >= 0) {
+    close(_socket_fd);
+  }
+}
+
+const RawSender::FrameTemplate &
+RawSender::get_template(const int ifindex, const InterfaceInfo &interface) {
+  if (static_cast<size_t>(ifindex) >= _templates.size()) {
+    _templates.resize(ifindex + 1);
+  }
+  std::optional<FrameTemplate> &frame_template = _templates[ifindex];
+  if (frame_template.has_value() &&
+      frame_template->source_address == interface.address &&
+      frame_template->source_hwaddr == interface.hwaddr) {
+    return frame_template.value();
+  }
+
+  frame_template = FrameTemplate{.source_address = interface.address,
+                                 .source_hwaddr = interface.hwaddr,
+                                 .headers = {},
+                                 .ip_checksum_base = 0,
+                                 .udp_checksum_base = 0};
+  uint8_t *headers = frame_template->headers.data();
+  struct ether_header ethernet {};
+  std::copy(interface.hwaddr.cbegin(), interface.hwaddr.cend(),
+            ethernet.ether_shost);
+  ethernet.ether_type = htons(ETHERTYPE_IP);
+  std::memcpy(headers, &ethernet, sizeof(ethernet));
+
+  // the length, destination and checksum are filled in per reply
+  struct iphdr ip {};
+  ip.version = 4;
+  ip.ihl = sizeof(ip) / 4;
+  ip.frag_off = htons(IP_DF);
+  ip.ttl = DEFAULT_TTL;
+  ip.protocol = IPPROTO_UDP;
+  ip.saddr = htonl(interface.address);
+  std::memcpy(headers + sizeof(ethernet), &ip, sizeof(ip));
+
+  struct udphdr udp {};
+  udp.source = htons(DHCP_SERVER_PORT);
+  udp.dest = htons(DHCP_CLIENT_PORT);
+  std::memcpy(headers + sizeof(ethernet) + sizeof(ip), &udp, sizeof(udp));
+
+  frame_template->ip_checksum_base =
+      add_to_checksum(0, headers + sizeof(ethernet), sizeof(ip));
+  frame_template->udp_checksum_base =
+      add_to_checksum(IPPROTO_UDP, interface.address);
+  return frame_template.value();
+}
+
+bool RawSender::send(const int ifindex, const InterfaceInfo &interface,
+                     const DhcpDatagram &request, const DhcpDatagram &reply,
+                     const in_addr_t destination) {
+  if (interface.link_type != ARPHRD_ETHER ||
+      request._hwaddr_type != ARPHRD_ETHER || request._hwaddr_len != ETH_ALEN) {
+    return false;
+  }
+  const FrameTemplate &frame_template = get_template(ifindex, interface);
+
+  const size_t ip_offset = sizeof(struct ether_header);
+  const size_t udp_offset = ip_offset + sizeof(struct iphdr);
+  // the limit requested by the client includes the IP and UDP headers
+  size_t max_ip_size =
+      std::min<size_t>(reply._max_message_size, MAX_PAYLOAD_SIZE);
+  if (interface.mtu != 0) {
+    max_ip_size = std::min<size_t>(max_ip_size, interface.mtu);
+  }
+  size_t payload_size;
+  try {
+    payload_size = reply.encode(_frame.data() + HEADERS_SIZE,
+                                max_ip_size - (HEADERS_SIZE - ip_offset));
+  } catch (std::invalid_argument &ex) {
+    LOG_ERROR(ex.what());
+    return true;
+  }
+  std::copy(frame_template.headers.cbegin(), frame_template.headers.cend(),
+            _frame.begin());
+
+  struct ether_header ethernet;
+  std::memcpy(&ethernet, _frame.data(), sizeof(ethernet));
+  std::copy(request._hw_addr.cbegin(), request._hw_addr.cbegin() + ETH_ALEN,
+            ethernet.ether_dhost);
+  std::memcpy(_frame.data(), &ethernet, sizeof(ethernet));
+
+  const uint16_t udp_length =
+      static_cast<uint16_t>(sizeof(struct udphdr) + payload_size);
+  const uint16_t ip_length =
+      static_cast<uint16_t>(sizeof(struct iphdr) + udp_length);
+
+  struct iphdr ip;
+  std::memcpy(&ip, _frame.data() + ip_offset, sizeof(ip));
+  ip.tot_len = htons(ip_length);
+  ip.daddr = htonl(destination);
+  ip.check = htons(finish_checksum(add_to_checksum(
+      frame_template.ip_checksum_base + ip_length, destination)));
+  std::memcpy(_frame.data() + ip_offset, &ip, sizeof(ip));
+
+  struct udphdr udp;
+  std::memcpy(&udp, _frame.data() + udp_offset, sizeof(udp));
+  udp.len = htons(udp_length);
+  std::memcpy(_frame.data() + udp_offset, &udp, sizeof(udp));
+  // pseudo header, then the UDP header and payload
+  uint32_t udp_sum = add_to_checksum(
+      frame_template.udp_checksum_base + udp_length, destination);
+  udp_sum = add_to_checksum(udp_sum, _frame.data() + udp_offset, udp_length);
+  const uint16_t udp_checksum = finish_checksum(udp_sum);
+  // a zero checksum means that none was computed
+  udp.check = htons(udp_checksum == 0 ? 0xffff : udp_checksum);
+  std::memcpy(_frame.data() + udp_offset, &udp, sizeof(udp));
+
+  struct sockaddr_ll link_address {};
+  link_address.sll_family = AF_PACKET;
+  link_address.sll_protocol = htons(ETH_P_IP);
+  link_address.sll_ifindex = ifindex;
+  link_address.sll_halen = ETH_ALEN;
+  std::copy(request._hw_addr.cbegin(), request._hw_addr.cbegin() + ETH_ALEN,
+            link_address.sll_addr);
+  if (sendto(_socket_fd, _frame.data(), sizeof(struct ether_header) + ip_length,
+             0, reinterpret_cast<struct sockaddr *>(&link_address),
+             sizeof(link_address)) < 0) {
+    // clients retransmit their requests, so a dropped reply is not fatal
+    LOG_WARN("Failed to send raw reply: %s", strerror(errno));
+  }
+  return true;
+}
+} // namespace tinydhcpd
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <optional>
+#include <vector>
+
+#include "datagram.hpp"
+#include "interface_cache.hpp"
+
+namespace tinydhcpd {
+// Sends unicast replies as complete Ethernet frames through a packet socket,
+// addressed directly to the client hardware address. Unlike replies sent
+// through the UDP socket, these need no ARP entry for the client.
+class RawSender {
+private:
+  static constexpr size_t HEADERS_SIZE = sizeof(struct ether_header) +
+                                         sizeof(struct iphdr) +
+                                         sizeof(struct udphdr);
+  static constexpr size_t MAX_PAYLOAD_SIZE = 1500;
+
+  // headers with every field that only depends on the interface filled in
+  struct FrameTemplate {
+    in_addr_t source_address;
+    std::array<uint8_t, ETH_ALEN> source_hwaddr;
+    std::array<uint8_t, HEADERS_SIZE> headers;
+    // partial sums of the IP header and the UDP pseudo header
+    uint32_t ip_checksum_base;
+    uint32_t udp_checksum_base;
+  };
+
+  int _socket_fd;
+  // indexed by interface index
+  std::vector<std::optional<FrameTemplate>> _templates;
+  std::array<uint8_t, sizeof(struct ether_header) + MAX_PAYLOAD_SIZE> _frame;
+
+  const FrameTemplate &get_template(const int ifindex,
+                                    const InterfaceInfo &interface);
+
+public:
+  // requires CAP_NET_RAW
+  RawSender();
+  ~RawSender() noexcept;
+  RawSender(const RawSender &other) = delete;
+
+  // Sends the reply to the hardware address of the request and the given
+  // address (host byte order). Returns false if the reply cannot be sent
+  // this way because the interface or the client are not on Ethernet.
+  bool send(const int ifindex, const InterfaceInfo &interface,
+            const DhcpDatagram &request, const DhcpDatagram &reply,
+            const in_addr_t destination);
+};
+} // namespace tinydhcpd
@@ -0,0 +1,72 @@
+#include "reply_cache.hpp"
+
+namespace tinydhcpd {
+namespace {
+// FNV-1a
+uint64_t hash_hwaddr(const HardwareAddress &hwaddr) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < hwaddr.length; i++) {
+    hash = (hash ^ hwaddr.octets[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+} // namespace
+
+ReplyCache::ReplyCache() : _entries(CACHE_SIZE) {}
+
+ReplyCache::Entry &ReplyCache::slot(const HardwareAddress &hwaddr) {
+  return _entries[hash_hwaddr(hwaddr) & (CACHE_SIZE - 1)];
+}
+
+const CachedReply *ReplyCache::find(const DhcpDatagram &request,
+                                    const uint8_t request_type,
+                                    const uint64_t current_time_seconds) {
+  const HardwareAddress hwaddr(request._hw_addr, request._hwaddr_len);
+  const Entry &entry = slot(hwaddr);
+  if (!entry.valid || entry.expiry_timestamp <= current_time_seconds ||
+      entry.transaction_id != request._transaction_id ||
+      entry.request_type != request_type ||
+      entry.relay_agent_ip != request._relay_agent_ip ||
+      entry.recv_ifindex != request._recv_ifindex || entry.hwaddr != hwaddr) {
+    return nullptr;
+  }
+  return &entry.reply;
+}
+
+void ReplyCache::insert(const DhcpDatagram &request,
+                        const uint8_t request_type,
+                        const uint64_t expiry_timestamp,
+                        const struct sockaddr_in &destination,
+                        const int ifindex, const in_addr_t source_address,
+                        const uint8_t message_type,
+                        const std::span<const uint8_t> data) {
+  const HardwareAddress hwaddr(request._hw_addr, request._hwaddr_len);
+  Entry &entry = slot(hwaddr);
+  entry.valid = true;
+  entry.hwaddr = hwaddr;
+  entry.transaction_id = request._transaction_id;
+  entry.request_type = request_type;
+  entry.relay_agent_ip = request._relay_agent_ip;
+  entry.recv_ifindex = request._recv_ifindex;
+  entry.expiry_timestamp = expiry_timestamp;
+  entry.reply.destination = destination;
+  entry.reply.ifindex = ifindex;
+  entry.reply.source_address = source_address;
+  entry.reply.message_type = message_type;
+  // keeps its capacity, so replacing an entry rarely allocates
+  entry.reply.data.assign(data.begin(), data.end());
+}
+
+void ReplyCache::erase(const HardwareAddress &hwaddr) {
+  Entry &entry = slot(hwaddr);
+  if (entry.valid && entry.hwaddr == hwaddr) {
+    entry.valid = false;
+  }
+}
+
+void ReplyCache::clear() {
+  for (Entry &entry : _entries) {
+    entry.valid = false;
+  }
+}
+} // namespace tinydhcpd
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <netinet/in.h>
+#include <span>
+#include <vector>
+
+#include "datagram.hpp"
+#include "lease_table.hpp"
+
+namespace tinydhcpd {
+// An encoded reply and where it was sent through the UDP socket.
+struct CachedReply {
+  struct sockaddr_in destination;
+  int ifindex;
+  in_addr_t source_address; // host byte order
+  uint8_t message_type;
+  std::vector<uint8_t> data;
+};
+
+// The replies recently sent to DISCOVERs and REQUESTs, so that a client
+// retransmitting its request gets the same reply again without the lease
+// state being touched a second time.
+//
+// Requests are matched by client hardware address, transaction id, message
+// type, relay agent and receiving interface. The cache is direct-mapped by
+// hardware address, so each client has at most one reply cached and a
+// colliding client replaces it.
+class ReplyCache {
+private:
+  static constexpr size_t CACHE_SIZE = 1024; // power of 2
+
+  struct Entry {
+    bool valid;
+    HardwareAddress hwaddr;
+    uint32_t transaction_id;
+    uint8_t request_type;
+    in_addr_t relay_agent_ip;
+    int recv_ifindex;
+    uint64_t expiry_timestamp;
+    CachedReply reply;
+  };
+
+  std::vector<Entry> _entries;
+
+  Entry &slot(const HardwareAddress &hwaddr);
+
+public:
+  ReplyCache();
+
+  // Returns the reply to an earlier copy of the request, or nullptr. The
+  // reply stays valid until the next insert() or erase().
+  const CachedReply *find(const DhcpDatagram &request,
+                          const uint8_t request_type,
+                          const uint64_t current_time_seconds);
+  void insert(const DhcpDatagram &request, const uint8_t request_type,
+              const uint64_t expiry_timestamp,
+              const struct sockaddr_in &destination, const int ifindex,
+              const in_addr_t source_address, const uint8_t message_type,
+              const std::span<const uint8_t> data);
+  // forgets the reply to the client, e.g. after it gave up its lease
+  void erase(const HardwareAddress &hwaddr);
+  void clear();
+};
+} // namespace tinydhcpd
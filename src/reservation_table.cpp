@@ -0,0 +1,111 @@
+#include "reservation_table.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <bit>
+#include <netinet/ether.h>
+#include <stdexcept>
+
+#include "hash.hpp"
+#include "string-format.hpp"
+
+namespace tinydhcpd {
+ReservationTable::ReservationTable()
+    : _reservations(), _hwaddr_index(), _address_index() {}
+
+ReservationTable::ReservationTable(std::vector<Reservation> reservations)
+    : _reservations(std::move(reservations)), _hwaddr_index(),
+      _address_index() {
+  if (_reservations.empty()) {
+    return;
+  }
+  // at most half full, so probe sequences stay short
+  const size_t capacity = std::bit_ceil(2 * _reservations.size());
+  _hwaddr_index.assign(capacity, EMPTY_SLOT);
+  _address_index.assign(capacity, EMPTY_SLOT);
+  const size_t mask = capacity - 1;
+  for (uint32_t slot = 0; slot < _reservations.size(); slot++) {
+    const Reservation &reservation = _reservations[slot];
+    size_t position = hwaddr_bucket(reservation.hwaddr.data());
+    while (_hwaddr_index[position] != EMPTY_SLOT) {
+      if (_reservations[_hwaddr_index[position]].hwaddr ==
+          reservation.hwaddr) {
+        throw std::invalid_argument(string_format(
+            "%s has more than one fixed address!",
+            ether_ntoa(reinterpret_cast<const struct ether_addr *>(
+                reservation.hwaddr.data()))));
+      }
+      position = (position + 1) & mask;
+    }
+    _hwaddr_index[position] = slot;
+
+    position = address_bucket(reservation.address);
+    while (_address_index[position] != EMPTY_SLOT) {
+      if (_reservations[_address_index[position]].address ==
+          reservation.address) {
+        throw std::invalid_argument(string_format(
+            "%s is the fixed address of more than one host!",
+            inet_ntoa({.s_addr = htonl(reservation.address)})));
+      }
+      position = (position + 1) & mask;
+    }
+    _address_index[position] = slot;
+  }
+}
+
+size_t ReservationTable::hwaddr_bucket(const uint8_t *hwaddr) const {
+  uint64_t key = 0;
+  for (size_t i = 0; i < ETHER_ADDR_LEN; i++) {
+    key = (key << 8) | hwaddr[i];
+  }
+  return mix(key) & (_hwaddr_index.size() - 1);
+}
+
+size_t ReservationTable::address_bucket(const in_addr_t address) const {
+  return mix(address) & (_address_index.size() - 1);
+}
+
+const Reservation *ReservationTable::find(const HardwareAddress &hwaddr) const {
+  if (_reservations.empty() || hwaddr.length != ETHER_ADDR_LEN) {
+    return nullptr;
+  }
+  const size_t mask = _hwaddr_index.size() - 1;
+  for (size_t position = hwaddr_bucket(hwaddr.octets.data());
+       _hwaddr_index[position] != EMPTY_SLOT;
+       position = (position + 1) & mask) {
+    const Reservation &reservation = _reservations[_hwaddr_index[position]];
+    if (std::equal(reservation.hwaddr.begin(), reservation.hwaddr.end(),
+                   hwaddr.octets.begin())) {
+      return &reservation;
+    }
+  }
+  return nullptr;
+}
+
+const Reservation *
+ReservationTable::find_by_address(const in_addr_t address_hostorder) const {
+  if (_reservations.empty()) {
+    return nullptr;
+  }
+  const size_t mask = _address_index.size() - 1;
+  for (size_t position = address_bucket(address_hostorder);
+       _address_index[position] != EMPTY_SLOT;
+       position = (position + 1) & mask) {
+    const Reservation &reservation = _reservations[_address_index[position]];
+    if (reservation.address == address_hostorder) {
+      return &reservation;
+    }
+  }
+  return nullptr;
+}
+
+size_t ReservationTable::size() const { return _reservations.size(); }
+
+std::vector<Reservation>::const_iterator ReservationTable::begin() const {
+  return _reservations.begin();
+}
+
+std::vector<Reservation>::const_iterator ReservationTable::end() const {
+  return _reservations.end();
+}
+} // namespace tinydhcpd
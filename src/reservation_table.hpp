@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <vector>
+
+#include "lease_table.hpp"
+
+namespace tinydhcpd {
+struct Reservation {
+  std::array<uint8_t, ETHER_ADDR_LEN> hwaddr;
+  in_addr_t address; // host byte order
+};
+
+// The fixed addresses of a subnet, built once when the configuration is
+// loaded. Two open-addressing indices map Ethernet addresses and reserved
+// addresses to the reservations, so both lookups take constant time however
+// many hosts are configured.
+class ReservationTable {
+private:
+  static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+  std::vector<Reservation> _reservations;
+  std::vector<uint32_t> _hwaddr_index;
+  std::vector<uint32_t> _address_index;
+
+  size_t hwaddr_bucket(const uint8_t *hwaddr) const;
+  size_t address_bucket(const in_addr_t address) const;
+
+public:
+  ReservationTable();
+  // Throws std::invalid_argument if a hardware address or an address is
+  // reserved twice.
+  explicit ReservationTable(std::vector<Reservation> reservations);
+
+  // only Ethernet addresses can have a reservation
+  const Reservation *find(const HardwareAddress &hwaddr) const;
+  const Reservation *find_by_address(const in_addr_t address_hostorder) const;
+  size_t size() const;
+  std::vector<Reservation>::const_iterator begin() const;
+  std::vector<Reservation>::const_iterator end() const;
+};
+} // namespace tinydhcpd
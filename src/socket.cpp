@@ -1,25 +1,47 @@
 #include "socket.hpp"
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <linux/filter.h>
 #include <net/if.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
 #include "bytemanip.hpp"
+#include "datagram.hpp"
 #include "log/logger.hpp"
 #include "string-format.hpp"
 
-#define DGRAM_SIZE 576
-
 namespace tinydhcpd {
-Socket::Socket(const struct in_addr &address, const std::string &iface_name,
-               SocketObserver &observer)
-    : _observer(observer), _listen_address{.sin_family = AF_INET,
-                                           .sin_port = htons(PORT),
-                                           .sin_addr = address,
-                                           .sin_zero = {}},
-      _server_ip(address.s_addr), _send_queue() {
+Socket::Socket(const struct in_addr &address,
+               const std::vector<std::string> &iface_names,
+               const uint32_t io_batch_size, const uint32_t worker_index,
+               const uint32_t worker_count,
+               const ReceiveBackend receive_backend,
+               const RateLimitConfiguration &rate_limits,
+               SocketObserver &observer, WorkerMetrics &metrics)
+    : _observer(observer), _metrics(metrics),
+      _rate_limiter(rate_limits, worker_count),
+      _listen_address{.sin_family = AF_INET,
+                      .sin_port = htons(DHCP_SERVER_PORT),
+                      .sin_addr = address,
+                      .sin_zero = {}},
+      _recv_slots(io_batch_size), _recv_iovecs(io_batch_size),
+      _recv_headers(io_batch_size),
+      _send_queue(std::max<size_t>(SEND_QUEUE_CAPACITY, io_batch_size)),
+      _send_queue_head(0), _send_queue_length(0), _send_iovecs(io_batch_size),
+      _send_headers(io_batch_size), _packet_ring() {
+  for (size_t i = 0; i < io_batch_size; i++) {
+    _recv_iovecs[i] = {.iov_base = _recv_slots[i].data.data(),
+                       .iov_len = _recv_slots[i].data.size()};
+    _recv_headers[i].msg_hdr.msg_iov = &_recv_iovecs[i];
+    _recv_headers[i].msg_hdr.msg_iovlen = 1;
+    _recv_headers[i].msg_hdr.msg_control = _recv_slots[i].control.data();
+    _send_headers[i].msg_hdr.msg_iov = &_send_iovecs[i];
+    _send_headers[i].msg_hdr.msg_iovlen = 1;
+  }
+
   _socket_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
   if (_socket_fd == -1) {
     die("Failed to create socket: ");
@@ -34,7 +56,9 @@ Socket::Socket(const struct in_addr &address, const std::string &iface_name,
     die("Failed to set socket option SO_BROADCAST: ");
   }
 
-  if (!iface_name.empty()) {
+  // with several interfaces, the daemon drops requests from other ones
+  if (iface_names.size() == 1) {
+    const std::string &iface_name = iface_names.front();
     struct ifreq ireq {};
     ireq.ifr_addr.sa_family = AF_INET;
     std::copy(iface_name.begin(), iface_name.end(), ireq.ifr_name);
@@ -45,22 +69,71 @@ Socket::Socket(const struct in_addr &address, const std::string &iface_name,
       msg.append(": ");
       die(msg);
     }
-    LOG_INFO(string_format("Binding to interface %s", iface_name.c_str()));
-    if (_server_ip == INADDR_ANY) {
-      if (ioctl(_socket_fd, SIOCGIFADDR, &ireq) < 0) {
-        die("ioctl SIOCGIFADDR failed: ");
-      }
-      _server_ip = ((struct sockaddr_in *)&ireq.ifr_addr)->sin_addr.s_addr;
+    LOG_INFO("Binding to interface %s", iface_name.c_str());
+  } else {
+    for (const std::string &iface_name : iface_names) {
+      LOG_INFO("Serving interface %s", iface_name.c_str());
     }
   }
 
+  if (worker_count > 1 &&
+      setsockopt(_socket_fd, SOL_SOCKET, SO_REUSEPORT, &enable,
+                 sizeof(enable)) < 0) {
+    die("Failed to set socket option SO_REUSEPORT: ");
+  }
+
   if (bind(_socket_fd, (const sockaddr *)&_listen_address,
            sizeof(_listen_address)) == -1) {
     die("Failed to bind socket: ");
   }
-  LOG_INFO(string_format("Listening on address %s",
-                         inet_ntoa({.s_addr = _server_ip})));
-  if (!iface_name.empty()) {
+  if (receive_backend == ReceiveBackend::PACKET_RING) {
+    // the UDP socket stays bound, or the kernel would answer every request
+    // with an ICMP port unreachable
+    attach_drop_program();
+    const int ifindex = iface_names.size() == 1
+                            ? if_nametoindex(iface_names.front().c_str())
+                            : 0;
+    _packet_ring.emplace(ifindex, worker_index, worker_count);
+  } else if (worker_count > 1 && worker_index == 0) {
+    // the program applies to the whole group, so the first worker installs it
+    attach_steering_program(worker_count);
+  }
+  LOG_INFO("Listening on address %s", inet_ntoa(_listen_address.sin_addr));
+}
+
+// Steers every message to the socket with index hash(chaddr) % worker_count
+// in the SO_REUSEPORT group, so the same client always reaches the same
+// worker. Sockets are indexed in the order in which they were bound, and the
+// program sees the message starting at the UDP payload.
+void Socket::attach_steering_program(const uint32_t worker_count) {
+  struct sock_filter code[] = {
+      // A = chaddr[0..3], X = A
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 28),
+      BPF_STMT(BPF_MISC | BPF_TAX, 0),
+      // A = chaddr[4..5] ^ X
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 32),
+      BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+      BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, worker_count),
+      BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  struct sock_fprog program {
+    .len = sizeof(code) / sizeof(code[0]), .filter = code
+  };
+  if (setsockopt(_socket_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program,
+                 sizeof(program)) < 0) {
+    die("Failed to attach the worker steering program: ");
+  }
+}
+
+// Makes the UDP socket discard everything it receives.
+void Socket::attach_drop_program() {
+  struct sock_filter code[] = {BPF_STMT(BPF_RET | BPF_K, 0)};
+  struct sock_fprog program {
+    .len = 1, .filter = code
+  };
+  if (setsockopt(_socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &program,
+                 sizeof(program)) < 0) {
+    die("Failed to attach the drop program: ");
   }
 }
 
@@ -74,75 +147,124 @@ void Socket::die(std::string error_msg) {
 }
 
 bool Socket::handle_epollin() {
-  uint8_t raw_data_buffer[DGRAM_SIZE];
-  uint8_t control_msg_buffer[256];
-  struct iovec data_buffer {
-    .iov_base = raw_data_buffer, .iov_len = DGRAM_SIZE
-  };
-  struct msghdr message_header {
-    .msg_name = nullptr, .msg_namelen = 0, .msg_iov = &data_buffer,
-    .msg_iovlen = 1,
-#ifdef __MUSL__
-    // musl libc adheres more strictly to POSIX, which necessitates some padding
-    // Functionally this is the same as default initialization, but I don't like
-    // the compiler complaining if the field initializers are missing
-        .__pad1 = 0,
-#endif
-    .msg_control = &control_msg_buffer, .msg_controllen = 256,
-#ifdef __MUSL__
-    .__pad2 = 0,
-#endif
-    .msg_flags = 0,
-  };
-  std::fill(raw_data_buffer, raw_data_buffer + DGRAM_SIZE, (uint8_t)0);
-
-  if (recvmsg(_socket_fd, &message_header, MSG_WAITALL) < 0) {
-    if (errno == EWOULDBLOCK) {
-      return true;
+  for (size_t i = 0; i < _recv_headers.size(); i++) {
+    // the kernel overwrites this with the length it actually used
+    _recv_headers[i].msg_hdr.msg_controllen = _recv_slots[i].control.size();
+  }
+  const int received = recvmmsg(_socket_fd, _recv_headers.data(),
+                                _recv_headers.size(), MSG_DONTWAIT, nullptr);
+  if (received < 0) {
+    if (errno == EINTR) {
+      return false;
     }
-    return false;
+    if (errno != EWOULDBLOCK) {
+      LOG_ERROR("Receive failed: %s", strerror(errno));
+    }
+    return true;
+  }
+  for (int i = 0; i < received; i++) {
+    handle_message(_recv_slots[i], _recv_headers[i]);
+  }
+  // a short batch means that the socket has been drained
+  return static_cast<size_t>(received) < _recv_headers.size();
+}
+
+void Socket::handle_message(ReceiveSlot &slot, struct mmsghdr &header) {
+  if ((header.msg_hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
+    LOG_WARN("Dropping truncated message");
+    return;
+  }
+  const int ifindex = extract_interface_index(header.msg_hdr);
+  if (ifindex < 0) {
+    LOG_WARN("No control message with packet info!");
+    return;
+  }
+  handle_payload(slot.data.data(), header.msg_len, ifindex);
+}
+
+int Socket::packet_ring_fd() const {
+  return _packet_ring.has_value() ? static_cast<int>(*_packet_ring) : -1;
+}
+
+void Socket::handle_packet_ring() {
+  _packet_ring->drain(
+      [this](uint8_t *payload, const size_t length, const int ifindex,
+             const in_addr_t destination) {
+        // unlike the UDP socket, the ring also sees requests to other hosts
+        if (_observer.accepts_destination(ifindex, destination)) {
+          handle_payload(payload, length, ifindex);
+        }
+      });
+}
+
+void Socket::handle_payload(uint8_t *payload, const size_t length,
+                            const int ifindex) {
+  switch (_rate_limiter.admit(payload, length, ifindex)) {
+  case RateLimitVerdict::ACCEPT:
+    break;
+  case RateLimitVerdict::CLIENT:
+    _metrics.count(Counter::RATE_LIMITED_CLIENT);
+    return;
+  case RateLimitVerdict::INTERFACE:
+    _metrics.count(Counter::RATE_LIMITED_INTERFACE);
+    return;
+  case RateLimitVerdict::GLOBAL:
+    _metrics.count(Counter::RATE_LIMITED_GLOBAL);
+    return;
   }
   try {
-    DhcpDatagram datagram =
-        DhcpDatagram::from_buffer(raw_data_buffer, DGRAM_SIZE);
-    if (datagram._server_ip == static_cast<uint32_t>(0x0)) {
-      datagram._server_ip = _server_ip;
-    }
-    auto iface_info = extract_interface_info(message_header);
-    datagram._recv_addr = iface_info.first;
-    datagram._recv_iface = iface_info.second;
+    DhcpDatagram datagram = DhcpDatagram::from_buffer(payload, length);
+    datagram._recv_ifindex = ifindex;
     _observer.handle_recv(datagram);
   } catch (std::invalid_argument &ex) {
+    _metrics.count(Counter::PARSE_ERROR);
     LOG_ERROR(ex.what());
   }
-  std::fill(raw_data_buffer, raw_data_buffer + DGRAM_SIZE, (uint8_t)0);
-  return false;
 }
 
 bool Socket::handle_epollout() {
-  if (_send_queue.empty()) {
+  if (_send_queue_length == 0) {
     return false;
   }
 
-  struct sockaddr_in destination = _send_queue.front().first;
-  std::vector<uint8_t> data = _send_queue.front().second.to_byte_vector();
-  if (sendto(_socket_fd, data.data(), data.size(), MSG_DONTWAIT,
-             reinterpret_cast<struct sockaddr *>(&destination),
-             sizeof(destination)) == -1) {
+  // only slots that are contiguous in the ring can be sent in one batch
+  const size_t count =
+      std::min({_send_queue_length, _send_queue.size() - _send_queue_head,
+                _send_headers.size()});
+  for (size_t i = 0; i < count; i++) {
+    EncodedDatagram &encoded = _send_queue[_send_queue_head + i];
+    _send_iovecs[i] = {.iov_base = encoded.data.data(),
+                       .iov_len = encoded.length};
+    _send_headers[i].msg_hdr.msg_name = &encoded.destination;
+    _send_headers[i].msg_hdr.msg_namelen = sizeof(encoded.destination);
+    _send_headers[i].msg_hdr.msg_control = encoded.control.data();
+    _send_headers[i].msg_hdr.msg_controllen = encoded.control.size();
+  }
+  int sent = sendmmsg(_socket_fd, _send_headers.data(), count, MSG_DONTWAIT);
+  if (sent < 0) {
     if (errno == EWOULDBLOCK) {
+      _metrics.count(Counter::SEND_WOULD_BLOCK);
       return true;
-    } else {
-      LOG_ERROR("Send failed!");
     }
+    if (errno == EINTR) {
+      return false;
+    }
+    LOG_ERROR("Send failed: %s", strerror(errno));
+    // drop the datagram that could not be sent
+    sent = 1;
   }
-  _send_queue.pop();
+  _send_queue_head = (_send_queue_head + sent) % _send_queue.size();
+  _send_queue_length -= sent;
   return false;
 }
 
-bool Socket::has_waiting_messages() { return _send_queue.size() > 0; }
+void Socket::handle_tick() { _observer.handle_tick(); }
+
+bool Socket::has_waiting_messages() { return _send_queue_length > 0; }
 
-std::pair<in_addr_t, std::string>
-Socket::extract_interface_info(struct msghdr &message_header) {
+size_t Socket::send_queue_length() const { return _send_queue_length; }
+
+int Socket::extract_interface_index(struct msghdr &message_header) {
   for (struct cmsghdr *control_message = CMSG_FIRSTHDR(&message_header);
        control_message != nullptr;
        control_message = CMSG_NXTHDR(&message_header, control_message)) {
@@ -152,24 +274,77 @@ Socket::extract_interface_info(struct msghdr &message_header) {
     }
     struct in_pktinfo *packet_info =
         reinterpret_cast<struct in_pktinfo *>(CMSG_DATA(control_message));
-    const int if_index = packet_info->ipi_ifindex;
-    struct ifreq ireq {};
-    ireq.ifr_addr.sa_family = AF_INET;
-    ireq.ifr_ifindex = if_index;
-    if (ioctl(_socket_fd, SIOCGIFNAME, &ireq) != 0)
-      die("Failed to get interface name: ");
-    ioctl(_socket_fd, SIOCGIFADDR, &ireq);
-    std::string iface_name(ireq.ifr_name);
-    return std::make_pair(
-        ntohl(reinterpret_cast<struct sockaddr_in *>(&ireq.ifr_addr)
-                  ->sin_addr.s_addr),
-        iface_name);
-  }
-  die("No control message with packet info!");
+    return packet_info->ipi_ifindex;
+  }
+  return -1;
+}
+
+Socket::EncodedDatagram *Socket::reserve_send_slot() {
+  if (_send_queue_length == _send_queue.size()) {
+    // make room by sending right away instead of waiting for the event loop
+    bool would_block = false;
+    while (_send_queue_length > 0 && !would_block) {
+      would_block = handle_epollout();
+    }
+    if (_send_queue_length == _send_queue.size()) {
+      _metrics.count(Counter::SEND_QUEUE_FULL);
+      LOG_WARN("Send queue is full, dropping reply");
+      return nullptr;
+    }
+  }
+  return &_send_queue[(_send_queue_head + _send_queue_length) %
+                      _send_queue.size()];
 }
 
-void Socket::enqueue_datagram(struct sockaddr_in &destination,
-                              DhcpDatagram &datagram) {
-  _send_queue.push(std::make_pair(destination, datagram));
+void Socket::commit_send_slot(EncodedDatagram &encoded,
+                              const struct sockaddr_in &destination,
+                              const int ifindex,
+                              const in_addr_t source_address) {
+  encoded.destination = destination;
+  struct cmsghdr *control_message =
+      reinterpret_cast<struct cmsghdr *>(encoded.control.data());
+  control_message->cmsg_level = IPPROTO_IP;
+  control_message->cmsg_type = IP_PKTINFO;
+  control_message->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+  const struct in_pktinfo packet_info {
+    .ipi_ifindex = ifindex, .ipi_spec_dst = {.s_addr = htonl(source_address)},
+    .ipi_addr = {}
+  };
+  memcpy(CMSG_DATA(control_message), &packet_info, sizeof(packet_info));
+  _send_queue_length++;
+}
+
+std::span<const uint8_t>
+Socket::enqueue_datagram(const struct sockaddr_in &destination,
+                         const int ifindex, const in_addr_t source_address,
+                         const DhcpDatagram &datagram) {
+  EncodedDatagram *encoded = reserve_send_slot();
+  if (encoded == nullptr) {
+    return {};
+  }
+  try {
+    // the limit requested by the client includes the IP and UDP headers
+    const size_t capacity =
+        std::min<size_t>(encoded->data.size(),
+                         datagram._max_message_size - IP_UDP_HEADER_SIZE);
+    encoded->length = datagram.encode(encoded->data.data(), capacity);
+  } catch (std::invalid_argument &ex) {
+    LOG_ERROR(ex.what());
+    return {};
+  }
+  commit_send_slot(*encoded, destination, ifindex, source_address);
+  return std::span<const uint8_t>(encoded->data.data(), encoded->length);
+}
+
+void Socket::enqueue_encoded(const struct sockaddr_in &destination,
+                             const int ifindex, const in_addr_t source_address,
+                             const std::span<const uint8_t> data) {
+  EncodedDatagram *encoded = reserve_send_slot();
+  if (encoded == nullptr) {
+    return;
+  }
+  encoded->length = std::min(data.size(), encoded->data.size());
+  std::copy_n(data.begin(), encoded->length, encoded->data.begin());
+  commit_send_slot(*encoded, destination, ifindex, source_address);
 }
 } // namespace tinydhcpd
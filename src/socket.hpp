@@ -1,26 +1,84 @@
 #pragma once
 
-#include <queue>
+#include <array>
+#include <netinet/in.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
 
+#include "metrics.hpp"
+#include "packet_ring.hpp"
+#include "rate_limiter.hpp"
 #include "socket_observer.hpp"
 
-#define PORT 67
-
 namespace tinydhcpd {
+enum struct ReceiveBackend { SOCKET, PACKET_RING };
+
 class Socket {
 private:
+  static constexpr size_t MAX_DGRAM_SIZE = 1500;
+  static constexpr size_t IP_UDP_HEADER_SIZE = 28;
+  static constexpr size_t SEND_QUEUE_CAPACITY = 256;
+
+  struct ReceiveSlot {
+    std::array<uint8_t, MAX_DGRAM_SIZE> data;
+    std::array<uint8_t, CMSG_SPACE(sizeof(struct in_pktinfo))> control;
+  };
+
+  // replies are encoded on enqueue, so sending is a plain copy-free syscall
+  struct EncodedDatagram {
+    struct sockaddr_in destination;
+    // IP_PKTINFO selecting the outgoing interface and source address
+    std::array<uint8_t, CMSG_SPACE(sizeof(struct in_pktinfo))> control;
+    size_t length;
+    std::array<uint8_t, MAX_DGRAM_SIZE> data;
+  };
+
   int _socket_fd;
   SocketObserver &_observer;
+  WorkerMetrics &_metrics;
+  RateLimiter _rate_limiter;
   const struct sockaddr_in _listen_address;
-  in_addr_t _server_ip;
-  std::queue<std::pair<struct sockaddr_in, DhcpDatagram>> _send_queue;
+  // one slot per message of a recvmmsg() batch
+  std::vector<ReceiveSlot> _recv_slots;
+  std::vector<struct iovec> _recv_iovecs;
+  std::vector<struct mmsghdr> _recv_headers;
+  // ring buffer of preallocated slots
+  std::vector<EncodedDatagram> _send_queue;
+  size_t _send_queue_head;
+  size_t _send_queue_length;
+  std::vector<struct iovec> _send_iovecs;
+  std::vector<struct mmsghdr> _send_headers;
+  // replaces recvmmsg() on the UDP socket if set
+  std::optional<PacketRing> _packet_ring;
   [[noreturn]] void die(std::string error_msg);
-  std::pair<in_addr_t, std::string>
-  extract_interface_info(struct msghdr &message_header);
+  int extract_interface_index(struct msghdr &message_header);
+  void handle_message(ReceiveSlot &slot, struct mmsghdr &header);
+  void handle_payload(uint8_t *payload, const size_t length,
+                      const int ifindex);
+  void attach_steering_program(const uint32_t worker_count);
+  void attach_drop_program();
+  // nullptr if the send queue is full
+  EncodedDatagram *reserve_send_slot();
+  void commit_send_slot(EncodedDatagram &encoded,
+                        const struct sockaddr_in &destination,
+                        const int ifindex, const in_addr_t source_address);
 
 public:
-  Socket(const struct in_addr &address, const std::string &iface_name,
-         SocketObserver &observer);
+  // The socket is bound to the interface if exactly one is given, and
+  // receives on all of them otherwise.
+  // With worker_count > 1, the socket joins an SO_REUSEPORT group in which
+  // messages are distributed by client hardware address. The sockets have to
+  // be created in the order of their worker_index.
+  // Messages over the rate limits are dropped before they are parsed.
+  Socket(const struct in_addr &address,
+         const std::vector<std::string> &iface_names,
+         const uint32_t io_batch_size, const uint32_t worker_index,
+         const uint32_t worker_count, const ReceiveBackend receive_backend,
+         const RateLimitConfiguration &rate_limits, SocketObserver &observer,
+         WorkerMetrics &metrics);
   ~Socket() noexcept;
   Socket(Socket &&other) noexcept = default;
   // forbid copy construction, only one socket
@@ -29,11 +87,25 @@ public:
 
   operator int();
 
-  void enqueue_datagram(struct sockaddr_in &destination,
-                        DhcpDatagram &datagram);
+  // sends through the interface with the given index, from the given source
+  // address (host byte order). Returns the encoded datagram, which stays
+  // valid until the next call, or an empty span if it has been dropped.
+  std::span<const uint8_t>
+  enqueue_datagram(const struct sockaddr_in &destination, const int ifindex,
+                   const in_addr_t source_address,
+                   const DhcpDatagram &datagram);
+  // like enqueue_datagram(), for a datagram that has already been encoded
+  void enqueue_encoded(const struct sockaddr_in &destination,
+                       const int ifindex, const in_addr_t source_address,
+                       const std::span<const uint8_t> data);
   bool has_waiting_messages();
+  size_t send_queue_length() const;
   bool handle_epollin();
+  // -1 unless receiving through a packet ring
+  int packet_ring_fd() const;
+  void handle_packet_ring();
   bool handle_epollout();
+  void handle_tick();
 };
 
 } // namespace tinydhcpd
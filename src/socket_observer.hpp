@@ -9,5 +9,12 @@ public:
   virtual ~SocketObserver(){};
 
   virtual void handle_recv(tinydhcpd::DhcpDatagram &datagram) = 0;
+  // Whether a request sent to the destination address (host byte order) is
+  // meant for this server. Only asked for requests from the packet ring, the
+  // kernel already filters those received on the UDP socket.
+  virtual bool accepts_destination(const int ifindex,
+                                   const in_addr_t destination) = 0;
+  // called periodically from the event loop, also when no packets arrive
+  virtual void handle_tick() = 0;
 };
 } // namespace tinydhcpd
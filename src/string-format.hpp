@@ -1,9 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdio>
 #include <iostream>
 #include <memory>
+#include <string_view>
+#include <type_traits>
 
 namespace tinydhcpd {
+constexpr size_t FORMAT_BUFFER_SIZE = 512;
+
 // from
 // https://stackoverflow.com/questions/2342162/stdstring-formatting-like-sprintf
 template <typename... Args>
@@ -20,4 +27,21 @@ std::string string_format(const std::string &format, Args... args) {
   return std::string(buf.get(),
                      buf.get() + size - 1); // We don't want the '\0' inside
 }
+
+// Formats into a buffer that belongs to the calling thread, without
+// allocating. The result is cut off at FORMAT_BUFFER_SIZE - 1 characters and
+// only valid until the next call.
+template <typename... Args>
+std::string_view format_to_buffer(const char *format, Args... args) {
+  static_assert((std::is_scalar_v<Args> && ...),
+                "Only scalars and C strings can be formatted!");
+  thread_local std::array<char, FORMAT_BUFFER_SIZE> buffer;
+  const int length =
+      std::snprintf(buffer.data(), buffer.size(), format, args...);
+  if (length < 0) {
+    return {};
+  }
+  return std::string_view(
+      buffer.data(), std::min(static_cast<size_t>(length), buffer.size() - 1));
+}
 } // namespace tinydhcpd
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace tinydhcpd::test {
+struct TestCase {
+  const char *name;
+  std::function<void()> body;
+};
+
+std::vector<TestCase> &test_cases();
+// records a failure of the running test case, which continues
+void fail(const char *file, const int line, const std::string &message);
+
+// Adds a test case to the ones run by tests/main.cpp.
+struct TestRegistration {
+  TestRegistration(const char *name, std::function<void()> body) {
+    test_cases().push_back(TestCase{.name = name, .body = std::move(body)});
+  }
+};
+} // namespace tinydhcpd::test
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      ::tinydhcpd::test::fail(__FILE__, __LINE__, #condition);                 \
+    }                                                                          \
+  } while (false)
+
+#define CHECK_THROWS(expression, exception)                                    \
+  do {                                                                         \
+    try {                                                                      \
+      expression;                                                              \
+      ::tinydhcpd::test::fail(__FILE__, __LINE__,                              \
+                              #expression " did not throw " #exception);       \
+    } catch (const exception &) {                                              \
+    }                                                                          \
+  } while (false)
@@ -0,0 +1,46 @@
+#include <libconfig.h++>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "src/configuration.hpp"
+
+namespace tinydhcpd::test {
+namespace {
+std::vector<uint8_t> encode_address(const char *option_name,
+                                    const char *address) {
+  libconfig::Config config;
+  libconfig::Setting &setting =
+      config.getRoot().add("value", libconfig::Setting::TypeString);
+  setting = address;
+  return encode_option_value(*find_option_definition(option_name), setting);
+}
+
+const TestRegistration address_option_encoded(
+    "configuration/address_option_is_encoded_in_network_order", [] {
+      CHECK(encode_address("routers", "10.0.0.1") ==
+            std::vector<uint8_t>({10, 0, 0, 1}));
+    });
+
+const TestRegistration invalid_address_rejected(
+    "configuration/invalid_address_is_rejected", [] {
+      CHECK_THROWS(encode_address("routers", "bogus"), std::invalid_argument);
+      CHECK_THROWS(encode_address("routers", "10.0.0.256"),
+                   std::invalid_argument);
+      // inet_aton would read this as 10.0.0.1
+      CHECK_THROWS(encode_address("routers", "10.1"), std::invalid_argument);
+    });
+
+const TestRegistration invalid_address_names_option(
+    "configuration/invalid_address_error_names_the_option", [] {
+      try {
+        encode_address("domain-name-servers", "bogus");
+        fail(__FILE__, __LINE__, "the address was accepted");
+      } catch (const std::invalid_argument &ex) {
+        CHECK(std::string(ex.what()).find("domain-name-servers") !=
+              std::string::npos);
+      }
+    });
+} // namespace
+} // namespace tinydhcpd::test
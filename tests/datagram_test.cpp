@@ -0,0 +1,84 @@
+#include <vector>
+
+#include "check.hpp"
+#include "src/datagram.hpp"
+
+namespace tinydhcpd::test {
+namespace {
+constexpr size_t OPTIONS_OFFSET = 240;
+
+DhcpDatagram relayed_reply() {
+  DhcpDatagram reply{._opcode = 0x2,
+                     ._hwaddr_type = 0x1,
+                     ._hwaddr_len = 6,
+                     ._transaction_id = 0x1234,
+                     ._secs_passed = 0,
+                     ._flags = 0,
+                     ._client_ip = INADDR_ANY,
+                     ._assigned_ip = 0x0a000005,
+                     ._server_ip = INADDR_ANY,
+                     ._relay_agent_ip = 0x0a000001,
+                     ._recv_addr = INADDR_ANY,
+                     ._recv_ifindex = 0,
+                     ._max_message_size = DEFAULT_MAX_MESSAGE_SIZE,
+                     ._hw_addr = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+                     ._options = DhcpOptions(),
+                     ._option_block = {}};
+  reply._options.set(OptionTag::DHCP_MESSAGE_TYPE, {5});
+  reply._options.set(OptionTag::SERVER_IDENTIFIER, {10, 0, 0, 1});
+  reply._options.set(OptionTag::RELAY_AGENT_INFORMATION, {1, 2, 'a', 'b'});
+  reply._options.set(OptionTag::LEASE_TIME, {0, 0, 0x0e, 0x10});
+  return reply;
+}
+
+// the tags of the encoded options, in the order in which they were written
+std::vector<uint8_t> encoded_tags(const DhcpDatagram &datagram) {
+  std::vector<uint8_t> buffer(datagram.encoded_size());
+  datagram.encode(buffer.data(), buffer.size());
+  std::vector<uint8_t> tags;
+  size_t offset = OPTIONS_OFFSET;
+  while (offset < buffer.size() &&
+         buffer[offset] != static_cast<uint8_t>(OptionTag::OPTIONS_END)) {
+    tags.push_back(buffer[offset]);
+    offset += 2 + buffer[offset + 1];
+  }
+  return tags;
+}
+
+const TestRegistration relay_information_last(
+    "datagram/relay_agent_information_is_last_option", [] {
+      DhcpDatagram reply = relayed_reply();
+      // configured options, e.g. routers and a tag above 82
+      const std::vector<uint8_t> option_block = {3,   4, 10, 0, 0, 1,
+                                                 119, 3, 1,  'a', 0};
+      reply._option_block = option_block;
+      const std::vector<uint8_t> tags = encoded_tags(reply);
+      CHECK(tags.size() == 6);
+      CHECK(tags.front() == static_cast<uint8_t>(OptionTag::DHCP_MESSAGE_TYPE));
+      CHECK(tags.back() ==
+            static_cast<uint8_t>(OptionTag::RELAY_AGENT_INFORMATION));
+
+      // the relay agent information survives decoding unchanged
+      std::vector<uint8_t> buffer(reply.encoded_size());
+      reply.encode(buffer.data(), buffer.size());
+      const DhcpDatagram decoded =
+          DhcpDatagram::from_buffer(buffer.data(), buffer.size());
+      const std::span<const uint8_t> relay_information =
+          decoded._options.get(OptionTag::RELAY_AGENT_INFORMATION);
+      CHECK(std::vector<uint8_t>(relay_information.begin(),
+                                 relay_information.end()) ==
+            std::vector<uint8_t>({1, 2, 'a', 'b'}));
+    });
+
+const TestRegistration relay_information_without_block(
+    "datagram/relay_agent_information_last_without_option_block", [] {
+      DhcpDatagram reply = relayed_reply();
+      // options are otherwise written in ascending tag order
+      reply._options.set(static_cast<OptionTag>(119), {1, 'a', 0});
+      const std::vector<uint8_t> tags = encoded_tags(reply);
+      CHECK(tags.size() == 5);
+      CHECK(tags.back() ==
+            static_cast<uint8_t>(OptionTag::RELAY_AGENT_INFORMATION));
+    });
+} // namespace
+} // namespace tinydhcpd::test
@@ -0,0 +1,44 @@
+// Runs every registered test case and exits with a failure if any check
+// failed. `meson test` runs it.
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+#include "check.hpp"
+
+namespace tinydhcpd::test {
+namespace {
+size_t failures = 0;
+}
+
+std::vector<TestCase> &test_cases() {
+  static std::vector<TestCase> cases;
+  return cases;
+}
+
+void fail(const char *file, const int line, const std::string &message) {
+  std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line,
+               message.c_str());
+  failures++;
+}
+} // namespace tinydhcpd::test
+
+int main() {
+  using namespace tinydhcpd::test;
+  size_t failed_cases = 0;
+  for (const TestCase &test_case : test_cases()) {
+    const size_t previous_failures = failures;
+    try {
+      test_case.body();
+    } catch (std::exception &ex) {
+      fail(__FILE__, __LINE__,
+           std::string("unexpected exception: ") + ex.what());
+    }
+    const bool passed = failures == previous_failures;
+    std::printf("%s %s\n", passed ? "PASS" : "FAIL", test_case.name);
+    failed_cases += passed ? 0 : 1;
+  }
+  std::printf("%lu of %lu test cases failed\n", failed_cases,
+              test_cases().size());
+  return failed_cases == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
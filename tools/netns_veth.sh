@@ -0,0 +1,36 @@
+#!/bin/sh
+# Sets up a veth pair with one end in a separate network namespace, so that
+# the daemon (e.g. with receive-backend: "packet-ring" and raw-unicast: true)
+# can be exercised with a real DHCP client on the other end:
+#
+#   # tools/netns_veth.sh up
+#   # tinydhcpd -f -i tdhcp0 -c <config serving 10.99.0.0/24>
+#   # ip netns exec tdhcp-client udhcpc -f -i tdhcp1
+#   # tools/netns_veth.sh down
+
+NAMESPACE=${NAMESPACE:-tdhcp-client}
+SERVER_IFACE=${SERVER_IFACE:-tdhcp0}
+CLIENT_IFACE=${CLIENT_IFACE:-tdhcp1}
+SERVER_ADDRESS=${SERVER_ADDRESS:-10.99.0.1/24}
+
+set -e
+
+case "$1" in
+up)
+    ip netns add "${NAMESPACE}"
+    ip link add "${SERVER_IFACE}" type veth peer name "${CLIENT_IFACE}"
+    ip link set "${CLIENT_IFACE}" netns "${NAMESPACE}"
+    ip addr add "${SERVER_ADDRESS}" dev "${SERVER_IFACE}"
+    ip link set "${SERVER_IFACE}" up
+    ip -n "${NAMESPACE}" link set lo up
+    ip -n "${NAMESPACE}" link set "${CLIENT_IFACE}" up
+    ;;
+down)
+    ip link del "${SERVER_IFACE}" || true
+    ip netns del "${NAMESPACE}" || true
+    ;;
+*)
+    echo "Usage: $0 up|down" >&2
+    exit 1
+    ;;
+esac